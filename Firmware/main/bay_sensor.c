@@ -0,0 +1,110 @@
+#include "bay_sensor.h"
+#include "i2c_bus.h"
+#include "sht3x.h"
+
+#include "esp_timer.h"
+
+#include <string.h>
+
+#define SHT3x_FETCH_DATA_CMD    0xE000
+
+// Three missed fetches and the reading is too old to act on.
+#define BAY_STALE_US            (3 * BAY_FETCH_INTERVAL_MS * 1000LL)
+
+static sht3x_sensor_t *sensor = NULL;
+
+// fetch command -> read 6 bytes, chained on the bus task
+static i2c_bus_txn_t fetch_txn;
+static i2c_bus_txn_t read_txn;
+static const uint8_t fetch_cmd[2] = { SHT3x_FETCH_DATA_CMD >> 8, SHT3x_FETCH_DATA_CMD & 0xFF };
+static sht3x_raw_data_t raw;
+static volatile bool fetching = false;
+static int64_t next_fetch_us = 0;
+
+static portMUX_TYPE reading_mux = portMUX_INITIALIZER_UNLOCKED;
+static bay_reading_t reading;
+
+static void fetch_failed()
+{
+    portENTER_CRITICAL(&reading_mux);
+    reading.errors++;
+    portEXIT_CRITICAL(&reading_mux);
+
+    fetching = false;
+}
+
+// Callbacks run on the bus task.
+static void read_done(i2c_bus_txn_t *txn, esp_err_t err)
+{
+    if ((err != ESP_OK) || !sht3x_check_raw_data(raw))
+    {
+        fetch_failed();
+        return;
+    }
+
+    // Datasheet conversions, integer: T = -45 + 175 * t / 65535, RH = 100 * h / 65535
+    const uint32_t t = ((uint32_t)raw[0] << 8) | raw[1];
+    const uint32_t h = ((uint32_t)raw[3] << 8) | raw[4];
+
+    portENTER_CRITICAL(&reading_mux);
+    reading.temp_cC = (int32_t)(t * 17500 / 65535) - 4500;
+    reading.humidity_c = h * 10000 / 65535;
+    reading.time_us = esp_timer_get_time();
+    portEXIT_CRITICAL(&reading_mux);
+
+    fetching = false;
+}
+
+static void fetch_done(i2c_bus_txn_t *txn, esp_err_t err)
+{
+    if ((err != ESP_OK) || (ESP_OK != i2c_bus_submit(&read_txn, read_done, NULL)))
+        fetch_failed();
+}
+
+bool bay_sensor_init(i2c_port_t i2c_port)
+{
+    sensor = sht3x_init_sensor(i2c_port, SHT3x_ADDR_1);
+    if (!sensor)
+        sensor = sht3x_init_sensor(i2c_port, SHT3x_ADDR_2);
+
+    if (!sensor || !sht3x_start_measurement(sensor, sht3x_periodic_1mps, sht3x_high))
+    {
+        printf("No electronics bay sensor!\n");
+        return false;
+    }
+
+    i2c_bus_prepare_write(&fetch_txn, sensor->addr, NULL, fetch_cmd, sizeof(fetch_cmd));
+    i2c_bus_prepare_read(&read_txn, sensor->addr, NULL, raw, sizeof(raw));
+
+    // First result is ready after one period.
+    next_fetch_us = esp_timer_get_time() + 1000 * 1000;
+
+    printf("Electronics bay sensor at 0x%02x\n", sensor->addr);
+    return true;
+}
+
+void bay_sensor_sample()
+{
+    if (!sensor || fetching)
+        return;
+
+    const int64_t now = esp_timer_get_time();
+    if (now < next_fetch_us)
+        return;
+
+    next_fetch_us = now + BAY_FETCH_INTERVAL_MS * 1000LL;
+
+    fetching = true;
+    if (ESP_OK != i2c_bus_submit(&fetch_txn, fetch_done, NULL))
+        fetching = false;
+}
+
+bay_reading_t bay_sensor_latest()
+{
+    portENTER_CRITICAL(&reading_mux);
+    bay_reading_t r = reading;
+    portEXIT_CRITICAL(&reading_mux);
+
+    r.ok = (r.time_us != 0) && (esp_timer_get_time() - r.time_us < BAY_STALE_US);
+    return r;
+}
@@ -0,0 +1,42 @@
+#ifndef BAY_SENSOR_H
+#define BAY_SENSOR_H
+
+#include <driver/i2c.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* SHT3x in the electronics bay, next to the relay board.
+ * The sensor measures on its own once a second; bay_sensor_sample() fetches the
+ *   latest result through the bus task at most every BAY_FETCH_INTERVAL_MS, so it
+ *   can be called from the control loop every tick.
+ */
+
+#define BAY_FETCH_INTERVAL_MS 2000
+
+typedef struct
+{
+    bool ok;                // a reading newer than a few fetch intervals
+    int32_t temp_cC;        // centi-C
+    int32_t humidity_c;     // centi-%RH
+    int64_t time_us;        // when it was read, 0 if never
+    uint32_t errors;        // failed fetches and CRC errors
+} bay_reading_t;
+
+// Find the sensor and start periodic measurement. Blocks on the bus, boot only.
+extern bool bay_sensor_init(i2c_port_t i2c_port);
+
+// Fetch the latest measurement if one is due; returns immediately.
+extern void bay_sensor_sample();
+
+extern bay_reading_t bay_sensor_latest();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BAY_SENSOR_H
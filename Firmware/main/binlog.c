@@ -0,0 +1,172 @@
+#include "binlog.h"
+#include "trace.h"
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdbool.h>
+
+#define BINLOG_SLOTS        64      // power of two
+#define BINLOG_DRAIN_MS     50
+
+/* A bounded multi producer queue. Each slot's seq says whose turn it is. Counting from
+ *   lap, the first position of the lap pos is on, a writer may take pos when seq == lap,
+ *   publishes by setting it to lap + 1, and the drain task frees it for the next lap by
+ *   setting lap + BINLOG_SLOTS. All zero is the right start, so nothing is lost before
+ *   binlog_init().
+ */
+typedef struct
+{
+    uint32_t seq;
+    binlog_record_t record;
+} slot_t;
+
+static slot_t ring[BINLOG_SLOTS];
+static uint32_t head = 0;       // next position to hand a writer
+static uint32_t tail = 0;       // drain task only
+static uint32_t dropped = 0;
+
+void binlog_write(binlog_id_t id, const char *str, int nargs, ...)
+{
+    uint32_t pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+    slot_t *slot;
+    while (1)
+    {
+        slot = &ring[pos % BINLOG_SLOTS];
+        const uint32_t lap = pos - pos % BINLOG_SLOTS;
+        const int32_t diff = (int32_t)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - lap);
+        if (diff == 0)
+        {
+            if (__atomic_compare_exchange_n(&head, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        }
+        else if (diff < 0)
+        {
+            // Still waiting to be drained from the last lap.
+            __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        else
+        {
+            pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+        }
+    }
+
+    binlog_record_t *r = &slot->record;
+    r->time_ms = esp_timer_get_time() / 1000;
+    r->id = id;
+    r->nargs = (nargs > BINLOG_MAX_ARGS) ? BINLOG_MAX_ARGS : nargs;
+
+    va_list args;
+    va_start(args, nargs);
+    for (int i = 0; i < r->nargs; i++)
+        r->args[i] = va_arg(args, int);
+    va_end(args);
+
+    int len = 0;
+    if (str)
+        while ((len < BINLOG_MAX_STR) && str[len])
+        {
+            r->str[len] = str[len];
+            len++;
+        }
+    r->len = len;
+
+    __atomic_store_n(&slot->seq, pos - pos % BINLOG_SLOTS + 1, __ATOMIC_RELEASE);
+}
+
+static const char base64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static int encode(char *out, const uint8_t *in, int len)
+{
+    char *o = out;
+    for (int i = 0; i < len; i += 3)
+    {
+        const uint32_t b = (in[i] << 16) |
+                           ((i + 1 < len) ? in[i + 1] << 8 : 0) |
+                           ((i + 2 < len) ? in[i + 2] : 0);
+        *o++ = base64[(b >> 18) & 0x3f];
+        *o++ = base64[(b >> 12) & 0x3f];
+        *o++ = (i + 1 < len) ? base64[(b >> 6) & 0x3f] : '=';
+        *o++ = (i + 2 < len) ? base64[b & 0x3f] : '=';
+    }
+    return o - out;
+}
+
+int binlog_frame(char *line, char tag, uint8_t *data, int len)
+{
+    data[len] = binlog_crc8(data, len);
+
+    int n = 0;
+    line[n++] = BINLOG_STX;
+    line[n++] = tag;
+    n += encode(line + n, data, len + 1);
+    line[n++] = '\n';
+    return n;
+}
+
+static void emit(const binlog_record_t *r)
+{
+    // Pack: header, the args in use, the string.
+    uint8_t packed[sizeof(binlog_record_t) + 1];
+    int len = BINLOG_HEADER_SIZE;
+    memcpy(packed, r, BINLOG_HEADER_SIZE);
+    memcpy(packed + len, r->args, r->nargs * sizeof(int32_t));
+    len += r->nargs * sizeof(int32_t);
+    memcpy(packed + len, r->str, r->len);
+    len += r->len;
+
+    char line[BINLOG_LINE_SIZE(sizeof(binlog_record_t))];
+    fwrite(line, 1, binlog_frame(line, BINLOG_TAG, packed, len), stdout);
+}
+
+static void binlog_task(void *arg)
+{
+    uint32_t reported = 0;
+    while (1)
+    {
+        bool any = false;
+        while (1)
+        {
+            slot_t *slot = &ring[tail % BINLOG_SLOTS];
+            const uint32_t lap = tail - tail % BINLOG_SLOTS;
+            if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != lap + 1)
+                break;
+
+            emit(&slot->record);
+            __atomic_store_n(&slot->seq, lap + BINLOG_SLOTS, __ATOMIC_RELEASE);
+            tail++;
+            any = true;
+        }
+
+        const uint32_t lost = __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+        if (lost != reported)
+        {
+            const binlog_record_t r = {
+                .time_ms = esp_timer_get_time() / 1000,
+                .id = BL_DROPPED,
+                .nargs = 1,
+                .args = { lost - reported },
+            };
+            emit(&r);
+            reported = lost;
+            any = true;
+        }
+
+        any = trace_console() || any;
+
+        if (any)
+            fflush(stdout);
+        vTaskDelay(BINLOG_DRAIN_MS / portTICK_PERIOD_MS);
+    }
+}
+
+void binlog_init()
+{
+    // Below everything that logs, so the console only ever costs idle time.
+    xTaskCreate(binlog_task, "binlog", 2048, NULL, tskIDLE_PRIORITY+1, NULL);
+}
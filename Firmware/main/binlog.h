@@ -0,0 +1,86 @@
+#ifndef BINLOG_H
+#define BINLOG_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Deferred logging for the control, bus and httpd tasks.
+ *
+ * printf() on the console holds the caller until the UART has taken the text, so a
+ *   burst of messages at 115200 baud stalls whoever wrote them. BINLOG() instead copies
+ *   a message number, up to BINLOG_MAX_ARGS ints and one short string into a slot of a
+ *   lock free ring and returns. A low priority task drains the ring to the console.
+ * Each record goes out as one line: STX, 'L', then the base64 of the packed record and
+ *   a CRC-8, so it passes through the console's line ending conversion untouched and
+ *   sits between ordinary printf() lines. binlog_decode (a host tool) turns those lines
+ *   back into text using binlog_msgs.h.
+ * When the ring is full records are dropped and counted, the drain task logs how many.
+ */
+
+typedef enum
+{
+#define BINLOG_MSG(id, format) id,
+#include "binlog_msgs.h"
+#undef BINLOG_MSG
+    BL_COUNT
+} binlog_id_t;
+
+#define BINLOG_MAX_ARGS 4
+#define BINLOG_MAX_STR  32      // longer strings are cut short
+
+#define BINLOG_STX      '\x02'
+#define BINLOG_TAG      'L'
+
+// As sent, little endian, before base64. Only nargs args and len bytes of str are sent,
+//   followed by a CRC-8 of everything before it.
+typedef struct __attribute__((packed))
+{
+    uint32_t time_ms;       // since boot
+    uint16_t id;            // binlog_id_t
+    uint8_t nargs;
+    uint8_t len;            // of str, no terminator
+    int32_t args[BINLOG_MAX_ARGS];
+    char str[BINLOG_MAX_STR];
+} binlog_record_t;
+
+#define BINLOG_HEADER_SIZE  8
+
+// Longest console line for len bytes of record: STX, tag, base64 with the CRC, newline.
+#define BINLOG_LINE_SIZE(len) (2 + ((len) + 3) / 3 * 4 + 1)
+
+extern void binlog_init();
+
+// Use BINLOG()/BINLOG_STR(). Safe from any task, not from an ISR. Arguments are ints.
+extern void binlog_write(binlog_id_t id, const char *str, int nargs, ...);
+
+// Frame len bytes of data as a console line, for other record types. data needs room
+//   for the CRC after it. Returns the length of the line, which is not terminated.
+extern int binlog_frame(char *line, char tag, uint8_t *data, int len);
+
+#define BINLOG_NARGS_(_0, _1, _2, _3, _4, n, ...) n
+#define BINLOG_NARGS(...) BINLOG_NARGS_(0, ##__VA_ARGS__, 4, 3, 2, 1, 0)
+
+#define BINLOG(id, ...)          binlog_write(id, NULL, BINLOG_NARGS(__VA_ARGS__), ##__VA_ARGS__)
+#define BINLOG_STR(id, str, ...) binlog_write(id, str, BINLOG_NARGS(__VA_ARGS__), ##__VA_ARGS__)
+
+// CRC-8, polynomial 0x07, as used on the wire.
+static inline uint8_t binlog_crc8(const uint8_t *data, int len)
+{
+    uint8_t crc = 0;
+    while (len--)
+    {
+        crc ^= *data++;
+        for (int i = 0; i < 8; i++)
+            crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+    return crc;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BINLOG_H
@@ -0,0 +1,62 @@
+/* Host tool: turns the console's binlog lines back into text.
+ *
+ *   gcc -I. -o binlog_decode binlog_decode.c binlog_text.c
+ *   binlog_decode [capture ...]      (stdin without arguments)
+ *
+ * Everything that isn't a binlog line is copied through as it is.
+ */
+
+#include "binlog_text.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static void decode(FILE *in)
+{
+    char line[1024];
+    while (fgets(line, sizeof(line), in))
+    {
+        if ((line[0] != BINLOG_STX) || (line[1] != BINLOG_TAG))
+        {
+            fputs(line, stdout);
+            continue;
+        }
+
+        line[strcspn(line, "\r\n")] = 0;
+
+        uint8_t data[sizeof(binlog_record_t) + 1];
+        binlog_record_t r;
+        const int len = binlog_unbase64(data, sizeof(data), line + 2);
+        if ((len < 0) || !binlog_unpack(&r, data, len))
+        {
+            printf("<bad binlog record %s>\n", line + 2);
+            continue;
+        }
+
+        char text[256];
+        binlog_format(text, sizeof(text), &r);
+        printf("[%6lu.%03lu] %s\n", (unsigned long)(r.time_ms / 1000), (unsigned long)(r.time_ms % 1000), text);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        decode(stdin);
+        return 0;
+    }
+
+    for (int i = 1; i < argc; i++)
+    {
+        FILE *in = fopen(argv[i], "r");
+        if (!in)
+        {
+            perror(argv[i]);
+            return 1;
+        }
+        decode(in);
+        fclose(in);
+    }
+    return 0;
+}
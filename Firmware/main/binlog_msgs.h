@@ -0,0 +1,61 @@
+/* Messages for binlog.h, BINLOG_MSG(id, format).
+ *
+ * Arguments are ints, %i %u %x and %c with the usual flags and width; %s is the record's
+ *   one string. Records on the wire carry the number, not the text, so only ever append:
+ *   binlog_decode needs the same table to read a capture.
+ */
+
+BINLOG_MSG(BL_DROPPED,              "Log ring full, %u records dropped")
+
+// Control task
+BINLOG_MSG(BL_RUNAWAY,              "Run away or error state!")
+BINLOG_MSG(BL_PROBE_FAULT_HOLD,     "Oven probe fault, holding elements off")
+BINLOG_MSG(BL_NO_TEMPERATURE,       "No temperature for %ims, holding elements off")
+BINLOG_MSG(BL_TEMPERATURE_BACK,     "Temperature readings back, resuming")
+BINLOG_MSG(BL_BAY_OVERHEAT,         "Electronics bay at %i cC, shutting down!")
+BINLOG_MSG(BL_HW_OVERTEMP,          "Hardware over temperature trip! Relays off %uus into the ISR")
+BINLOG_MSG(BL_ELEMENT_FAILED,       "%s element on for %is, only %i cF rise!")
+BINLOG_MSG(BL_RELAY_STUCK,          "Elements off but still heating, %i cF in %is!")
+BINLOG_MSG(BL_EVENT,                "Event %i, argument %i, %s")
+
+// Cook timers
+BINLOG_MSG(BL_TIMER_STARTED,        "Timer %i started")
+BINLOG_MSG(BL_TIMER_DONE,           "Timer %i timed out")
+BINLOG_MSG(BL_TIMER_ARG_COUNT,      "Bad timer, %i arguments")
+BINLOG_MSG(BL_TIMER_ORDER,          "Bad timer, arguments out of order (%i)")
+BINLOG_MSG(BL_TOO_MANY_TIMERS,      "Too many timers!")
+BINLOG_MSG(BL_ADD_TIMER,            "Add timer: %is, argument %i, action %i, probe %i")
+BINLOG_MSG(BL_REMOVE_TIMER,         "Remove timer %i")
+
+// HTTP handlers
+BINLOG_MSG(BL_POST_TOO_LARGE,       "HTTP POST too large, %u bytes")
+BINLOG_MSG(BL_POST_FAILED,          "Reading HTTP POST failed, %i")
+BINLOG_MSG(BL_SET_TARGET,           "Set target %s")
+BINLOG_MSG(BL_SET_LIGHT,            "Set light %s")
+BINLOG_MSG(BL_SET_COOLING_FAN,      "Set cooling fan %s")
+BINLOG_MSG(BL_SET_DOWNDRAFT_FAN,    "Set downdraft fan %s")
+BINLOG_MSG(BL_SET_CONVECTION_FAN,   "Set convection fan %s")
+BINLOG_MSG(BL_SET_STOVE_MODE,       "Set stove mode %s")
+BINLOG_MSG(BL_SET_USE_TOP,          "Set use top element %s")
+BINLOG_MSG(BL_SET_USE_BOTTOM,       "Set use bottom element %s")
+BINLOG_MSG(BL_BAD_PROBE_NAME,       "Bad probe name: %s")
+BINLOG_MSG(BL_BAD_PROBE_CONFIG,     "Bad probe config: %s")
+
+// Probes, from the bus task
+BINLOG_MSG(BL_PROBE_READ_FAILED,    "Failed to read temperature from %s!")
+BINLOG_MSG(BL_PROBE_RECOVERED,      "Temperature readings from %s recovered after %u failures")
+
+// Cook timers, later additions
+BINLOG_MSG(BL_TIMER_BAD_VALUE,      "Bad timer, %s is not a number in range")
+BINLOG_MSG(BL_TIMER_BAD_PROBE,      "Bad timer, probe %i is not fitted")
+BINLOG_MSG(BL_TIMER_PROBE_LOST,     "Timer %i: probe %i lost for %is, ending the step")
+
+// Control loop trace
+BINLOG_MSG(BL_TRACE_NO_MEMORY,      "No memory for a %u byte trace ring, not tracing")
+
+// Moved off printf
+BINLOG_MSG(BL_TOO_MANY_EVENT_CLIENTS, "Too many event clients!")
+BINLOG_MSG(BL_I2C_BUS_RESET,        "I2C bus reset%s")
+BINLOG_MSG(BL_COOK_LOG_WRITE_FAILED, "Cook log write failed at %u:%u, error %i!")
+BINLOG_MSG(BL_COOK_LOG_SECTOR_FAILED, "Cook log sector %u failed, error %i!")
+BINLOG_MSG(BL_BAD_TARGET,           "Bad target temperature: %s")
@@ -0,0 +1,105 @@
+#include "binlog_text.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const char *formats[BL_COUNT] = {
+#define BINLOG_MSG(id, format) [id] = format,
+#include "binlog_msgs.h"
+#undef BINLOG_MSG
+};
+
+int binlog_unbase64(uint8_t *out, int size, const char *in)
+{
+    uint32_t bits = 0;
+    int nbits = 0, len = 0;
+    for (; *in && (*in != '='); in++)
+    {
+        const char c = *in;
+        int v;
+        if ((c >= 'A') && (c <= 'Z'))      v = c - 'A';
+        else if ((c >= 'a') && (c <= 'z')) v = c - 'a' + 26;
+        else if ((c >= '0') && (c <= '9')) v = c - '0' + 52;
+        else if (c == '+')                 v = 62;
+        else if (c == '/')                 v = 63;
+        else                               return -1;
+
+        bits = (bits << 6) | v;
+        nbits += 6;
+        if (nbits >= 8)
+        {
+            nbits -= 8;
+            if (len == size)
+                return -1;
+            out[len++] = bits >> nbits;
+        }
+    }
+    return len;
+}
+
+bool binlog_unpack(binlog_record_t *r, const uint8_t *data, int len)
+{
+    if ((len < BINLOG_HEADER_SIZE + 1) || (binlog_crc8(data, len - 1) != data[len - 1]))
+        return false;
+
+    memset(r, 0, sizeof(*r));
+    memcpy(r, data, BINLOG_HEADER_SIZE);
+    if ((r->nargs > BINLOG_MAX_ARGS) || (r->len > BINLOG_MAX_STR) ||
+        (BINLOG_HEADER_SIZE + r->nargs * 4 + r->len + 1 != len))
+        return false;
+
+    memcpy(r->args, data + BINLOG_HEADER_SIZE, r->nargs * 4);
+    memcpy(r->str, data + BINLOG_HEADER_SIZE + r->nargs * 4, r->len);
+    return true;
+}
+
+// printf() with the record's ints and string, one conversion at a time.
+void binlog_format(char *out, int size, const binlog_record_t *r)
+{
+    const char *f = (r->id < BL_COUNT) ? formats[r->id] : NULL;
+    if (!f)
+    {
+        snprintf(out, size, "Unknown message %u", r->id);
+        return;
+    }
+
+    char str[BINLOG_MAX_STR + 1];
+    memcpy(str, r->str, r->len);
+    str[r->len] = 0;
+
+    int len = 0, arg = 0;
+    while (*f && (len < size - 1))
+    {
+        if (*f != '%')
+        {
+            out[len++] = *f++;
+            continue;
+        }
+
+        // Copy the spec, flags and width included.
+        char spec[16];
+        int n = 0;
+        spec[n++] = *f++;
+        while (*f && strchr("-+ #0123456789.l", *f) && (n < (int)sizeof(spec) - 2))
+            if (*f == 'l')
+                f++;    // everything is an int on the wire
+            else
+                spec[n++] = *f++;
+        const char conv = *f ? *f++ : '%';
+        spec[n++] = conv;
+        spec[n] = 0;
+
+        if (conv == '%')
+            len += snprintf(out + len, size - len, "%%");
+        else if (conv == 's')
+            len += snprintf(out + len, size - len, spec, str);
+        else if (strchr("diuxXc", conv))
+            len += snprintf(out + len, size - len, spec, (arg < r->nargs) ? r->args[arg++] : 0);
+        else
+            len += snprintf(out + len, size - len, "%s", spec);
+
+        if (len > size - 1)
+            len = size - 1;
+    }
+    out[len] = 0;
+}
@@ -0,0 +1,30 @@
+#ifndef BINLOG_TEXT_H
+#define BINLOG_TEXT_H
+
+#include "binlog.h"
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Reading console lines back on the host, for binlog_decode, bumprts and the replay.
+ *   Not part of the firmware.
+ */
+
+// Decode the base64 after a line's STX and tag. Returns the number of bytes, CRC
+//   included, or -1 if it isn't base64 or doesn't fit.
+extern int binlog_unbase64(uint8_t *out, int size, const char *in);
+
+// Unpack len decoded bytes of an 'L' line, checking the CRC.
+extern bool binlog_unpack(binlog_record_t *r, const uint8_t *data, int len);
+
+// The record as text, with its message from binlog_msgs.h.
+extern void binlog_format(char *out, int size, const binlog_record_t *r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BINLOG_TEXT_H
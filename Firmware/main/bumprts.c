@@ -1,14 +1,44 @@
+/* Host tool: resets the controller through RTS and watches its console.
+ *
+ *   gcc -I. -I../replay/shim -o bumprts bumprts.c binlog_text.c
+ *   bumprts [-n] [-b baud] [-i seconds] [-o capture] device
+ *
+ * RTS is pulsed to reset the board (-n leaves it running), then the console is read
+ *   until ^C. Ordinary lines and binlog 'L' records are printed as text, as
+ *   binlog_decode would. Trace 'T' records, see trace.h, are not printed but every -i
+ *   seconds (10) a line sums up the control loop over them: ticks, their period and
+ *   how many were late or lost, probe samples, relay duty, the oven temperature and
+ *   the target. POST /set_trace 1 first, it is kept over the reset.
+ * -o also writes everything received, as it came, to a file that binlog_decode and
+ *   replay/replay read.
+ */
+
+#include "binlog_text.h"
+#include "trace.h"
+#include "mcp9600.h"
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <errno.h>
 #include <termios.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
+#include <sys/select.h>
+#include <sys/time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 
+#define TICK_US     50000                       // the control loop, 20 per second
+#define LATE_US     (TICK_US + TICK_US / 2)
+
+static const char *modes[] = { "off", "manual", "timers", "?" };
 
 static struct termios oldterminfo;
+static volatile sig_atomic_t stop = 0;
 
 
 void closeserial(int fd)
@@ -19,12 +49,13 @@ void closeserial(int fd)
 }
 
 
-int openserial(char *devicename)
+// Raw, and without hardware flow control, which would move RTS under us.
+int openserial(char *devicename, speed_t speed)
 {
     int fd;
     struct termios attr;
 
-    if ((fd = open(devicename, O_RDWR)) == -1) {
+    if ((fd = open(devicename, O_RDWR | O_NOCTTY)) == -1) {
         perror("openserial(): open()");
         return 0;
     }
@@ -33,8 +64,13 @@ int openserial(char *devicename)
         return 0;
     }
     attr = oldterminfo;
-    attr.c_cflag |= CRTSCTS | CLOCAL;
-    attr.c_oflag = 0;
+    cfmakeraw(&attr);
+    attr.c_cflag &= ~CRTSCTS;
+    attr.c_cflag |= CLOCAL | CREAD;
+    attr.c_cc[VMIN] = 1;
+    attr.c_cc[VTIME] = 0;
+    cfsetispeed(&attr, speed);
+    cfsetospeed(&attr, speed);
     if (tcflush(fd, TCIOFLUSH) == -1) {
         perror("openserial(): tcflush()");
         return 0;
@@ -67,28 +103,333 @@ int setRTS(int fd, int level)
 }
 
 
+static speed_t baud(int rate)
+{
+    switch (rate)
+    {
+    case 9600:   return B9600;
+    case 19200:  return B19200;
+    case 38400:  return B38400;
+    case 57600:  return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 921600: return B921600;
+    default:     return 0;
+    }
+}
+
+static double now_s()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void on_signal(int sig)
+{
+    stop = 1;
+}
+
+// The control loop over the ticks of one report, or of the whole run.
+typedef struct
+{
+    unsigned ticks;
+    unsigned lost;          // missing from the sequence
+    unsigned late;          // more than LATE_US after the tick before
+    unsigned samples;
+    unsigned bake;          // ticks with the element on
+    unsigned broil;
+    int64_t period_us;      // summed over the ticks that follow another
+    unsigned periods;
+    int64_t max_period_us;
+    unsigned records;       // binlog
+    unsigned dropped;       // binlog records the board couldn't send
+    unsigned bad_lines;
+} loop_stats_t;
+
+static loop_stats_t window, total;
+
+// The latest of everything, to report.
+static bool tracing = false;
+static uint32_t last_seq;
+static int64_t last_us;
+static uint16_t outputs;
+static int32_t target_cF;
+static bool have_oven = false;
+static int32_t oven_raw;            // 1/16 C
+
+static void count_bad_line()
+{
+    window.bad_lines++;
+    total.bad_lines++;
+}
+
+static void count_tick(loop_stats_t *s, const trace_tick_t *t, int64_t period_us, unsigned lost)
+{
+    s->ticks++;
+    s->lost += lost;
+    s->samples += t->samples;
+    s->bake += !!(t->outputs & TRACE_OUT_BAKE);
+    s->broil += !!(t->outputs & TRACE_OUT_BROIL);
+    if (period_us > 0)
+    {
+        s->period_us += period_us;
+        s->periods++;
+        if (period_us > s->max_period_us)
+            s->max_period_us = period_us;
+        if (period_us > LATE_US)
+            s->late++;
+    }
+}
+
+static void trace_record(const uint8_t *data, int len)
+{
+    if ((data[0] == TRACE_HEADER) && (len == sizeof(trace_header_t)))
+    {
+        trace_header_t h;
+        memcpy(&h, data, sizeof(h));
+        printf("--- trace from tick %u, version %u, probes %02x\n", h.first_tick, h.version, h.present);
+        tracing = false;
+        return;
+    }
+
+    trace_tick_t t;
+    if ((data[0] != TRACE_TICK) || (len < (int)sizeof(t)))
+    {
+        count_bad_line();
+        return;
+    }
+    memcpy(&t, data, sizeof(t));
+
+    // Samples follow the tick and the bay reading, the last one from the oven probe wins.
+    int at = sizeof(t) + ((t.inputs & TRACE_IN_BAY) ? sizeof(trace_bay_t) : 0);
+    for (int i = 0; (i < t.samples) && (at + (int)sizeof(trace_sample_t) <= len); i++)
+    {
+        trace_sample_t s;
+        memcpy(&s, data + at, sizeof(s));
+        at += sizeof(s);
+        if (mcp9600_probe_index(s.source) == MCP9600_OVEN)
+        {
+            oven_raw = (int16_t)s.value;
+            have_oven = true;
+        }
+    }
+
+    int64_t period_us = 0;
+    unsigned lost = 0;
+    if (tracing && (t.seq > last_seq))
+    {
+        period_us = t.now_us - last_us;
+        lost = t.seq - last_seq - 1;
+    }
+    else if (tracing)
+        printf("--- tick %u after %u, the board restarted\n", t.seq, last_seq);
+
+    count_tick(&window, &t, lost ? 0 : period_us, lost);
+    count_tick(&total, &t, lost ? 0 : period_us, lost);
+
+    tracing = true;
+    last_seq = t.seq;
+    last_us = t.now_us;
+    outputs = t.outputs;
+    target_cF = t.target_cF;
+}
+
+static void log_record(const uint8_t *data, int len, const char *line)
+{
+    binlog_record_t r;
+    if (!binlog_unpack(&r, data, len))
+    {
+        printf("<bad binlog record %s>\n", line);
+        count_bad_line();
+        return;
+    }
+
+    const unsigned lost = ((r.id == BL_DROPPED) && r.nargs) ? r.args[0] : 0;
+    window.records++;
+    window.dropped += lost;
+    total.records++;
+    total.dropped += lost;
+
+    char text[256];
+    binlog_format(text, sizeof(text), &r);
+    printf("[%6lu.%03lu] %s\n", (unsigned long)(r.time_ms / 1000), (unsigned long)(r.time_ms % 1000), text);
+}
+
+static void line_received(char *line)
+{
+    if ((line[0] != BINLOG_STX) || ((line[1] != BINLOG_TAG) && (line[1] != TRACE_TAG)))
+    {
+        fputs(line, stdout);
+        return;
+    }
+
+    line[strcspn(line, "\r\n")] = 0;
+
+    uint8_t data[TRACE_RECORD_MAX + 1];
+    const int len = binlog_unbase64(data, sizeof(data), line + 2);
+    if (len < 2)
+    {
+        count_bad_line();
+        return;
+    }
+
+    if (line[1] == BINLOG_TAG)
+        log_record(data, len, line + 2);
+    else if (binlog_crc8(data, len - 1) == data[len - 1])
+        trace_record(data, len - 1);
+    else
+        count_bad_line();
+}
+
+static void print_stats(const char *what, const loop_stats_t *s, double seconds)
+{
+    if (!s->ticks)
+    {
+        printf("--- %s %.0fs: no trace ticks%s\n", what, seconds, tracing ? "" : ", POST /set_trace 1 to see the control loop");
+        return;
+    }
+
+    printf("--- %s %.0fs: %u ticks, %u lost, period %.1fms avg %.1fms max, %u late, %.2f samples/tick, "
+           "bake %u%% broil %u%%, ",
+           what, seconds, s->ticks, s->lost,
+           s->periods ? s->period_us / 1e3 / s->periods : 0.0, s->max_period_us / 1e3, s->late,
+           (double)s->samples / s->ticks, s->bake * 100 / s->ticks, s->broil * 100 / s->ticks);
+    if (have_oven)
+        printf("oven %.1fF, ", oven_raw / 16.0 * 9 / 5 + 32);
+    printf("target %.2fF, %s", target_cF / 100.0, modes[TRACE_OUT_MODE(outputs)]);
+    if (s->records || s->dropped || s->bad_lines)
+        printf(", %u log records, %u dropped, %u bad lines", s->records, s->dropped, s->bad_lines);
+    printf("\n");
+}
+
 int main(int argc, char **argv)
 {
-    int fd;
+    bool reset = true;
+    int rate = 115200;
+    double interval = 10;
+    const char *capture_name = NULL;
 
-    if(argc < 1)
+    int opt;
+    while ((opt = getopt(argc, argv, "nb:i:o:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n': reset = false; break;
+        case 'b': rate = atoi(optarg); break;
+        case 'i': interval = atof(optarg); break;
+        case 'o': capture_name = optarg; break;
+        default:  optind = argc + 1; break;
+        }
+    }
+    if ((optind != argc - 1) || !baud(rate) || (interval <= 0))
+    {
+        fprintf(stderr, "Usage: %s [-n] [-b baud] [-i seconds] [-o capture] device\n", argv[0]);
         return 1;
+    }
+    char *device = argv[optind];
 
-    fd = openserial(argv[1]);
+    int fd = openserial(device, baud(rate));
     if (!fd)
     {
-        fprintf(stderr, "Error while initializing %s.\n", argv[1]);
+        fprintf(stderr, "Error while initializing %s.\n", device);
         return 1;
     }
-    else
+
+    FILE *capture = NULL;
+    if (capture_name && !(capture = fopen(capture_name, "w")))
+    {
+        perror(capture_name);
+        closeserial(fd);
+        return 1;
+    }
+
+    if (reset)
     {
-        printf("Toggling RTS for %s.\n", argv[1]);
+        printf("Toggling RTS for %s.\n", device);
+
+        // As this always did, then let go again the way closing the port used to.
+        setRTS(fd, 0);
+        sleep(1);       /* pause 1 second */
+        setRTS(fd, 1);
+        usleep(100000);
+        setRTS(fd, 0);
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    const double start = now_s();
+    double next_report = start + interval, window_start = start;
+    char line[4096];
+    int line_len = 0;
+
+    while (!stop)
+    {
+        const double wait = next_report - now_s();
+        struct timeval timeout = { 0, 0 };
+        if (wait > 0)
+        {
+            timeout.tv_sec = (time_t)wait;
+            timeout.tv_usec = (wait - timeout.tv_sec) * 1e6;
+        }
+
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(fd, &readable);
+        const int ready = select(fd + 1, &readable, NULL, NULL, &timeout);
+        if ((ready < 0) && (errno != EINTR))
+        {
+            perror("select()");
+            break;
+        }
+
+        if ((ready > 0) && FD_ISSET(fd, &readable))
+        {
+            char buf[1024];
+            const ssize_t n = read(fd, buf, sizeof(buf));
+            if (n <= 0)
+            {
+                if (n < 0)
+                    perror("read()");
+                else
+                    printf("%s closed\n", device);
+                break;
+            }
+
+            if (capture)
+                fwrite(buf, 1, n, capture);
+
+            for (ssize_t i = 0; i < n; i++)
+            {
+                line[line_len++] = buf[i];
+                if ((buf[i] == '\n') || (line_len == sizeof(line) - 1))
+                {
+                    line[line_len] = 0;
+                    line_received(line);
+                    line_len = 0;
+                }
+            }
+            fflush(stdout);
+        }
+
+        if (now_s() >= next_report)
+        {
+            print_stats("last", &window, now_s() - window_start);
+            fflush(stdout);
+            memset(&window, 0, sizeof(window));
+            window_start = now_s();
+            next_report += interval;
+            if (next_report < window_start)
+                next_report = window_start + interval;
+        }
     }
 
-    setRTS(fd, 0);
-    sleep(1);       /* pause 1 second */
-    setRTS(fd, 1);
+    print_stats("all of", &total, now_s() - start);
 
+    if (capture)
+        fclose(capture);
     closeserial(fd);
     return 0;
 }
@@ -0,0 +1,185 @@
+#include "clock_sync.h"
+#include "rx8900.h"
+
+#include "nvs.h"
+
+#include <time.h>
+#include <string.h>
+
+typedef enum
+{
+    TS_None,
+    TS_RTC,
+    TS_SNTP
+} time_source_t;
+
+static i2c_port_t rtc_port;
+static bool rtc_ok = false;
+
+static time_source_t source = TS_None;
+static uint32_t sntp_syncs = 0;
+static int64_t last_sync = 0;          // epoch seconds
+static int32_t system_offset_ms = 0;   // system clock - SNTP at the last sync
+static int32_t rtc_offset_s = 0;       // RTC - SNTP at the last sync
+static int32_t rtc_drift_ppm = 0;      // rtc_offset_s over the time since the RTC was set
+static int64_t rtc_set_at = 0;         // epoch seconds, kept in NVS
+
+// Days since 1970-01-01, proleptic Gregorian (Howard Hinnant's days_from_civil).
+static int64_t days_from_civil(int y, unsigned m, unsigned d)
+{
+    y -= m <= 2;
+    const int era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned yoe = (unsigned)(y - era * 400);
+    const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return (int64_t)era * 146097 + (int64_t)doe - 719468;
+}
+
+static time_t to_epoch(date_time_t dt)
+{
+    return days_from_civil(dt.year, dt.month, dt.day) * 86400 +
+           dt.hour * 3600 + dt.min * 60 + dt.sec;
+}
+
+static date_time_t from_epoch(time_t t)
+{
+    struct tm tm;
+    gmtime_r(&t, &tm);
+
+    const date_time_t dt = {
+        .year  = tm.tm_year + 1900,
+        .month = tm.tm_mon + 1,
+        .day   = tm.tm_mday,
+        .hour  = tm.tm_hour,
+        .min   = tm.tm_min,
+        .sec   = tm.tm_sec,
+    };
+    return dt;
+}
+
+static void load_rtc_set_at()
+{
+    nvs_handle_t nvs;
+    if (ESP_OK != nvs_open("clock", NVS_READONLY, &nvs))
+        return;
+
+    int64_t t = 0;
+    if (ESP_OK == nvs_get_i64(nvs, "rtc_set", &t))
+        rtc_set_at = t;
+    nvs_close(nvs);
+}
+
+static void save_rtc_set_at()
+{
+    nvs_handle_t nvs;
+    if (ESP_OK != nvs_open("clock", NVS_READWRITE, &nvs))
+        return;
+
+    if (ESP_OK == nvs_set_i64(nvs, "rtc_set", rtc_set_at))
+        nvs_commit(nvs);
+    nvs_close(nvs);
+}
+
+static bool read_rtc(time_t *t)
+{
+    if (!rx8900_time_valid(rtc_port))
+        return false;
+
+    const date_time_t dt = get_hwclock(rtc_port);
+    if ((dt.month < 1) || (dt.month > 12) || (dt.day < 1) || (dt.year < 2020))
+        return false;
+
+    *t = to_epoch(dt);
+    return true;
+}
+
+bool clock_sync_init(i2c_port_t i2c_port)
+{
+    rtc_port = i2c_port;
+    load_rtc_set_at();
+
+    time_t t;
+    if (!read_rtc(&t))
+    {
+        printf("RTC has no valid time, waiting for SNTP\n");
+        return false;
+    }
+
+    // The RTC only has whole seconds, we are on average half way through one.
+    const struct timeval tv = { .tv_sec = t, .tv_usec = 500000 };
+    settimeofday(&tv, NULL);
+
+    rtc_ok = true;
+    source = TS_RTC;
+
+    const date_time_t dt = from_epoch(t);
+    printf("Time from RTC: %04u-%02u-%02u %02u:%02u:%02u UTC\n",
+           dt.year, dt.month, dt.day, dt.hour, dt.min, dt.sec);
+    return true;
+}
+
+void clock_sync_sntp(const struct timeval *tv)
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+
+    system_offset_ms = (int32_t)(((int64_t)now.tv_sec - tv->tv_sec) * 1000 +
+                                 ((int64_t)now.tv_usec - tv->tv_usec) / 1000);
+
+    // How far the RTC got from the truth since we last set it.
+    time_t rtc;
+    if (read_rtc(&rtc))
+    {
+        rtc_offset_s = (int32_t)(rtc - tv->tv_sec);
+
+        // Below an hour the one second resolution swamps the drift.
+        const int64_t since_set = tv->tv_sec - rtc_set_at;
+        if (rtc_set_at && (since_set > 3600))
+            rtc_drift_ppm = (int32_t)((int64_t)rtc_offset_s * 1000000 / since_set);
+    }
+
+    // Round to the nearest second, setting the seconds register restarts the RTC's
+    //   sub-second divider.
+    const time_t nearest = tv->tv_sec + (tv->tv_usec >= 500000);
+    set_hwclock(rtc_port, from_epoch(nearest));
+
+    rtc_ok = true;
+    rtc_set_at = nearest;
+    save_rtc_set_at();
+
+    sntp_syncs++;
+    last_sync = tv->tv_sec;
+    source = TS_SNTP;
+
+    printf("SNTP sync %lu: system off by %li ms, RTC off by %li s (%li ppm)\n",
+           (unsigned long)sntp_syncs, (long)system_offset_ms, (long)rtc_offset_s, (long)rtc_drift_ppm);
+}
+
+static const char *source_name(time_source_t s)
+{
+    switch (s)
+    {
+    case TS_None: return "none";
+    case TS_RTC:  return "rtc";
+    case TS_SNTP: return "sntp";
+    }
+    return "";
+}
+
+esp_err_t get_time_stats(httpd_req_t *req)
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+
+    char json[320];
+    const int len = snprintf(json, sizeof(json),
+                             "{ \"time\": {\"now\":%lld,\"source\":\"%s\",\"rtc_ok\":%d,"
+                             "\"sntp_syncs\":%lu,\"last_sync\":%lld,\"system_offset_ms\":%li,"
+                             "\"rtc_offset_s\":%li,\"rtc_drift_ppm\":%li,\"rtc_set_at\":%lld}}",
+                             (long long)now.tv_sec, source_name(source), rtc_ok,
+                             (unsigned long)sntp_syncs, (long long)last_sync, (long)system_offset_ms,
+                             (long)rtc_offset_s, (long)rtc_drift_ppm, (long long)rtc_set_at);
+
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, json, len);
+}
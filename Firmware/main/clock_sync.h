@@ -0,0 +1,33 @@
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <driver/i2c.h>
+#include <sys/time.h>
+
+#include "esp_http_server.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Wall clock time from the RX8900 until SNTP is available, and after if it never is.
+ *
+ * At boot the system clock is set from the RTC, before WiFi comes up. Every SNTP
+ *   sync writes the time back to the RTC and measures how far the RTC had drifted
+ *   since it was last set, which can be across reboots.
+ * The RTC keeps UTC.
+ */
+
+// Seed the system clock from the RTC. Returns false if the RTC has no valid time.
+extern bool clock_sync_init(i2c_port_t i2c_port);
+
+// Called with the time from each SNTP sync, before it is applied.
+extern void clock_sync_sntp(const struct timeval *tv);
+
+extern esp_err_t get_time_stats(httpd_req_t *req);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CLOCK_SYNC_H
@@ -0,0 +1,739 @@
+#include "cook_log.h"
+#include "events.h"
+#include "mcp9600.h"
+#include "binlog.h"
+
+#include "esp_app_desc.h"
+#include "esp_partition.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define COOK_LOG_SUBTYPE    0x40
+#define SECTOR_SIZE         4096
+#define SECTOR_MAGIC        0x474C4B43  // "CKLG"
+#define QUEUE_LEN           16
+#define PAGE_SIZE           256
+#define DETAIL_LEN          24          // as events keep it
+
+typedef enum
+{
+    LOG_START = 1,
+    LOG_END,
+    LOG_SAMPLE,
+    LOG_EVENT,
+    LOG_SUMMARY,
+    LOG_ERASED = 0xFF,
+} log_type_t;
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t seq;               // counts up with every sector opened
+    uint32_t first_session;     // latest session started when the sector was opened
+    uint32_t reserved;
+} sector_header_t;
+
+typedef struct __attribute__((packed))
+{
+    uint8_t type;
+    uint8_t len;                // whole record, header included
+    uint8_t crc;                // CRC-8 of the record after this byte
+    uint8_t code;               // event type
+    uint32_t session;
+    uint32_t time;              // unix seconds
+} record_header_t;
+
+typedef struct __attribute__((packed))
+{
+    record_header_t h;
+    union
+    {
+        struct __attribute__((packed))
+        {
+            int16_t temp_dF;    // deci-F
+            int16_t target_dF;
+            uint8_t bake_duty;
+            uint8_t broil_duty;
+            uint8_t outputs;
+            uint8_t probes;     // as history_record_t, 0 in logs from before they were kept
+            int16_t probe_dF[HISTORY_PROBES]; // only the probes in the mask, in order
+        } sample;
+
+        struct __attribute__((packed))
+        {
+            int32_t argument;
+            char detail[DETAIL_LEN];
+        } event;
+
+        cook_summary_t summary;
+    };
+} log_record_t;
+
+static const esp_partition_t *part = NULL;
+static uint32_t sector_count = 0;
+static QueueHandle_t queue = NULL;
+
+static volatile uint32_t session = 0;   // open session, 0 if none
+static uint32_t next_session = 1;
+
+/* The HTTP handlers read the log from the httpd task while the writer carries on.
+ * The writer holds sector_lock while it moves to a new sector, cur_sector, cur_seq and
+ *   the sector's erase and header change together under it. Readers take a snapshot of
+ *   where the writer was and read each header under the lock; a sector whose header is
+ *   newer than the snapshot has been reused since, and what it held is gone. Records
+ *   are CRC checked, so one being overwritten under a reader just ends that sector.
+ */
+static SemaphoreHandle_t sector_lock = NULL;
+
+typedef struct
+{
+    uint32_t sector;
+    uint32_t seq;
+} log_head_t;
+
+// Writer state, only touched by the writer task after init, cur_sector and cur_seq
+//   only under sector_lock.
+static uint32_t cur_sector;
+static uint32_t cur_seq = 0;
+static uint32_t write_off;              // in the current sector
+static bool need_new_sector = true;
+static uint32_t last_session = 0;       // latest one written
+static uint8_t page[PAGE_SIZE];
+static uint32_t page_len = 0;
+static int64_t page_since_us = 0;       // oldest record in the page
+static uint32_t dropped = 0;
+
+static uint8_t crc8(uint8_t crc, const uint8_t *data, int len)
+{
+    while (len--)
+    {
+        crc ^= *data++;
+        for (int i = 0; i < 8; i++)
+            crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+    return crc;
+}
+
+static uint8_t record_crc(const log_record_t *r)
+{
+    // Everything but the crc byte itself.
+    const uint8_t *bytes = (const uint8_t *)r;
+    return crc8(crc8(0, bytes, 2), bytes + 3, r->h.len - 3);
+}
+
+static bool record_ok(const log_record_t *r)
+{
+    return (r->h.len >= sizeof(record_header_t)) && (r->h.len <= sizeof(log_record_t)) &&
+           (r->h.type >= LOG_START) && (r->h.type <= LOG_SUMMARY) &&
+           (r->h.crc == record_crc(r));
+}
+
+static uint32_t sector_addr(uint32_t sector)
+{
+    return sector * SECTOR_SIZE;
+}
+
+static bool read_header(uint32_t sector, sector_header_t *h)
+{
+    return (ESP_OK == esp_partition_read(part, sector_addr(sector), h, sizeof(*h))) &&
+           (h->magic == SECTOR_MAGIC);
+}
+
+// Read the record at off, false at the end of the sector's records.
+static bool read_record(uint32_t sector, uint32_t off, log_record_t *r)
+{
+    if (off + sizeof(record_header_t) > SECTOR_SIZE)
+        return false;
+
+    if (ESP_OK != esp_partition_read(part, sector_addr(sector) + off, &r->h, sizeof(r->h)))
+        return false;
+
+    if ((r->h.type == LOG_ERASED) || (r->h.len < sizeof(record_header_t)) ||
+        (r->h.len > sizeof(log_record_t)) || (off + r->h.len > SECTOR_SIZE))
+        return false;
+
+    const uint32_t rest = r->h.len - sizeof(record_header_t);
+    if (rest && (ESP_OK != esp_partition_read(part, sector_addr(sector) + off + sizeof(r->h), &r->h + 1, rest)))
+        return false;
+
+    return record_ok(r);
+}
+
+static void flush()
+{
+    if (!page_len)
+        return;
+
+    const esp_err_t err = esp_partition_write(part, sector_addr(cur_sector) + write_off, page, page_len);
+    if (err)
+    {
+        BINLOG(BL_COOK_LOG_WRITE_FAILED, (unsigned)cur_sector, (unsigned)write_off, err);
+        need_new_sector = true;
+    }
+
+    write_off += page_len;
+    page_len = 0;
+}
+
+static void open_next_sector()
+{
+    xSemaphoreTake(sector_lock, portMAX_DELAY);
+    cur_sector = (cur_sector + 1) % sector_count;
+
+    const sector_header_t h = {
+        .magic = SECTOR_MAGIC,
+        .seq = ++cur_seq,
+        .first_session = last_session,
+        .reserved = 0xFFFFFFFF,
+    };
+
+    // Stalls everything not in IRAM for the length of the erase, once per 4K of log.
+    esp_err_t err = esp_partition_erase_range(part, sector_addr(cur_sector), SECTOR_SIZE);
+    if (!err)
+        err = esp_partition_write(part, sector_addr(cur_sector), &h, sizeof(h));
+    xSemaphoreGive(sector_lock);
+
+    if (err)
+        BINLOG(BL_COOK_LOG_SECTOR_FAILED, (unsigned)cur_sector, err);
+
+    write_off = sizeof(h);
+    need_new_sector = false;
+}
+
+static void append(const log_record_t *r)
+{
+    if (need_new_sector || (write_off + page_len + r->h.len > SECTOR_SIZE))
+    {
+        flush();
+        open_next_sector();
+    }
+
+    if (page_len + r->h.len > sizeof(page))
+        flush();
+
+    if (!page_len)
+        page_since_us = esp_timer_get_time();
+
+    memcpy(page + page_len, r, r->h.len);
+    page_len += r->h.len;
+
+    if (r->h.session > last_session)
+        last_session = r->h.session;
+
+    if (r->h.type == LOG_END)
+        flush();
+}
+
+static void cook_log_task(void *arg)
+{
+    while (1)
+    {
+        log_record_t r;
+        if (xQueueReceive(queue, &r, COOK_LOG_FLUSH_S * 1000 / portTICK_PERIOD_MS))
+            append(&r);
+
+        if (page_len && (esp_timer_get_time() - page_since_us >= COOK_LOG_FLUSH_S * 1000000LL))
+            flush();
+    }
+}
+
+// Find where writing left off: the sector with the highest sequence number, and the
+//   end of the records in it.
+static void mount()
+{
+    bool found = false;
+    sector_header_t h;
+    sector_header_t cur = { 0 };
+
+    for (uint32_t s = 0; s < sector_count; s++)
+    {
+        if (read_header(s, &h) && (!found || (h.seq > cur.seq)))
+        {
+            found = true;
+            cur = h;
+            cur_sector = s;
+        }
+    }
+
+    if (!found)
+    {
+        // Fresh partition, the first record opens sector 0.
+        cur_sector = sector_count - 1;
+        return;
+    }
+
+    cur_seq = cur.seq;
+    last_session = cur.first_session;
+
+    log_record_t r;
+    uint32_t off = sizeof(sector_header_t);
+    while (read_record(cur_sector, off, &r))
+    {
+        if (r.h.session > last_session)
+            last_session = r.h.session;
+        off += r.h.len;
+    }
+
+    write_off = off;
+
+    // Anything but erased flash after the last good record is a torn write.
+    uint8_t next = LOG_ERASED;
+    if (off < SECTOR_SIZE)
+        esp_partition_read(part, sector_addr(cur_sector) + off, &next, 1);
+    need_new_sector = (next != LOG_ERASED);
+}
+
+void cook_log_init()
+{
+    sector_lock = xSemaphoreCreateMutex();
+
+    part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, COOK_LOG_SUBTYPE, "cooklog");
+    if (!part)
+    {
+        printf("No cook log partition!\n");
+        return;
+    }
+
+    sector_count = part->size / SECTOR_SIZE;
+    mount();
+    next_session = last_session + 1;
+
+    printf("Cook log: %lu sectors, at %lu:%lu, next session %lu\n",
+           (unsigned long)sector_count, (unsigned long)cur_sector,
+           (unsigned long)write_off, (unsigned long)next_session);
+
+    queue = xQueueCreate(QUEUE_LEN, sizeof(log_record_t));
+    xTaskCreate(cook_log_task, "cook_log", 3072, NULL, tskIDLE_PRIORITY+2, NULL);
+}
+
+static void post(log_record_t *r, log_type_t type, uint32_t id, uint8_t len)
+{
+    r->h.type = type;
+    r->h.len = len;
+    r->h.session = id;
+    r->h.time = time(NULL);
+    r->h.crc = record_crc(r);
+
+    if (!xQueueSend(queue, r, 0))
+        dropped++;
+}
+
+uint32_t cook_log_start()
+{
+    if (!queue)
+        return 0;
+
+    if (session)
+        cook_log_end();
+
+    log_record_t r = { 0 };
+    const uint32_t id = next_session++;
+    post(&r, LOG_START, id, sizeof(record_header_t));
+    session = id;
+    return id;
+}
+
+void cook_log_end()
+{
+    const uint32_t id = session;
+    if (!id)
+        return;
+
+    log_record_t r = { 0 };
+    session = 0;
+    post(&r, LOG_END, id, sizeof(record_header_t));
+}
+
+uint32_t cook_log_session()
+{
+    return session;
+}
+
+static int16_t to_dF(int32_t cF)
+{
+    return (cF + ((cF < 0) ? -5 : 5)) / 10;
+}
+
+void cook_log_sample(const history_record_t *record)
+{
+    const uint32_t id = session;
+    if (!id || (record->time % COOK_LOG_SAMPLE_S))
+        return;
+
+    log_record_t r = { 0 };
+    r.sample.temp_dF = to_dF(record->temp_cF);
+    r.sample.target_dF = to_dF(record->target_cF);
+    r.sample.bake_duty = record->bake_duty;
+    r.sample.broil_duty = record->broil_duty;
+    r.sample.outputs = record->outputs;
+    r.sample.probes = record->probes;
+
+    int n = 0;
+    for (int i = 0; i < HISTORY_PROBES; i++)
+    {
+        if (record->probes & (1 << i))
+            r.sample.probe_dF[n++] = to_dF(record->probe_cF[i]);
+    }
+
+    const int size = sizeof(record_header_t) + sizeof(r.sample) - sizeof(r.sample.probe_dF) + n * sizeof(int16_t);
+    post(&r, LOG_SAMPLE, id, size);
+}
+
+void cook_log_event(int event, int argument, const char *detail)
+{
+    const uint32_t id = session;
+    if (!id)
+        return;
+
+    log_record_t r = { 0 };
+    r.h.code = event;
+    r.event.argument = argument;
+    const int len = detail ? strnlen(detail, DETAIL_LEN) : 0;
+    if (len)
+        memcpy(r.event.detail, detail, len);
+
+    // Only as much of the detail as there is, rounded up to keep records aligned.
+    const int size = sizeof(record_header_t) + sizeof(r.event.argument) + ((len + 3) & ~3);
+    post(&r, LOG_EVENT, id, size);
+}
+
+void cook_log_summary(const cook_summary_t *summary)
+{
+    const uint32_t id = session;
+    if (!id)
+        return;
+
+    log_record_t r = { 0 };
+    r.summary = *summary;
+
+    const uint8_t *sha = esp_app_get_description()->app_elf_sha256;
+    r.summary.firmware = (sha[0] << 24) | (sha[1] << 16) | (sha[2] << 8) | sha[3];
+
+    post(&r, LOG_SUMMARY, id, sizeof(record_header_t) + sizeof(r.summary));
+}
+
+// deci-F as a CSV number, "-1.5"
+static int print_deci(char *buf, int size, int32_t deci)
+{
+    const uint32_t mag = (deci < 0) ? -(uint32_t)deci : deci;
+    return snprintf(buf, size, "%s%lu.%lu", (deci < 0) ? "-" : "",
+                    (unsigned long)(mag / 10), (unsigned long)(mag % 10));
+}
+
+// The CSV has a column for each food probe, named as the probe is now.
+static int print_header(char *buf, int size)
+{
+    int len = snprintf(buf, size, "time,temp,target,bake,broil,outputs,event,argument,detail");
+    for (int i = 0; i < HISTORY_PROBES; i++)
+    {
+        if (i == MCP9600_OVEN)
+            continue;
+
+        const char *name = mcp9600_name(i);
+        if (*name)
+            len += snprintf(buf + len, size - len, ",%s", name);
+        else
+            len += snprintf(buf + len, size - len, ",probe%i", i);
+    }
+    buf[len++] = '\n';
+    return len;
+}
+
+static int print_record(char *buf, int size, const log_record_t *r)
+{
+    int len = snprintf(buf, size, "%lu,", (unsigned long)r->h.time);
+
+    switch (r->h.type)
+    {
+    case LOG_SAMPLE:
+        len += print_deci(buf + len, size - len, r->sample.temp_dF);
+        buf[len++] = ',';
+        len += print_deci(buf + len, size - len, r->sample.target_dF);
+        len += snprintf(buf + len, size - len, ",%u,%u,%u,,,",
+                        r->sample.bake_duty, r->sample.broil_duty, r->sample.outputs);
+        break;
+
+    case LOG_EVENT:
+    {
+        const int detail_len = r->h.len - sizeof(record_header_t) - sizeof(r->event.argument);
+        len += snprintf(buf + len, size - len, ",,,,,%s,%li,%.*s",
+                        EV_name(r->h.code), (long)r->event.argument,
+                        (int)strnlen(r->event.detail, detail_len), r->event.detail);
+        break;
+    }
+
+    case LOG_START:
+    case LOG_END:
+        len += snprintf(buf + len, size - len, ",,,,,%s,%lu,",
+                        (r->h.type == LOG_START) ? "start" : "end", (unsigned long)r->h.session);
+        break;
+
+    default:
+        return 0;
+    }
+
+    // Probe columns, only samples fill them.
+    const uint8_t probes = (r->h.type == LOG_SAMPLE) ? r->sample.probes : 0;
+    int n = 0;
+    for (int i = 0; i < HISTORY_PROBES; i++)
+    {
+        if (i == MCP9600_OVEN)
+            continue;
+
+        buf[len++] = ',';
+        if (probes & (1 << i))
+            len += print_deci(buf + len, size - len, r->sample.probe_dF[n++]);
+    }
+    buf[len++] = '\n';
+
+    return len;
+}
+
+static log_head_t head()
+{
+    xSemaphoreTake(sector_lock, portMAX_DELAY);
+    const log_head_t head = { cur_sector, cur_seq };
+    xSemaphoreGive(sector_lock);
+    return head;
+}
+
+// False for a sector that is empty or has been reused since the snapshot was taken.
+static bool read_header_since(const log_head_t *head, uint32_t sector, sector_header_t *h)
+{
+    xSemaphoreTake(sector_lock, portMAX_DELAY);
+    const bool ok = read_header(sector, h);
+    xSemaphoreGive(sector_lock);
+
+    return ok && (h->seq <= head->seq);
+}
+
+esp_err_t get_cook_log(httpd_req_t *req)
+{
+    // /logs/<id>.csv
+    const char *name = strrchr(req->uri, '/');
+    const uint32_t id = name ? strtoul(name + 1, NULL, 10) : 0;
+    if (!part || !id)
+        return httpd_resp_send_404(req);
+
+    char buf[1024];
+    int len = 0;
+    bool found = false;
+    bool ended = false;
+
+    // Oldest sector first, the one after the current one.
+    const log_head_t at = head();
+    sector_header_t h;
+    sector_header_t next;
+    uint32_t s = (at.sector + 1) % sector_count;
+    bool have_next = read_header_since(&at, s, &next);
+
+    for (uint32_t i = 0; (i < sector_count) && !ended; i++)
+    {
+        h = next;
+        const bool valid = have_next;
+        const uint32_t sector = s;
+
+        s = (s + 1) % sector_count;
+        have_next = (i + 1 < sector_count) && read_header_since(&at, s, &next);
+
+        // Sessions in this sector run from its first_session to the next one's.
+        if (!valid || (h.first_session > id) || (have_next && (next.first_session < id)))
+            continue;
+
+        log_record_t r;
+        for (uint32_t off = sizeof(sector_header_t); read_record(sector, off, &r); off += r.h.len)
+        {
+            if (r.h.session != id)
+                continue;
+
+            if (!found)
+            {
+                found = true;
+                httpd_resp_set_type(req, "text/csv");
+                len = print_header(buf, sizeof(buf));
+            }
+
+            if (len > (int)sizeof(buf) - 160)
+            {
+                if (ESP_OK != httpd_resp_send_chunk(req, buf, len))
+                    return ESP_FAIL;
+                len = 0;
+            }
+
+            len += print_record(buf + len, sizeof(buf) - len, &r);
+            if (r.h.type == LOG_END)
+            {
+                ended = true;
+                break;
+            }
+        }
+    }
+
+    if (!found)
+        return httpd_resp_send_404(req);
+
+    if (len && (ESP_OK != httpd_resp_send_chunk(req, buf, len)))
+        return ESP_FAIL;
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+esp_err_t get_cook_logs(httpd_req_t *req)
+{
+    uint32_t oldest = 0;
+    uint32_t used = 0;
+    sector_header_t h;
+
+    // All of the headers in one go, a few ms of reads the writer can wait for.
+    xSemaphoreTake(sector_lock, portMAX_DELAY);
+    const uint32_t erases = cur_seq;
+    for (uint32_t i = 1; part && (i <= sector_count); i++)
+    {
+        if (!read_header((cur_sector + i) % sector_count, &h))
+            continue;
+
+        // Once the log has wrapped the first session may only be partly there.
+        if (!used)
+            oldest = h.first_session ? h.first_session : 1;
+        used++;
+    }
+    xSemaphoreGive(sector_lock);
+
+    char json[200];
+    const int len = snprintf(json, sizeof(json),
+                             "{\"first\":%lu,\"last\":%lu,\"open\":%lu,\"sectors\":%lu,\"used\":%lu,\"erases\":%lu,\"dropped\":%lu}",
+                             (unsigned long)oldest, (unsigned long)(next_session - 1),
+                             (unsigned long)session, (unsigned long)sector_count, (unsigned long)used,
+                             (unsigned long)erases, (unsigned long)dropped);
+
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, json, len);
+}
+
+// centi-F as a JSON number, "-1.05"
+static int print_centi(char *buf, int size, int32_t centi)
+{
+    const uint32_t mag = (centi < 0) ? -(uint32_t)centi : centi;
+    return snprintf(buf, size, "%s%lu.%02lu", (centi < 0) ? "-" : "",
+                    (unsigned long)(mag / 100), (unsigned long)(mag % 100));
+}
+
+static int print_summary(char *buf, int size, const record_header_t *h, const cook_summary_t *s)
+{
+    int len = snprintf(buf, size, "{\"session\":%lu,\"end\":%lu,\"duration\":%lu,\"target\":",
+                       (unsigned long)h->session, (unsigned long)h->time, (unsigned long)s->duration_s);
+    len += print_centi(buf + len, size - len, s->target_cF);
+
+    if (s->preheat_s >= 0)
+        len += snprintf(buf + len, size - len, ",\"preheat\":%li", (long)s->preheat_s);
+    else
+        len += snprintf(buf + len, size - len, ",\"preheat\":null");
+
+    len += snprintf(buf + len, size - len, ",\"overshoot\":");
+    len += print_centi(buf + len, size - len, s->overshoot_cF);
+
+    len += snprintf(buf + len, size - len, ",\"rms\":");
+    if (s->rms_cF >= 0)
+        len += print_centi(buf + len, size - len, s->rms_cF);
+    else
+        len += snprintf(buf + len, size - len, "null");
+
+    len += snprintf(buf + len, size - len,
+                    ",\"settled\":%lu,\"bake_cycles\":%lu,\"broil_cycles\":%lu,\"energy_wh\":%lu,\"firmware\":\"%08lx\"}",
+                    (unsigned long)s->settled_s, (unsigned long)s->bake_cycles, (unsigned long)s->broil_cycles,
+                    (unsigned long)s->energy_Wh, (unsigned long)s->firmware);
+    return len;
+}
+
+esp_err_t get_cook_summaries(httpd_req_t *req)
+{
+    // The server runs one handler at a time.
+    static uint8_t sector_buf[SECTOR_SIZE];
+
+    uint32_t since = 0;
+    char query[32];
+    char value[12];
+    if ((ESP_OK == httpd_req_get_url_query_str(req, query, sizeof(query))) &&
+        (ESP_OK == httpd_query_key_value(query, "since", value, sizeof(value))))
+    {
+        since = strtoul(value, NULL, 10);
+    }
+
+    const uint8_t *sha = esp_app_get_description()->app_elf_sha256;
+
+    httpd_resp_set_type(req, "application/json");
+
+    char buf[1024];
+    int len = snprintf(buf, sizeof(buf), "{\"firmware\":\"%02x%02x%02x%02x\",\"cooks\":[",
+                       sha[0], sha[1], sha[2], sha[3]);
+    uint32_t count = 0;
+
+    // Oldest sector first, one read each.
+    const log_head_t at = head();
+    sector_header_t h;
+    sector_header_t next;
+    uint32_t s = part ? (at.sector + 1) % sector_count : 0;
+    bool have_next = part && read_header_since(&at, s, &next);
+
+    for (uint32_t i = 0; part && (i < sector_count); i++)
+    {
+        h = next;
+        const bool valid = have_next;
+        const uint32_t sector = s;
+
+        s = (s + 1) % sector_count;
+        have_next = (i + 1 < sector_count) && read_header_since(&at, s, &next);
+
+        // Every session here had started before the next sector was opened.
+        if (!valid || (have_next && (next.first_session <= since)))
+            continue;
+
+        xSemaphoreTake(sector_lock, portMAX_DELAY);
+        const esp_err_t err = esp_partition_read(part, sector_addr(sector), sector_buf, SECTOR_SIZE);
+        xSemaphoreGive(sector_lock);
+
+        // Reused by the writer since its header was read.
+        if (err || memcmp(sector_buf, &h, sizeof(h)))
+            continue;
+
+        log_record_t r;
+        for (uint32_t off = sizeof(sector_header_t); off + sizeof(record_header_t) <= SECTOR_SIZE; off += r.h.len)
+        {
+            memcpy(&r.h, sector_buf + off, sizeof(r.h));
+            if ((r.h.type == LOG_ERASED) || (r.h.len < sizeof(record_header_t)) ||
+                (r.h.len > sizeof(log_record_t)) || (off + r.h.len > SECTOR_SIZE))
+                break;
+
+            memcpy(&r, sector_buf + off, r.h.len);
+            if (!record_ok(&r))
+                break;
+
+            if ((r.h.type != LOG_SUMMARY) || (r.h.session <= since))
+                continue;
+
+            if (len > (int)sizeof(buf) - 320)
+            {
+                if (ESP_OK != httpd_resp_send_chunk(req, buf, len))
+                    return ESP_FAIL;
+                len = 0;
+            }
+
+            const cook_summary_t summary = r.summary;
+            if (count++)
+                buf[len++] = ',';
+            len += print_summary(buf + len, sizeof(buf) - len, &r.h, &summary);
+        }
+    }
+
+    len += snprintf(buf + len, sizeof(buf) - len, "]}");
+    if (ESP_OK != httpd_resp_send_chunk(req, buf, len))
+        return ESP_FAIL;
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
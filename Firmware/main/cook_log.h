@@ -0,0 +1,58 @@
+#ifndef COOK_LOG_H
+#define COOK_LOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "history.h"
+#include "cook_summary.h"
+#include "esp_http_server.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Record of every cook, kept on the "cooklog" flash partition.
+ *
+ * A session runs from the oven being turned on until it is off again. While one is
+ *   open its samples (every COOK_LOG_SAMPLE_S) and events are appended as small binary
+ *   records. Callers only queue records; a low priority task batches them into a page
+ *   buffer and writes it out when full, every COOK_LOG_FLUSH_S or when the session ends,
+ *   so a reader can be up to that far behind.
+ * The partition is used as one circular log of 4K sectors, erased in turn as the head
+ *   reaches them, so every sector wears at the same rate and the oldest cooks are the
+ *   ones dropped. Each record carries a CRC so a write torn by a power cut is found at
+ *   boot and writing carries on in a fresh sector.
+ */
+
+#define COOK_LOG_SAMPLE_S   2
+#define COOK_LOG_FLUSH_S    10
+
+// Find the partition and where the log ends, and start the writer task.
+extern void cook_log_init();
+
+// From the control task. Returns the new session id, 0 if there is no log.
+extern uint32_t cook_log_start();
+extern void cook_log_end();
+// Ignored when no session is open.
+extern void cook_log_sample(const history_record_t *record);
+// Safe to call from any task. Ignored when no session is open.
+extern void cook_log_event(int event, int argument, const char *detail);
+// How the cook went, just before it ends.
+extern void cook_log_summary(const cook_summary_t *summary);
+
+// Open session id, or 0.
+extern uint32_t cook_log_session();
+
+// GET /logs/<id>.csv, streamed straight from flash.
+extern esp_err_t get_cook_log(httpd_req_t *req);
+// GET /logs.json, which sessions are still held.
+extern esp_err_t get_cook_logs(httpd_req_t *req);
+// GET /cooks.json?since=<session>, the summaries of the cooks still held, oldest first.
+extern esp_err_t get_cook_summaries(httpd_req_t *req);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // COOK_LOG_H
@@ -0,0 +1,89 @@
+#include "cook_summary.h"
+
+#include <math.h>
+#include <string.h>
+
+// The cook so far, control task only.
+static cook_summary_t summary;
+static uint64_t energy_J;
+static uint64_t error_sq;           // sum over the settled seconds, cF squared
+
+// The target being held. A change of target starts over.
+static int32_t target;
+static bool below;                  // been below it since it was set
+static bool reached;                // came up to it from below
+static uint32_t reached_at;
+static bool first_target;           // still on the cook's first target
+static uint32_t first_target_at;
+
+void cook_summary_start()
+{
+    memset(&summary, 0, sizeof(summary));
+    summary.preheat_s = -1;
+    summary.rms_cF = -1;
+    energy_J = 0;
+    error_sq = 0;
+    target = 0;
+}
+
+void cook_summary_add(const cook_second_t *second)
+{
+    const uint32_t now = summary.duration_s++;
+
+    summary.bake_cycles += second->bake_starts;
+    summary.broil_cycles += second->broil_starts;
+    energy_J += second->energy_J;
+
+    if (second->target_cF != target)
+    {
+        first_target = !summary.target_cF && second->target_cF;
+        first_target_at = now;
+        target = second->target_cF;
+        below = false;
+        reached = false;
+    }
+
+    if (target > summary.target_cF)
+        summary.target_cF = target;
+
+    if (!target || !second->temp_ok)
+        return;
+
+    const int32_t error = second->temp_cF - target;
+
+    // Preheat counts an oven that was already hot enough as ready straight away.
+    if (first_target && (error >= 0))
+    {
+        summary.preheat_s = now - first_target_at;
+        first_target = false;
+    }
+
+    if (error < 0)
+        below = true;
+    else if (below && !reached)
+    {
+        reached = true;
+        reached_at = now;
+    }
+
+    if (!reached)
+        return;
+
+    if (error > summary.overshoot_cF)
+        summary.overshoot_cF = error;
+
+    if (now - reached_at >= COOK_SUMMARY_SETTLE_S)
+    {
+        error_sq += (int64_t)error * error;
+        summary.settled_s++;
+    }
+}
+
+void cook_summary_end(cook_summary_t *out)
+{
+    if (summary.settled_s)
+        summary.rms_cF = lround(sqrt((double)error_sq / summary.settled_s));
+    summary.energy_Wh = (energy_J + 1800) / 3600;
+
+    *out = summary;
+}
@@ -0,0 +1,58 @@
+#ifndef COOK_SUMMARY_H
+#define COOK_SUMMARY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* How well the oven held its temperature over one cook, kept with the cook in the log.
+ *
+ * The controller hands over every second of a cook. From those:
+ *   preheat    seconds from the first target being set until the oven first reached it
+ *   overshoot  furthest the oven went above a target it had climbed up to
+ *   rms        error against the target once settled, COOK_SUMMARY_SETTLE_S after
+ *              reaching it, until the target changes
+ * and the relay switch-ons and the element energy are added up.
+ * Seconds without a good oven reading only count towards the duration.
+ */
+
+#define COOK_SUMMARY_SETTLE_S 300
+
+typedef struct
+{
+    uint32_t duration_s;
+    int32_t target_cF;      // highest target of the cook, 0 if it never had one
+    int32_t preheat_s;      // -1 if the first target was never reached
+    int32_t overshoot_cF;
+    int32_t rms_cF;         // -1 without any settled seconds
+    uint32_t settled_s;     // seconds the rms is over
+    uint32_t bake_cycles;   // relay switch-ons
+    uint32_t broil_cycles;
+    uint32_t energy_Wh;
+    uint32_t firmware;      // first four bytes of the app's ELF SHA-256, cook_log_summary() sets it
+} cook_summary_t;
+
+// One second of a cook.
+typedef struct
+{
+    int32_t temp_cF;
+    int32_t target_cF;      // 0 when there is none
+    bool temp_ok;
+    uint16_t bake_starts;
+    uint16_t broil_starts;
+    uint32_t energy_J;
+} cook_second_t;
+
+// From the control task.
+extern void cook_summary_start();
+extern void cook_summary_add(const cook_second_t *second);
+extern void cook_summary_end(cook_summary_t *summary);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // COOK_SUMMARY_H
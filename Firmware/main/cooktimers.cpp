@@ -1,6 +1,17 @@
 #include "cooktimers.h"
 #include "stovectrl.h"
-
+#include "mcp9600.h"
+#include "events.h"
+#include "binlog.h"
+#include "timingwheel.h"
+#include "elapsedtimer.h"
+
+#include <list>
+#include <cmath>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <atomic>
 #include <mutex>
 #include <chrono>
 #include <string>
@@ -11,91 +22,12 @@
 
 using namespace std::chrono_literals;
 
-// https://codereview.stackexchange.com/a/225927
-class ElapsedTimer
-{
-protected:
-    using clock = std::chrono::steady_clock;
-
-private:
-    clock::duration m_elapsedTime = {0s};
-    clock::time_point m_startTime = {};
-    static std::mutex timer_mutex;
-
-    bool isRun() const
-    {
-        return m_startTime != clock::time_point{};
-    }
-
-public:
-    bool isRunning() const
-    {
-        const std::lock_guard<std::mutex> lock(timer_mutex);
-        return isRun();
-    }
-
-    void start()
-    {
-        const std::lock_guard<std::mutex> lock(timer_mutex);
-        if (!isRun())
-        {
-            m_startTime = clock::now();
-        }
-    }
-
-    void pause()
-    {
-        const std::lock_guard<std::mutex> lock(timer_mutex);
-        if (isRun())
-        {
-            m_elapsedTime += clock::now() - m_startTime;
-            m_startTime = {};
-        }
-    }
+// An open ended probe step whose probe has no reading for this long gives up.
+constexpr const static auto probe_lost_limit = 30s;
 
-    void reset()
-    {
-        const std::lock_guard<std::mutex> lock(timer_mutex);
-        m_elapsedTime = clock::duration{0s};
-        m_startTime = {};
-    }
-
-    clock::duration elapsedTime() const
-    {
-        const std::lock_guard<std::mutex> lock(timer_mutex);
-        clock::duration result = m_elapsedTime;
-        if (isRun())
-        {
-            result += clock::now() - m_startTime;
-        }
-        return result;
-    }
-};
-
-std::mutex ElapsedTimer::timer_mutex;
-
-class Timer : public ElapsedTimer
-{
-    clock::duration m_interval = {};
-public:
-    explicit Timer(clock::duration interval)
-        : m_interval(interval)
-    {
-
-    }
-
-    clock::duration duration() const
-    {
-        return m_interval;
-    }
-
-    bool timedout() const
-    {
-        return m_interval < elapsedTime();
-    }
-};
-
-class CookTimer
+// Cook steps run one after another from the program list. Countdown and alert timers
+//   are independent of the program, so they are scheduled on the timing wheel instead.
+class CookTimer : public TimingWheelNode
 {
 
 public:
@@ -109,9 +41,13 @@ public:
     };
 
     explicit CookTimer(const CookTimer &t)
-        : uid(t.uid)
+        : TimingWheelNode()
+        , uid(t.uid)
         , argument(t.argument)
         , action(t.action)
+        , preheat(t.preheat)
+        , probe(t.probe)
+        , probe_target(t.probe_target)
         , timer(t.timer)
     {
 
@@ -123,19 +59,38 @@ public:
         return *this;
     }
 
-    explicit CookTimer(Action action, int time_s, double argument)
+    // probe >= 0 ends a program step early once that probe reaches probe_target (centi-F).
+    //   A probe step with no duration runs until then.
+    explicit CookTimer(Action action, int time_s, double argument, bool preheat = false,
+                       int probe = -1, int32_t probe_target = 0)
         : uid(next_uid())
         , argument(argument)
         , action(action)
+        , preheat(preheat && !concurrent(action))
+        , probe(concurrent(action) ? -1 : probe)
+        , probe_target(probe_target)
         , timer(std::chrono::seconds(time_s))
     {
 
     }
 
+    // Called every tick until the timer is running.
     void start()
     {
-        start_action();
-        timer.start();
+        if (!action_started)
+        {
+            start_action();
+            action_started = true;
+        }
+
+        // A preheat timer only starts counting once the oven has settled at the target.
+        if (!preheat || SC_target_stable())
+            timer.start();
+    }
+
+    bool waiting() const
+    {
+        return action_started && !timer.isRunning();
     }
 
     void pause()
@@ -150,19 +105,66 @@ public:
 
     bool done() const
     {
-        return timer.isRunning() && timer.timedout();
+        if (!timer.isRunning())
+            return false;
+
+        if (probeReached())
+            return true;
+
+        if (probeLost())
+            return true;
+
+        return timer.timedout() && !openEnded();
     }
 
-    void toJSON(std::string &buf) const
+    bool openEnded() const
+    {
+        return watchingProbe() && (timer.duration().count() == 0);
+    }
+
+    bool probeLost() const
+    {
+        return openEnded() && (probe_lost_for.elapsedTime() >= probe_lost_limit);
+    }
+
+    bool watchingProbe() const
+    {
+        return probe >= 0;
+    }
+
+    bool probeReached() const
+    {
+        return watchingProbe() && (SC_probe_temp_cF(probe) >= probe_target);
+    }
+
+    // now_ms is device monotonic time. start and deadline are on the same clock so the
+    //   browser can run the countdown itself; both are -1 while the timer isn't counting.
+    void toJSON(std::string &buf, int64_t now_ms) const
     {
         using namespace std::chrono;
         const auto time = duration_cast<seconds>(timer.elapsedTime());
         const auto duration = duration_cast<seconds>(timer.duration());
+        const int starts_in = waiting() ? SC_preheat_eta_s() : 0;
+
+        int64_t start_ms = -1;
+        int64_t deadline_ms = -1;
+        if (timer.isRunning())
+        {
+            start_ms = now_ms - duration_cast<milliseconds>(timer.elapsedTime()).count();
+            deadline_ms = start_ms + duration_cast<milliseconds>(timer.duration()).count();
+        }
 
         buf += "\n\t{"
                "\n\t\t\"uid\":" + std::to_string(uid)
             +  ",\n\t\t\"elapsed\": " + std::to_string(time.count())
             +  ",\n\t\t\"duration\": " + std::to_string(duration.count())
+            +  ",\n\t\t\"start\": " + std::to_string(start_ms)
+            +  ",\n\t\t\"deadline\": " + std::to_string(deadline_ms)
+            +  ",\n\t\t\"preheat\": " + std::to_string(preheat)
+            +  ",\n\t\t\"waiting\": " + std::to_string(waiting())
+            +  ",\n\t\t\"starts_in\": " + std::to_string(starts_in)
+            +  ",\n\t\t\"probe\": " + std::to_string(probe)
+            +  ",\n\t\t\"until\": " + std::to_string(probe_target / 100)
             +  ",\n\t\t\"argument\": \"" + argument_string() +  "\""
             +  ",\n\t\t\"action\": \"" + to_string(action) + "\""
                "\n\t}";
@@ -170,12 +172,45 @@ public:
 
     void check()
     {
+        if (openEnded())
+        {
+            if (SC_probe_temp_cF(probe) == INT32_MIN)
+                probe_lost_for.start();
+            else
+                probe_lost_for.reset();
+        }
+
         if (done())
         {
             done_action();
         }
     }
 
+    // Called by the timing wheel once the interval has passed.
+    void fire()
+    {
+        done_action();
+    }
+
+    // Timers which do not touch the oven can run alongside the cook program.
+    static bool concurrent(Action a)
+    {
+        return (a == Countdown) || (a == Alert_Webpage);
+    }
+
+    bool concurrent() const
+    {
+        return concurrent(action);
+    }
+
+    // A concurrent timer's place in concurrent_timers, so the wheel can erase it in O(1).
+    std::list<CookTimer>::iterator entry;
+
+    std::chrono::seconds interval() const
+    {
+        return std::chrono::duration_cast<std::chrono::seconds>(timer.duration());
+    }
+
     int id() const
     {
         return uid;
@@ -197,7 +232,12 @@ private:
     const int uid;
     const double argument;
     const Action action { Countdown };
+    const bool preheat { false };
+    const int probe { -1 };
+    const int32_t probe_target { 0 };
+    bool action_started { false };
     Timer timer;
+    ElapsedTimer probe_lost_for;    // while an open ended step's probe has no reading
 
     static int next_uid()
     {
@@ -226,7 +266,7 @@ private:
 
     void start_action()
     {
-        printf("Timer %i started!\n", uid);
+        BINLOG(BL_TIMER_STARTED, uid);
 
         switch(action)
         {
@@ -245,13 +285,24 @@ private:
 
     void done_action()
     {
-        printf("Timer %i timed out!\n", uid);
+        BINLOG(BL_TIMER_DONE, uid);
+
+        if (probeReached())
+            EV_post(SE_Target_Reached, probe_target / 100, mcp9600_name(probe));
+        else if (probeLost())
+        {
+            BINLOG(BL_TIMER_PROBE_LOST, uid, probe, (int)std::chrono::duration_cast<std::chrono::seconds>(probe_lost_limit).count());
+            EV_post(SE_Fault, probe_target / 100, "probe_lost");
+        }
 
         switch(action)
         {
         case Cook:
+            return;
+
         case Countdown:
         case Alert_Webpage:
+            EV_post(SE_Timer_Fired, uid, to_string(action).c_str());
             return;
 
         case Stop_Cook:
@@ -270,13 +321,25 @@ std::mutex CookTimer::mutex;
 /*******************************/
 
 #define MAX_TIMERS 30
-static std::vector<CookTimer> timers;
+#define MAX_TIMER_S         (7 * 24 * 3600)
+#define MAX_PROBE_TARGET_F  1000
+
+// std::list keeps the timers at a fixed address while they are linked into the wheel.
+static std::list<CookTimer> timers;            // sequential cook program, front runs
+static std::list<CookTimer> concurrent_timers; // independent, driven by the wheel
 static std::mutex timers_mutex;
 
+// Bumped whenever a timer is added, removed, starts counting or fires.
+static std::atomic<unsigned> timers_version { 1 };
+
+// One wheel tick per second; 3 levels of 64 slots cover ~72 hours.
+static TimingWheel<6, 3> wheel;
+static ElapsedTimer wheel_clock;
+
 void CT_task_init()
 {
     const std::lock_guard<std::mutex> lock(timers_mutex);
-    timers.reserve(MAX_TIMERS);
+    wheel_clock.start();
 }
 
 void CT_update()
@@ -286,18 +349,52 @@ void CT_update()
     if (timers.empty())
         return;
 
-    if (timers.at(0).isRunning())
+    if (timers.front().isRunning())
     {
-        timers.at(0).check();
+        timers.front().check();
     }
     else
     {
-        timers.at(0).start();
+        timers.front().start();
+
+        if (timers.front().isRunning())
+        {
+            timers_version++;
+
+            // A probe already at its target is done on its first tick; run its action
+            //   before it is popped below.
+            timers.front().check();
+        }
     }
 
-    if(timers.at(0).done())
+    if(timers.front().done())
     {
-        timers.erase(timers.begin());
+        timers.pop_front();
+        timers_version++;
+    }
+}
+
+unsigned CT_version()
+{
+    return timers_version;
+}
+
+void CT_tick()
+{
+    using namespace std::chrono;
+
+    const std::lock_guard<std::mutex> lock(timers_mutex);
+
+    const auto now = duration_cast<seconds>(wheel_clock.elapsedTime()).count();
+    while (wheel.now() < now)
+    {
+        wheel.tick([](TimingWheelNode &node)
+        {
+            CookTimer &timer = static_cast<CookTimer &>(node);
+            timer.fire();
+            concurrent_timers.erase(timer.entry);
+            timers_version++;
+        });
     }
 }
 
@@ -307,13 +404,24 @@ esp_err_t get_timers(httpd_req_t *req)
 {
     const std::lock_guard<std::mutex> lock(timers_mutex);
 
+    using namespace std::chrono;
+    const int64_t now_ms = duration_cast<milliseconds>(cook_clock::now().time_since_epoch()).count();
+
     std::string json;
     json.reserve(1024);
 
-    json = "{ \"timers\" : [ "; // space incase timers is empty.
-    for (size_t i = 0; i < timers.size(); i++)
+    json = "{ \"now\": " + std::to_string(now_ms) + ","
+           " \"version\": " + std::to_string(timers_version) + ","
+           " \"timers\" : [ "; // space incase timers is empty.
+    for (const auto &timer : timers)
     {
-        timers.at(i).toJSON(json);
+        timer.toJSON(json, now_ms);
+
+        json += ",";
+    }
+    for (const auto &timer : concurrent_timers)
+    {
+        timer.toJSON(json, now_ms);
 
         json += ",";
     }
@@ -351,50 +459,109 @@ std::vector<std::string> split(const std::string &str, char delim1 = '&', char d
 }
 
 
+// A POST field as a whole number from min to max. Exceptions are off, so no std::stoi.
+static bool parse_int(const std::string &text, long min, long max, long *value)
+{
+    char *end;
+    errno = 0;
+    const long v = strtol(text.c_str(), &end, 10);
+    if ((end == text.c_str()) || *end || errno || (v < min) || (v > max))
+        return false;
+
+    *value = v;
+    return true;
+}
+
+static bool parse_double(const std::string &text, double *value)
+{
+    char *end;
+    const double v = strtod(text.c_str(), &end);
+    if ((end == text.c_str()) || *end || !std::isfinite(v))
+        return false;
+
+    *value = v;
+    return true;
+}
+
+static void insert_timer(int duration, double argument, CookTimer::Action action, bool preheat,
+                         int probe, int32_t until)
+{
+    BINLOG(BL_ADD_TIMER, duration, (int)argument, (int)action, probe);
+
+    const std::lock_guard<std::mutex> lock(timers_mutex);
+    if (timers.size() + concurrent_timers.size() >= MAX_TIMERS)
+    {
+        BINLOG(BL_TOO_MANY_TIMERS);
+        return;
+    }
+
+    auto &list = CookTimer::concurrent(action) ? concurrent_timers : timers;
+    CookTimer &timer = list.emplace_back(action, duration, argument, preheat, probe, until);
+
+    if (timer.concurrent())
+    {
+        timer.entry = std::prev(concurrent_timers.end());
+
+        // +1 tick: the current second has already partly passed.
+        timer.start();
+        wheel.schedule(timer, timer.interval().count() + 1);
+    }
+
+    timers_version++;
+}
+
 esp_err_t add_timer(httpd_req_t *req)
 {
     char content[100];
     if (ESP_OK != get_content(req, content, sizeof(content)))
         return ESP_FAIL;
 
-    //duration=36000&argument=100&action=Set+Temperature
+    //duration=36000&argument=100&action=Set+Temperature[&preheat=1[&probe=1&until=165]]
     auto s = split(content);
 
-    if (s.size() != 6)
+    if ((s.size() != 6) && (s.size() != 8) && (s.size() != 12))
     {
-        printf("Incorrect number of arguments for timer!\n");
+        BINLOG(BL_TIMER_ARG_COUNT, (int)s.size());
     }
     else if(s.at(0) != "duration")
     {
-        printf("Incorrect order" "(1)\n");
+        BINLOG(BL_TIMER_ORDER, 1);
     }
     else if(s.at(2) != "argument")
     {
-        printf("Incorrect order" "(2)\n");
+        BINLOG(BL_TIMER_ORDER, 2);
     }
     else if(s.at(4) != "action")
     {
-        printf("Incorrect order" "(3)\n");
+        BINLOG(BL_TIMER_ORDER, 3);
+    }
+    else if((s.size() >= 8) && (s.at(6) != "preheat"))
+    {
+        BINLOG(BL_TIMER_ORDER, 4);
+    }
+    else if((s.size() == 12) && ((s.at(8) != "probe") || (s.at(10) != "until")))
+    {
+        BINLOG(BL_TIMER_ORDER, 5);
     }
     else
     {
-        for(auto i : s) {
-            printf(i.c_str());
-            printf("\n");
-        }
-
-        const int duration = std::stoi(s.at(1));
-        const double argument = std::stod(s.at(3));
-        const auto action = CookTimer::from_post_string(s.at(5));
-
-        const std::lock_guard<std::mutex> lock(timers_mutex);
-        timers.push_back(CookTimer(action, duration, argument));
+        long duration = 0, probe = -1, until = 0;
+        double argument = 0;
+        if (!parse_int(s.at(1), 0, MAX_TIMER_S, &duration))
+            BINLOG_STR(BL_TIMER_BAD_VALUE, "duration");
+        else if (!parse_double(s.at(3), &argument))
+            BINLOG_STR(BL_TIMER_BAD_VALUE, "argument");
+        else if ((s.size() == 12) && !parse_int(s.at(9), 0, MCP9600_MAX_PROBES - 1, &probe))
+            BINLOG_STR(BL_TIMER_BAD_VALUE, "probe");
+        else if ((s.size() == 12) && !parse_int(s.at(11), 1, MAX_PROBE_TARGET_F, &until))
+            BINLOG_STR(BL_TIMER_BAD_VALUE, "until");
+        else if ((probe >= 0) && !mcp9600_present(probe))
+            BINLOG(BL_TIMER_BAD_PROBE, (int)probe);
+        else
+            insert_timer(duration, argument, CookTimer::from_post_string(s.at(5)),
+                         (s.size() >= 8) && (s.at(7) == "1"), probe, until * 100);
     }
 
-    printf("Add Timer\n");
-    printf(content);
-    printf("\n");
-
     return ack_http_post(req);
 }
 
@@ -408,19 +575,13 @@ esp_err_t rm_timer(httpd_req_t *req)
 
     {
         const std::lock_guard<std::mutex> lock(timers_mutex);
-        for (size_t i = 0; i < timers.size(); i++)
-        {
-            if (timers.at(i).id() == uid)
-            {
-                timers.erase(timers.begin() + i);
-                break;
-            }
-        }
+        // Erasing a concurrent timer also unlinks it from the wheel.
+        timers.remove_if([uid](const CookTimer &t) { return t.id() == uid; });
+        concurrent_timers.remove_if([uid](const CookTimer &t) { return t.id() == uid; });
+        timers_version++;
     }
 
-    printf("Remove Timer %i!\n", uid);
-    printf(content);
-    printf("\n");
+    BINLOG(BL_REMOVE_TIMER, uid);
 
     return ack_http_post(req);
 }
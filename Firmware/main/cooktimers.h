@@ -9,6 +9,10 @@ extern "C" {
 
 extern void CT_task_init();
 extern void CT_update();
+extern void CT_tick();
+
+// Changes whenever the timer list does, so clients know when to refetch it.
+extern unsigned CT_version();
 
 extern esp_err_t get_timers(httpd_req_t *req);
 extern esp_err_t add_timer(httpd_req_t *req);
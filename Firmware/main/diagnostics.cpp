@@ -0,0 +1,232 @@
+#include "diagnostics.h"
+
+#include "events.h"
+#include "mcp9600.h"
+#include "binlog.h"
+
+#include <array>
+#include <cstdio>
+#include <cstring>
+
+/* Detection times.
+ * Probe: DG_PROBE_TRIP bad samples in a row, well under a second in chip mode (~80ms
+ *   per conversion) and about a second linearizing (~320ms). DG_PROBE_CLEAR good ones
+ *   in a row to clear.
+ * Element: after element_window_s of continuous on time. Checked only below
+ *   element_check_below where losses are small enough that a working element always
+ *   shows a clear rise; the expected rise is scaled to each element's power. With both
+ *   on, a dead element is only caught if the other can't cover its share of the rise.
+ * Stuck relay: everything off for settle_s (the elements stay hot for a while after
+ *   switching off), then a rise of more than stuck_rise over any stuck_window_s.
+ *   So at worst settle_s + 2 * stuck_window_s.
+ * The door being open spoils both, the windows restart when it closes.
+ */
+
+#define DG_PROBE_TRIP   3
+#define DG_PROBE_CLEAR  10
+
+// Outside of what either thermocouple type covers, 1/16 C.
+#define DG_RAW16_MIN    (-200 * 16)
+#define DG_RAW16_MAX    (1372 * 16)
+
+namespace {
+
+// All temperatures centi-F.
+constexpr int element_window_s { 180 };
+constexpr int32_t element_check_below { 40000 };
+constexpr int32_t bake_min_rise { 1500 };     // 1500W bottom element
+constexpr int32_t broil_min_rise { 1000 };    // 1100W top element
+
+constexpr int settle_s { 180 };
+constexpr int stuck_window_s { 120 };
+constexpr int32_t stuck_rise { 1000 };
+
+struct ProbeDiag
+{
+    uint8_t open_count { 0 };
+    uint8_t short_count { 0 };
+    uint8_t good_count { 0 };
+    uint32_t faults { 0 };
+};
+
+// Watches one element while it is on.
+struct ElementWindow
+{
+    bool running { false };
+    int64_t start_us { 0 };
+    int32_t start_temp { 0 };
+};
+
+std::array<ProbeDiag, MCP9600_MAX_PROBES> probes;
+
+ElementWindow bake;
+ElementWindow broil;
+
+// Everything-off window for the stuck relay check.
+int64_t all_off_since_us { 0 };
+ElementWindow idle;
+
+uint32_t element_faults { 0 };
+uint32_t fault_count { 0 };
+
+const char *fault_name(uint32_t fault)
+{
+    switch (fault)
+    {
+    case DF_Probe_Open:   return "probe_open";
+    case DF_Probe_Short:  return "probe_short";
+    case DF_Bake_Failed:  return "bake_failed";
+    case DF_Broil_Failed: return "broil_failed";
+    case DF_Relay_Stuck:  return "relay_stuck";
+    }
+    return "";
+}
+
+// Post the change of one fault bit. argument is the probe, or the oven temperature in F.
+void set_fault(uint32_t &faults, uint32_t fault, bool active, int argument)
+{
+    if (active == bool(faults & fault))
+        return;
+
+    if (active)
+    {
+        faults |= fault;
+        fault_count++;
+        EV_post(SE_Fault, argument, fault_name(fault));
+    }
+    else
+    {
+        faults &= ~fault;
+        EV_post(SE_Recovered, argument, fault_name(fault));
+    }
+}
+
+int seconds(int64_t from_us, int64_t to_us)
+{
+    return (to_us - from_us) / 1000000;
+}
+
+void check_element(ElementWindow &w, const char *name, bool on, int32_t min_rise, uint32_t fault, const diag_inputs_t *in)
+{
+    const bool usable = on && in->oven_ok && !in->door_open && (in->oven_cF < element_check_below);
+    if (!usable)
+    {
+        w.running = false;
+        return;
+    }
+
+    if (!w.running)
+    {
+        w.running = true;
+        w.start_us = in->now_us;
+        w.start_temp = in->oven_cF;
+        return;
+    }
+
+    if (seconds(w.start_us, in->now_us) < element_window_s)
+        return;
+
+    const int32_t rise = in->oven_cF - w.start_temp;
+    if ((rise < min_rise) && !(element_faults & fault))
+        BINLOG_STR(BL_ELEMENT_FAILED, name, element_window_s, (int)rise);
+    set_fault(element_faults, fault, rise < min_rise, in->oven_cF / 100);
+
+    // Start over, a later window can clear it again.
+    w.running = false;
+}
+
+void check_relays(const diag_inputs_t *in)
+{
+    const bool any_on = in->bake_on || in->broil_on;
+    if (any_on || !in->oven_ok || in->door_open)
+    {
+        all_off_since_us = in->now_us;
+        idle.running = false;
+        return;
+    }
+
+    if (seconds(all_off_since_us, in->now_us) < settle_s)
+        return;
+
+    if (!idle.running)
+    {
+        idle.running = true;
+        idle.start_us = in->now_us;
+        idle.start_temp = in->oven_cF;
+        return;
+    }
+
+    if (seconds(idle.start_us, in->now_us) < stuck_window_s)
+        return;
+
+    const int32_t rise = in->oven_cF - idle.start_temp;
+    if ((rise > stuck_rise) && !(element_faults & DF_Relay_Stuck))
+        BINLOG(BL_RELAY_STUCK, (int)rise, stuck_window_s);
+    set_fault(element_faults, DF_Relay_Stuck, rise > stuck_rise, in->oven_cF / 100);
+
+    idle.running = false;
+}
+
+} // namespace
+
+void DG_probe_sample(int probe, uint16_t flags, int32_t raw16)
+{
+    if ((probe < 0) || (probe >= MCP9600_MAX_PROBES))
+        return;
+
+    ProbeDiag &p = probes[probe];
+
+    const bool open = (flags & (MCP9600_STATUS_INPUT_RANGE | MCP9600_FLAG_RAW_RANGE)) ||
+                      (raw16 < DG_RAW16_MIN) || (raw16 > DG_RAW16_MAX);
+    const bool shorted = flags & MCP9600_STATUS_SHORT;
+
+    p.open_count = open ? p.open_count + (p.open_count < DG_PROBE_TRIP) : 0;
+    p.short_count = shorted ? p.short_count + (p.short_count < DG_PROBE_TRIP) : 0;
+    p.good_count = (open || shorted) ? 0 : p.good_count + (p.good_count < DG_PROBE_CLEAR);
+
+    if (p.open_count >= DG_PROBE_TRIP)
+        set_fault(p.faults, DF_Probe_Open, true, probe);
+    if (p.short_count >= DG_PROBE_TRIP)
+        set_fault(p.faults, DF_Probe_Short, true, probe);
+
+    if (p.good_count >= DG_PROBE_CLEAR)
+    {
+        set_fault(p.faults, DF_Probe_Open, false, probe);
+        set_fault(p.faults, DF_Probe_Short, false, probe);
+    }
+}
+
+void DG_update(const diag_inputs_t *in)
+{
+    check_element(bake, "Bake", in->bake_on, bake_min_rise, DF_Bake_Failed, in);
+    check_element(broil, "Broil", in->broil_on, broil_min_rise, DF_Broil_Failed, in);
+    check_relays(in);
+}
+
+uint32_t DG_probe_faults(int probe)
+{
+    if ((probe < 0) || (probe >= MCP9600_MAX_PROBES))
+        return 0;
+    return probes[probe].faults;
+}
+
+uint32_t DG_element_faults()
+{
+    return element_faults;
+}
+
+uint32_t DG_fault_count()
+{
+    return fault_count;
+}
+
+void DG_fault_names(uint32_t mask, char *buf, int size)
+{
+    int len = 0;
+    buf[0] = 0;
+    for (uint32_t fault = 1; fault && (fault <= DF_Relay_Stuck); fault <<= 1)
+    {
+        if ((mask & fault) && (len < size))
+            len += snprintf(buf + len, size - len, "%s%s", len ? "," : "", fault_name(fault));
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Hardware diagnostics.
+ *
+ * Probe faults come from the MCP9600 status flags, raw ADC range and plausibility of
+ *   each reading. Element and relay faults come from comparing the oven's temperature
+ *   against what the relays were told to do: an element that has been on for minutes
+ *   must have warmed the oven, and with everything off the oven must not keep heating.
+ * Faults clear by themselves once the evidence goes away. Each change is posted as an
+ *   event; acting on them is left to the controller.
+ */
+
+enum DiagFault
+{
+    DF_Probe_Open    = 1 << 0,  // per probe
+    DF_Probe_Short   = 1 << 1,  // per probe
+    DF_Bake_Failed   = 1 << 2,  // on, but no heat
+    DF_Broil_Failed  = 1 << 3,
+    DF_Relay_Stuck   = 1 << 4,  // all off, but still heating
+};
+
+typedef struct
+{
+    int64_t now_us;
+    int32_t oven_cF;        // filtered
+    bool oven_ok;           // oven_cF is current
+    bool bake_on;           // as commanded
+    bool broil_on;
+    bool door_open;
+} diag_inputs_t;
+
+// Every fresh sample, flags and value as they come out of the sample ring.
+extern void DG_probe_sample(int probe, uint16_t flags, int32_t raw16);
+// Once per control tick.
+extern void DG_update(const diag_inputs_t *in);
+
+// Bitmask of DiagFault, probe faults only for the given probe.
+extern uint32_t DG_probe_faults(int probe);
+extern uint32_t DG_element_faults();
+extern uint32_t DG_fault_count();
+
+// Names of the faults in mask, "probe_open,bake_failed", for state.json.
+extern void DG_fault_names(uint32_t mask, char *buf, int size);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // DIAGNOSTICS_H
@@ -0,0 +1,104 @@
+#ifndef ELAPSEDTIMER_H
+#define ELAPSEDTIMER_H
+
+#include <mutex>
+#include <chrono>
+
+// Firmware builds run on the real clock, host builds on a clock the caller steps.
+#ifdef ESP_PLATFORM
+using cook_clock = std::chrono::steady_clock;
+#else
+#include "virtualclock.h"
+using cook_clock = VirtualClock;
+#endif
+
+// https://codereview.stackexchange.com/a/225927
+template <typename Clock>
+class BasicElapsedTimer
+{
+protected:
+    using clock = Clock;
+
+private:
+    typename clock::duration m_elapsedTime = {};
+    typename clock::time_point m_startTime = {};
+    static inline std::mutex timer_mutex;
+
+    bool isRun() const
+    {
+        return m_startTime != typename clock::time_point{};
+    }
+
+public:
+    bool isRunning() const
+    {
+        const std::lock_guard<std::mutex> lock(timer_mutex);
+        return isRun();
+    }
+
+    void start()
+    {
+        const std::lock_guard<std::mutex> lock(timer_mutex);
+        if (!isRun())
+        {
+            m_startTime = clock::now();
+        }
+    }
+
+    void pause()
+    {
+        const std::lock_guard<std::mutex> lock(timer_mutex);
+        if (isRun())
+        {
+            m_elapsedTime += clock::now() - m_startTime;
+            m_startTime = {};
+        }
+    }
+
+    void reset()
+    {
+        const std::lock_guard<std::mutex> lock(timer_mutex);
+        m_elapsedTime = typename clock::duration{};
+        m_startTime = {};
+    }
+
+    typename clock::duration elapsedTime() const
+    {
+        const std::lock_guard<std::mutex> lock(timer_mutex);
+        typename clock::duration result = m_elapsedTime;
+        if (isRun())
+        {
+            result += clock::now() - m_startTime;
+        }
+        return result;
+    }
+};
+
+template <typename Clock>
+class BasicTimer : public BasicElapsedTimer<Clock>
+{
+    using clock = Clock;
+
+    typename clock::duration m_interval = {};
+public:
+    explicit BasicTimer(typename clock::duration interval)
+        : m_interval(interval)
+    {
+
+    }
+
+    typename clock::duration duration() const
+    {
+        return m_interval;
+    }
+
+    bool timedout() const
+    {
+        return m_interval < this->elapsedTime();
+    }
+};
+
+using ElapsedTimer = BasicElapsedTimer<cook_clock>;
+using Timer = BasicTimer<cook_clock>;
+
+#endif // ELAPSEDTIMER_H
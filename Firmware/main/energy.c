@@ -0,0 +1,148 @@
+#include "energy.h"
+
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include <stdio.h>
+
+// As stored, grows only by appending.
+typedef struct
+{
+    uint64_t bake_ms;
+    uint64_t broil_ms;
+} stored_t;
+
+// Control task only.
+static energy_on_time_t session;
+static energy_on_time_t lifetime;
+static bool unsaved = false;
+static int64_t unsaved_since_us = 0;    // the oldest on time not yet saved
+static int64_t last_tick_us = 0;
+static int64_t carry_us = 0;            // under a ms, not yet added
+
+// Handed to the writer.
+static portMUX_TYPE save_mux = portMUX_INITIALIZER_UNLOCKED;
+static stored_t to_save;
+static TaskHandle_t writer = NULL;
+
+static void energy_task(void *arg)
+{
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        portENTER_CRITICAL(&save_mux);
+        const stored_t stored = to_save;
+        portEXIT_CRITICAL(&save_mux);
+
+        nvs_handle_t nvs;
+        esp_err_t err = nvs_open("energy", NVS_READWRITE, &nvs);
+        if (ESP_OK == err)
+        {
+            err = nvs_set_blob(nvs, "lifetime", &stored, sizeof(stored));
+            if (ESP_OK == err)
+                err = nvs_commit(nvs);
+            nvs_close(nvs);
+        }
+        if (ESP_OK != err)
+            printf("Saving energy totals failed, %d\n", err);
+    }
+}
+
+static void save()
+{
+    if (!unsaved)
+        return;
+
+    portENTER_CRITICAL(&save_mux);
+    to_save.bake_ms = lifetime.bake_ms;
+    to_save.broil_ms = lifetime.broil_ms;
+    portEXIT_CRITICAL(&save_mux);
+
+    unsaved = false;
+    if (writer)
+        xTaskNotifyGive(writer);
+}
+
+void energy_init()
+{
+    nvs_handle_t nvs;
+    if (ESP_OK == nvs_open("energy", NVS_READONLY, &nvs))
+    {
+        stored_t stored;
+        size_t len = sizeof(stored);
+        if ((ESP_OK == nvs_get_blob(nvs, "lifetime", &stored, &len)) && (len == sizeof(stored)))
+        {
+            lifetime.bake_ms = stored.bake_ms;
+            lifetime.broil_ms = stored.broil_ms;
+        }
+        nvs_close(nvs);
+    }
+
+    printf("Elements on %llus bake, %llus broil\n",
+           (unsigned long long)(lifetime.bake_ms / 1000), (unsigned long long)(lifetime.broil_ms / 1000));
+
+    xTaskCreate(energy_task, "energy", 2048, NULL, tskIDLE_PRIORITY+1, &writer);
+}
+
+void energy_tick(bool bake, bool broil, int64_t now_us, uint32_t tick_ms)
+{
+    int64_t elapsed_us = last_tick_us ? now_us - last_tick_us : 0;
+    last_tick_us = now_us;
+
+    if (elapsed_us < 0)
+        elapsed_us = 0;
+    if (elapsed_us > 2 * tick_ms * 1000LL)
+        elapsed_us = 2 * tick_ms * 1000LL;
+
+    if (!bake && !broil)
+    {
+        carry_us = 0;
+        return;
+    }
+
+    elapsed_us += carry_us;
+    const uint32_t ms = elapsed_us / 1000;
+    carry_us = elapsed_us % 1000;
+
+    if (bake)
+    {
+        session.bake_ms += ms;
+        lifetime.bake_ms += ms;
+    }
+    if (broil)
+    {
+        session.broil_ms += ms;
+        lifetime.broil_ms += ms;
+    }
+
+    if (!unsaved)
+    {
+        unsaved = true;
+        unsaved_since_us = now_us;
+    }
+    else if (now_us - unsaved_since_us >= ENERGY_SAVE_S * 1000000LL)
+        save();
+}
+
+void energy_session_start()
+{
+    session.bake_ms = 0;
+    session.broil_ms = 0;
+}
+
+void energy_session_end()
+{
+    save();
+}
+
+energy_on_time_t energy_session()
+{
+    return session;
+}
+
+energy_on_time_t energy_lifetime()
+{
+    return lifetime;
+}
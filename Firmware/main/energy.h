@@ -0,0 +1,49 @@
+#ifndef ENERGY_H
+#define ENERGY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* How long each element has been on, for what the oven costs to run.
+ *
+ * Every tick the control task adds the time since the tick before, as measured, to each
+ *   relay pair that was on over it. A late tick counts for what it was, up to two ticks,
+ *   so a stall or a clock step can't book minutes of heat. On time is kept for the
+ *   current cook, which stays until the next one starts, and for the life of the oven;
+ *   StoveCtrl turns it into energy with the element ratings.
+ * The lifetime totals are kept in NVS. To spare its flash they are written when a cook
+ *   ends, and while heating at most every ENERGY_SAVE_S, so a power cut loses no more
+ *   than that. A low priority task does the writing, the control loop never waits on
+ *   the flash.
+ */
+
+#define ENERGY_SAVE_S   900
+
+typedef struct
+{
+    uint64_t bake_ms;       // relays on
+    uint64_t broil_ms;
+} energy_on_time_t;
+
+// Loads the lifetime totals, after NVS is up and before the control task starts.
+extern void energy_init();
+
+// From the control task.
+// now_us is the tick's esp_timer_get_time(), tick_ms the nominal period.
+extern void energy_tick(bool bake, bool broil, int64_t now_us, uint32_t tick_ms);
+extern void energy_session_start();
+extern void energy_session_end();
+
+// The control task's view, from it or under its lock.
+extern energy_on_time_t energy_session();
+extern energy_on_time_t energy_lifetime();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ENERGY_H
@@ -0,0 +1,287 @@
+#include "events.h"
+#include "cook_log.h"
+#include "mcp9600.h"
+#include "binlog.h"
+
+#include "esp_timer.h"
+
+#include <array>
+#include <mutex>
+#include <string>
+#include <cstring>
+
+/* Events are kept in a small ring so a client that drops off (phone locked, WiFi blip)
+ *   can reconnect with the last sequence number it saw and get everything it missed.
+ * Each client has its own cursor into the ring; delivery runs on the httpd task
+ *   through httpd_queue_work() so posting never blocks the control loop on a socket.
+ * The live chart's points go the same way, but only the newest is kept: a client that
+ *   is behind gets one point and fills the gap from /history itself.
+ */
+
+#define EVENT_BUFFER_SIZE 32
+#define MAX_EVENT_CLIENTS 4
+
+struct Event
+{
+    uint32_t seq;
+    StoveEvent event;
+    int argument;
+    int64_t time_ms;
+    char detail[24];
+};
+
+struct EventClient
+{
+    int fd { -1 };
+    uint32_t next_seq { 0 }; // next sequence number this client has not yet received
+    uint32_t point_seq { 0 }; // history seq of the last point sent, + 1
+};
+
+static std::array<Event, EVENT_BUFFER_SIZE> events;
+static std::array<EventClient, MAX_EVENT_CLIENTS> clients;
+static uint32_t next_seq = 1;
+static history_record_t point;
+static bool have_point = false;
+static httpd_handle_t server = nullptr;
+static std::mutex events_mutex;
+
+static const char *to_string(StoveEvent e)
+{
+    switch (e)
+    {
+    case SE_Timer_Fired:    return "timer_fired";
+    case SE_Target_Reached: return "target_reached";
+    case SE_Fault:          return "fault";
+    case SE_Recovered:      return "recovered";
+    }
+    return "";
+}
+
+const char *EV_name(StoveEvent event)
+{
+    return to_string(event);
+}
+
+static uint32_t oldest_seq()
+{
+    return (next_seq > EVENT_BUFFER_SIZE) ? next_seq - EVENT_BUFFER_SIZE : 1;
+}
+
+static std::string toJSON(const Event &e)
+{
+    return "{\"seq\":"      + std::to_string(e.seq) +
+           ",\"type\":\""   + to_string(e.event) + "\""
+           ",\"argument\":" + std::to_string(e.argument) +
+           ",\"detail\":\"" + e.detail + "\""
+           ",\"time\":"     + std::to_string(e.time_ms) + "}";
+}
+
+static std::string centi(int32_t v)
+{
+    const uint32_t mag = (v < 0) ? -(uint32_t)v : v;
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%s%lu.%02lu", (v < 0) ? "-" : "",
+             (unsigned long)(mag / 100), (unsigned long)(mag % 100));
+    return buf;
+}
+
+// As in /history: [seq, time, temp, target, bake %, broil %, outputs, {probe: temp}]
+static std::string toJSON(const history_record_t &r)
+{
+    char probes[HISTORY_PROBES * (MCP9600_NAME_LEN + 16) + 4];
+    history_print_probes(probes, sizeof(probes), &r);
+
+    return "{\"type\":\"point\",\"point\":["
+           + std::to_string(r.seq) + ","
+           + std::to_string(r.time) + ","
+           + centi(r.temp_cF) + ","
+           + centi(r.target_cF) + ","
+           + std::to_string(r.bake_duty) + ","
+           + std::to_string(r.broil_duty) + ","
+           + std::to_string(r.outputs) + ","
+           + probes + "]}";
+}
+
+static bool send_text(int fd, const std::string &text)
+{
+    httpd_ws_frame_t frame = {};
+    frame.final = true;
+    frame.type = HTTPD_WS_TYPE_TEXT;
+    frame.payload = (uint8_t *)text.c_str();
+    frame.len = text.size();
+
+    return ESP_OK == httpd_ws_send_frame_async(server, fd, &frame);
+}
+
+// Runs on the httpd task, as does subscribe(), so only the posting side races with it.
+// The lock is held just to copy out what each client is owed and move its cursors on:
+//   EV_post() is called by the control task, which must never wait on a slow socket.
+static void deliver(void *)
+{
+    struct Pending
+    {
+        int fd;
+        uint32_t from, to; // events [from, to) to send
+        bool lost;
+        bool point;
+    };
+
+    // Only this task reads the copy, and it is too big for the httpd stack.
+    static std::array<Event, EVENT_BUFFER_SIZE> sending;
+    std::array<Pending, MAX_EVENT_CLIENTS> pending;
+    history_record_t sending_point;
+    uint32_t lost_seq;
+
+    {
+        const std::lock_guard<std::mutex> lock(events_mutex);
+
+        sending = events;
+        sending_point = point;
+        lost_seq = oldest_seq() - 1;
+
+        for (size_t i = 0; i < clients.size(); i++)
+        {
+            EventClient &client = clients[i];
+            Pending &p = pending[i];
+
+            p.fd = client.fd;
+            if (p.fd < 0)
+                continue;
+
+            // The client was away longer than the ring covers; tell it to resync.
+            p.lost = client.next_seq < oldest_seq();
+            p.from = p.lost ? oldest_seq() : client.next_seq;
+            p.to = next_seq;
+            p.point = have_point && (client.point_seq != point.seq + 1);
+
+            client.next_seq = next_seq;
+            if (p.point)
+                client.point_seq = point.seq + 1;
+        }
+    }
+
+    for (Pending &p : pending)
+    {
+        if (p.fd < 0)
+            continue;
+
+        bool ok = (httpd_ws_get_fd_info(server, p.fd) == HTTPD_WS_CLIENT_WEBSOCKET);
+
+        if (ok && p.lost)
+            send_text(p.fd, "{\"seq\":" + std::to_string(lost_seq) + ",\"type\":\"lost\"}");
+
+        for (uint32_t seq = p.from; ok && (seq < p.to); seq++)
+            ok = send_text(p.fd, toJSON(sending[seq % EVENT_BUFFER_SIZE]));
+
+        if (ok && p.point)
+            ok = send_text(p.fd, toJSON(sending_point));
+
+        if (ok)
+            continue;
+
+        // Gone; subscribe() cannot have reused the slot meanwhile, it runs on this task.
+        const std::lock_guard<std::mutex> lock(events_mutex);
+        for (auto &client : clients)
+        {
+            if (client.fd == p.fd)
+                client.fd = -1;
+        }
+    }
+}
+
+void EV_post(StoveEvent event, int argument, const char *detail)
+{
+    {
+        const std::lock_guard<std::mutex> lock(events_mutex);
+
+        Event &e = events[next_seq % EVENT_BUFFER_SIZE];
+        e.seq = next_seq++;
+        e.event = event;
+        e.argument = argument;
+        e.time_ms = esp_timer_get_time() / 1000;
+        snprintf(e.detail, sizeof(e.detail), "%s", detail ? detail : "");
+    }
+
+    BINLOG_STR(BL_EVENT, detail, (int)event, argument);
+    cook_log_event(event, argument, detail);
+
+    if (server)
+        httpd_queue_work(server, deliver, nullptr);
+}
+
+void EV_history_point(const history_record_t *record)
+{
+    {
+        const std::lock_guard<std::mutex> lock(events_mutex);
+        point = *record;
+        have_point = true;
+    }
+
+    if (server)
+        httpd_queue_work(server, deliver, nullptr);
+}
+
+static void subscribe(httpd_req_t *req)
+{
+    uint32_t since = 0;
+    char query[32];
+    char value[12];
+    if ((ESP_OK == httpd_req_get_url_query_str(req, query, sizeof(query))) &&
+        (ESP_OK == httpd_query_key_value(query, "since", value, sizeof(value))))
+    {
+        since = strtoul(value, nullptr, 10);
+    }
+
+    const int fd = httpd_req_to_sockfd(req);
+
+    const std::lock_guard<std::mutex> lock(events_mutex);
+    server = req->handle;
+
+    EventClient *slot = nullptr;
+    for (auto &client : clients)
+    {
+        if ((client.fd == fd) || (!slot && (client.fd < 0)))
+            slot = &client;
+    }
+
+    if (!slot)
+    {
+        BINLOG(BL_TOO_MANY_EVENT_CLIENTS);
+        return;
+    }
+
+    slot->fd = fd;
+    slot->point_seq = 0;
+
+    // A fresh client (since=0) only wants new events.
+    slot->next_seq = since ? since + 1 : next_seq;
+
+    // The device rebooted since the client last saw it, replay everything we have.
+    if (slot->next_seq > next_seq)
+        slot->next_seq = 0;
+}
+
+esp_err_t events_ws(httpd_req_t *req)
+{
+    if (req->method == HTTP_GET)
+    {
+        // Websocket handshake done.
+        subscribe(req);
+        httpd_queue_work(req->handle, deliver, nullptr);
+        return ESP_OK;
+    }
+
+    // Clients do not send us anything we act on, but the frame must be drained.
+    uint8_t buf[32];
+    httpd_ws_frame_t frame = {};
+
+    const esp_err_t err = httpd_ws_recv_frame(req, &frame, 0);
+    if ((err != ESP_OK) || (frame.len == 0))
+        return err;
+
+    if (frame.len > sizeof(buf))
+        return ESP_FAIL;
+
+    frame.payload = buf;
+    return httpd_ws_recv_frame(req, &frame, frame.len);
+}
@@ -0,0 +1,35 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include "history.h"
+#include "esp_http_server.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum StoveEvent
+{
+    SE_Timer_Fired,
+    SE_Target_Reached,
+    SE_Fault,
+    SE_Recovered
+};
+
+// Queue an event for every connected client. Safe to call from any task.
+extern void EV_post(enum StoveEvent event, int argument, const char *detail);
+
+extern const char *EV_name(enum StoveEvent event);
+
+// The newest 1s history record, pushed to every client as a "point" message. Points are
+//   not numbered with the events, a client that misses some fetches them from /history.
+extern void EV_history_point(const history_record_t *record);
+
+// Websocket endpoint. Connect with "?since=<seq>" to replay everything after <seq>.
+extern esp_err_t events_ws(httpd_req_t *req);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // EVENTS_H
@@ -0,0 +1,527 @@
+#include "history.h"
+#include "events.h"
+#include "mcp9600.h"
+
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "sdkconfig.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Ring sizes.
+ * With PSRAM (sdkconfig.wrover) ~2.5 bytes a record puts these at about 40h, 5 days
+ *   and 3 weeks.
+ * The WROOM boards have none, so 32K of internal RAM has to do. The rolled up levels
+ *   cost more like 4 bytes a record as their averages rarely repeat, which still gives
+ *   about 1.5h of seconds, 5h at 10s and 1.5 days of minutes.
+ */
+#if CONFIG_SPIRAM
+#define LEVEL_BYTES_1S      (384 * 1024)
+#define LEVEL_BYTES_10S     (128 * 1024)
+#define LEVEL_BYTES_1MIN    (64 * 1024)
+#define LEVEL_CAPS          MALLOC_CAP_SPIRAM
+#else
+#define LEVEL_BYTES_1S      (16 * 1024)
+#define LEVEL_BYTES_10S     (8 * 1024)
+#define LEVEL_BYTES_1MIN    (8 * 1024)
+#define LEVEL_CAPS          (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)
+#endif
+#define FALLBACK_BLOCKS     4
+
+/* Record encoding.
+ * A header byte says which fields follow. Time, temperature and target are zigzag
+ *   varints, the rest single bytes. The first record of a block has every field and
+ *   holds values, all later ones hold differences from the record before, with time
+ *   relative to where the level's period says it should be.
+ * The probes are a mask byte and then a varint for each probe in it, a difference when
+ *   the record before had that probe too.
+ */
+#define F_TIME          (1 << 0)
+#define F_TEMP          (1 << 1)
+#define F_TARGET        (1 << 2)
+#define F_BAKE          (1 << 3)
+#define F_BROIL         (1 << 4)
+#define F_OUTPUTS       (1 << 5)
+#define F_PROBES        (1 << 6)
+#define F_ALL           0x7F
+#define RECORD_MAX      (1 + 3 * 5 + 3 + 1 + HISTORY_PROBES * 5)
+
+typedef struct
+{
+    uint32_t period_s;
+    uint32_t rollup;            // records from the level below per record here
+    uint32_t bytes;
+
+    history_block_t *blocks;
+    uint32_t block_count;
+    uint32_t head;              // blocks ever started, the last one is being filled
+    uint32_t next_seq;
+
+    // Only touched by the writer.
+    history_record_t last;
+    uint32_t n;
+    int32_t temp_sum;
+    uint32_t bake_sum;
+    uint32_t broil_sum;
+    int32_t probe_sum[HISTORY_PROBES];
+    uint8_t probe_n[HISTORY_PROBES];
+} level_t;
+
+static level_t levels[HISTORY_LEVELS] = {
+    { .period_s = 1,  .rollup = 1,  .bytes = LEVEL_BYTES_1S },
+    { .period_s = 10, .rollup = 10, .bytes = LEVEL_BYTES_10S },
+    { .period_s = 60, .rollup = 6,  .bytes = LEVEL_BYTES_1MIN },
+};
+
+static portMUX_TYPE history_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static uint8_t *put_varint(uint8_t *p, uint32_t v)
+{
+    while (v >= 0x80)
+    {
+        *p++ = v | 0x80;
+        v >>= 7;
+    }
+    *p++ = v;
+    return p;
+}
+
+static const uint8_t *get_varint(const uint8_t *p, uint32_t *v)
+{
+    *v = 0;
+    for (int shift = 0; shift < 35; shift += 7)
+    {
+        *v |= (uint32_t)(*p & 0x7F) << shift;
+        if (!(*p++ & 0x80))
+            break;
+    }
+    return p;
+}
+
+static uint32_t zigzag(int32_t v)
+{
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static int32_t unzigzag(uint32_t v)
+{
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+static bool same_probes(const history_record_t *a, const history_record_t *b)
+{
+    if (a->probes != b->probes)
+        return false;
+
+    for (int i = 0; i < HISTORY_PROBES; i++)
+    {
+        if ((a->probes & (1 << i)) && (a->probe_cF[i] != b->probe_cF[i]))
+            return false;
+    }
+    return true;
+}
+
+// prev is NULL for the first record of a block.
+static int encode(const history_record_t *r, const history_record_t *prev, uint32_t period_s, uint8_t *buf)
+{
+    uint8_t flags = F_ALL;
+    if (prev)
+    {
+        flags = 0;
+        if (r->time != prev->time + period_s) flags |= F_TIME;
+        if (r->temp_cF != prev->temp_cF)      flags |= F_TEMP;
+        if (r->target_cF != prev->target_cF)  flags |= F_TARGET;
+        if (r->bake_duty != prev->bake_duty)  flags |= F_BAKE;
+        if (r->broil_duty != prev->broil_duty) flags |= F_BROIL;
+        if (r->outputs != prev->outputs)      flags |= F_OUTPUTS;
+        if (!same_probes(r, prev))            flags |= F_PROBES;
+    }
+
+    uint8_t *p = buf;
+    *p++ = flags;
+    if (flags & F_TIME)
+        p = put_varint(p, prev ? zigzag(r->time - prev->time - period_s) : r->time);
+    if (flags & F_TEMP)
+        p = put_varint(p, zigzag(prev ? r->temp_cF - prev->temp_cF : r->temp_cF));
+    if (flags & F_TARGET)
+        p = put_varint(p, zigzag(prev ? r->target_cF - prev->target_cF : r->target_cF));
+    if (flags & F_BAKE)
+        *p++ = r->bake_duty;
+    if (flags & F_BROIL)
+        *p++ = r->broil_duty;
+    if (flags & F_OUTPUTS)
+        *p++ = r->outputs;
+    if (flags & F_PROBES)
+    {
+        *p++ = r->probes;
+        for (int i = 0; i < HISTORY_PROBES; i++)
+        {
+            if (!(r->probes & (1 << i)))
+                continue;
+            const bool delta = prev && (prev->probes & (1 << i));
+            p = put_varint(p, zigzag(delta ? r->probe_cF[i] - prev->probe_cF[i] : r->probe_cF[i]));
+        }
+    }
+
+    return p - buf;
+}
+
+static const uint8_t *decode(const uint8_t *p, history_record_t *r, const history_record_t *prev, uint32_t period_s)
+{
+    const uint8_t flags = *p++;
+    uint32_t v;
+
+    if (prev)
+    {
+        *r = *prev;
+        r->time += period_s;
+    }
+
+    if (flags & F_TIME)
+    {
+        p = get_varint(p, &v);
+        r->time = prev ? r->time + unzigzag(v) : v;
+    }
+    if (flags & F_TEMP)
+    {
+        p = get_varint(p, &v);
+        r->temp_cF = (prev ? r->temp_cF : 0) + unzigzag(v);
+    }
+    if (flags & F_TARGET)
+    {
+        p = get_varint(p, &v);
+        r->target_cF = (prev ? r->target_cF : 0) + unzigzag(v);
+    }
+    if (flags & F_BAKE)
+        r->bake_duty = *p++;
+    if (flags & F_BROIL)
+        r->broil_duty = *p++;
+    if (flags & F_OUTPUTS)
+        r->outputs = *p++;
+    if (flags & F_PROBES)
+    {
+        const uint8_t had = prev ? prev->probes : 0;
+        r->probes = *p++;
+        for (int i = 0; i < HISTORY_PROBES; i++)
+        {
+            if (!(r->probes & (1 << i)))
+            {
+                r->probe_cF[i] = 0;
+                continue;
+            }
+            p = get_varint(p, &v);
+            r->probe_cF[i] = ((had & (1 << i)) ? r->probe_cF[i] : 0) + unzigzag(v);
+        }
+    }
+
+    return p;
+}
+
+void history_init()
+{
+    for (int i = 0; i < HISTORY_LEVELS; i++)
+    {
+        level_t *l = &levels[i];
+        l->next_seq = 1;
+        l->block_count = l->bytes / sizeof(history_block_t);
+        l->blocks = heap_caps_malloc(l->block_count * sizeof(history_block_t), LEVEL_CAPS);
+
+        if (!l->blocks)
+        {
+            l->block_count = FALLBACK_BLOCKS;
+            l->blocks = malloc(l->block_count * sizeof(history_block_t));
+        }
+
+        if (!l->blocks)
+            l->block_count = 0;
+    }
+
+    printf("History: %lu/%lu/%lu blocks of %i bytes\n",
+           (unsigned long)levels[HISTORY_1S].block_count,
+           (unsigned long)levels[HISTORY_10S].block_count,
+           (unsigned long)levels[HISTORY_1MIN].block_count,
+           (int)sizeof(history_block_t));
+}
+
+// Numbers the record and adds it to the level.
+static void append(level_t *l, history_record_t *r)
+{
+    r->seq = l->next_seq;
+
+    // Encoded both ways up front, only the copy into the block is done locked.
+    uint8_t delta[RECORD_MAX];
+    uint8_t whole[RECORD_MAX];
+    const int delta_len = l->head ? encode(r, &l->last, l->period_s, delta) : 0;
+    const int whole_len = encode(r, NULL, l->period_s, whole);
+
+    portENTER_CRITICAL(&history_mux);
+    history_block_t *b = &l->blocks[(l->head + l->block_count - 1) % l->block_count];
+    const uint8_t *data = delta;
+    int len = delta_len;
+
+    if (!l->head || (b->used + delta_len > sizeof(b->data)))
+    {
+        b = &l->blocks[l->head % l->block_count];
+        b->first_seq = r->seq;
+        b->count = 0;
+        b->used = 0;
+        l->head++;
+        data = whole;
+        len = whole_len;
+    }
+
+    memcpy(b->data + b->used, data, len);
+    b->used += len;
+    b->count++;
+    l->next_seq++;
+    portEXIT_CRITICAL(&history_mux);
+
+    l->last = *r;
+}
+
+void history_push(const history_record_t *record)
+{
+    history_record_t r = *record;
+
+    for (int i = 0; i < HISTORY_LEVELS; i++)
+    {
+        level_t *l = &levels[i];
+        if (!l->block_count)
+            return;
+
+        append(l, &r);
+
+        if (i == HISTORY_1S)
+            EV_history_point(&r);
+
+        if (i + 1 == HISTORY_LEVELS)
+            break;
+
+        level_t *up = &levels[i + 1];
+        up->temp_sum += r.temp_cF;
+        up->bake_sum += r.bake_duty;
+        up->broil_sum += r.broil_duty;
+        for (int p = 0; p < HISTORY_PROBES; p++)
+        {
+            if (r.probes & (1 << p))
+            {
+                up->probe_sum[p] += r.probe_cF[p];
+                up->probe_n[p]++;
+            }
+        }
+        if (++up->n < up->rollup)
+            break;
+
+        // Time, target and outputs as of the last record of the period. A probe is
+        //   averaged over the records that had it.
+        r.temp_cF = up->temp_sum / (int32_t)up->n;
+        r.bake_duty = up->bake_sum / up->n;
+        r.broil_duty = up->broil_sum / up->n;
+        r.probes = 0;
+        for (int p = 0; p < HISTORY_PROBES; p++)
+        {
+            r.probe_cF[p] = up->probe_n[p] ? up->probe_sum[p] / (int32_t)up->probe_n[p] : 0;
+            if (up->probe_n[p])
+                r.probes |= 1 << p;
+        }
+
+        up->n = 0;
+        up->temp_sum = 0;
+        up->bake_sum = 0;
+        up->broil_sum = 0;
+        memset(up->probe_sum, 0, sizeof(up->probe_sum));
+        memset(up->probe_n, 0, sizeof(up->probe_n));
+    }
+}
+
+uint32_t history_first(history_level_t level)
+{
+    const level_t *l = &levels[level];
+
+    portENTER_CRITICAL(&history_mux);
+    uint32_t first = l->next_seq;
+    if (l->head)
+    {
+        const uint32_t oldest = (l->head > l->block_count) ? l->head - l->block_count : 0;
+        first = l->blocks[oldest % l->block_count].first_seq;
+    }
+    portEXIT_CRITICAL(&history_mux);
+
+    return first;
+}
+
+uint32_t history_next_seq(history_level_t level)
+{
+    return __atomic_load_n(&levels[level].next_seq, __ATOMIC_RELAXED);
+}
+
+void history_open(history_reader_t *r, history_level_t level, uint32_t since)
+{
+    memset(r, 0, sizeof(*r));
+    r->level = level;
+    r->since = since;
+}
+
+// Copy the block holding the record after r->since, or the oldest block if that's gone.
+static bool load(history_reader_t *r)
+{
+    const level_t *l = &levels[r->level];
+    const uint32_t want = r->since + 1;
+
+    portENTER_CRITICAL(&history_mux);
+    const bool any = (l->head != 0) && (want < l->next_seq);
+    if (any)
+    {
+        uint32_t lo = (l->head > l->block_count) ? l->head - l->block_count : 0;
+        uint32_t hi = l->head - 1;
+        while (lo < hi)
+        {
+            const uint32_t mid = lo + (hi - lo + 1) / 2;
+            if (l->blocks[mid % l->block_count].first_seq <= want)
+                lo = mid;
+            else
+                hi = mid - 1;
+        }
+
+        r->block = lo;
+        memcpy(&r->copy, &l->blocks[lo % l->block_count], sizeof(r->copy));
+    }
+    portEXIT_CRITICAL(&history_mux);
+
+    r->loaded = any;
+    r->index = 0;
+    r->offset = 0;
+    return any;
+}
+
+bool history_read(history_reader_t *r, history_record_t *out)
+{
+    const uint32_t period_s = levels[r->level].period_s;
+
+    while (1)
+    {
+        if (!r->loaded && !load(r))
+            return false;
+
+        if (r->index >= r->copy.count)
+        {
+            // Either the next block or more records in this one, load() sorts it out.
+            r->loaded = false;
+            continue;
+        }
+
+        history_record_t rec;
+        const uint8_t *p = decode(r->copy.data + r->offset, &rec, r->index ? &r->prev : NULL, period_s);
+        rec.seq = r->copy.first_seq + r->index;
+        r->offset = p - r->copy.data;
+        r->index++;
+        r->prev = rec;
+
+        if (rec.seq <= r->since)
+            continue;
+
+        r->since = rec.seq;
+        *out = rec;
+        return true;
+    }
+}
+
+// Fixed point centi-units as a JSON number.
+static int print_centi(char *buf, int size, int32_t centi)
+{
+    const uint32_t mag = (centi < 0) ? -(uint32_t)centi : centi;
+    return snprintf(buf, size, "%s%lu.%02lu", (centi < 0) ? "-" : "",
+                    (unsigned long)(mag / 100), (unsigned long)(mag % 100));
+}
+
+int history_print_probes(char *buf, int size, const history_record_t *record)
+{
+    int len = snprintf(buf, size, "{");
+    for (int i = 0; (i < HISTORY_PROBES) && (len < size); i++)
+    {
+        if (!(record->probes & (1 << i)))
+            continue;
+
+        // A probe unplugged since has lost its name.
+        const char *name = mcp9600_name(i);
+        if (*name)
+            len += snprintf(buf + len, size - len, "%s\"%s\":", (len > 1) ? "," : "", name);
+        else
+            len += snprintf(buf + len, size - len, "%s\"probe%i\":", (len > 1) ? "," : "", i);
+
+        if (len < size)
+            len += print_centi(buf + len, size - len, record->probe_cF[i]);
+    }
+    if (len < size)
+        len += snprintf(buf + len, size - len, "}");
+    return len;
+}
+
+esp_err_t get_history(httpd_req_t *req)
+{
+    uint32_t since = 0;
+    uint32_t max = 3600;
+    history_level_t level = HISTORY_1S;
+
+    char query[64];
+    char value[12];
+    if (ESP_OK == httpd_req_get_url_query_str(req, query, sizeof(query)))
+    {
+        if (ESP_OK == httpd_query_key_value(query, "since", value, sizeof(value)))
+            since = strtoul(value, NULL, 10);
+        if (ESP_OK == httpd_query_key_value(query, "max", value, sizeof(value)))
+            max = strtoul(value, NULL, 10);
+        if (ESP_OK == httpd_query_key_value(query, "res", value, sizeof(value)))
+        {
+            const int res = atoi(value);
+            level = (res >= 60) ? HISTORY_1MIN : (res >= 10) ? HISTORY_10S : HISTORY_1S;
+        }
+    }
+
+    // Nobody could have seen more than we've numbered, so the device has rebooted.
+    if (since >= history_next_seq(level))
+        since = 0;
+
+    static history_reader_t reader; // only ever used from the httpd task
+    history_open(&reader, level, since);
+
+    httpd_resp_set_type(req, "application/json");
+
+    char buf[1024];
+    int len = snprintf(buf, sizeof(buf), "{\"res\":%lu,\"first\":%lu,\"points\":[",
+                       (unsigned long)levels[level].period_s, (unsigned long)history_first(level));
+
+    // [seq, time, temp, target, bake %, broil %, outputs, {probe: temp}]
+    history_record_t rec;
+    uint32_t count = 0;
+    while ((count < max) && history_read(&reader, &rec))
+    {
+        if (len > (int)sizeof(buf) - 96 - HISTORY_PROBES * (MCP9600_NAME_LEN + 16))
+        {
+            if (ESP_OK != httpd_resp_send_chunk(req, buf, len))
+                return ESP_FAIL;
+            len = 0;
+        }
+
+        len += snprintf(buf + len, sizeof(buf) - len, "%s[%lu,%lu,", count ? "," : "",
+                        (unsigned long)rec.seq, (unsigned long)rec.time);
+        len += print_centi(buf + len, sizeof(buf) - len, rec.temp_cF);
+        buf[len++] = ',';
+        len += print_centi(buf + len, sizeof(buf) - len, rec.target_cF);
+        len += snprintf(buf + len, sizeof(buf) - len, ",%u,%u,%u,",
+                        rec.bake_duty, rec.broil_duty, rec.outputs);
+        len += history_print_probes(buf + len, sizeof(buf) - len, &rec);
+        buf[len++] = ']';
+        count++;
+    }
+
+    len += snprintf(buf + len, sizeof(buf) - len, "],\"last\":%lu,\"next\":%lu,\"more\":%s}",
+                    (unsigned long)reader.since, (unsigned long)history_next_seq(level),
+                    (reader.since + 1 < history_next_seq(level)) ? "true" : "false");
+
+    if (ESP_OK != httpd_resp_send_chunk(req, buf, len))
+        return ESP_FAIL;
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
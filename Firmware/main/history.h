@@ -0,0 +1,107 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_http_server.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Time series of the oven's state, kept in RAM.
+ *
+ * The controller pushes one record a second. It is kept at three resolutions,
+ *   1s, 10s and 1min, each rolled up from the one below: temperatures and duty
+ *   averaged, everything else as it was at the end of the period.
+ * Each level is a ring of fixed size blocks. A block starts with a whole record and
+ *   after that each record only holds what changed since the one before, as zigzag
+ *   varint deltas. A typical second costs 2-3 bytes, and about one more for each food
+ *   probe fitted. Whole blocks are dropped when the ring wraps; history.c has how long
+ *   each level lasts.
+ * Records are numbered per level, clients ask for everything after the last one they
+ *   have.
+ */
+
+typedef enum
+{
+    HISTORY_1S,
+    HISTORY_10S,
+    HISTORY_1MIN,
+    HISTORY_LEVELS
+} history_level_t;
+
+// history_record_t.outputs
+#define HISTORY_CONVECTION(o)   ((o) & 0x3)         // FanSpeed
+#define HISTORY_DOWNDRAFT(o)    (((o) >> 2) & 0x3)  // FanSpeed
+#define HISTORY_COOLING_FAN     (1 << 4)
+#define HISTORY_LIGHT           (1 << 5)
+
+// The food probes, by MCP9600 probe number. The oven probe is temp_cF.
+#define HISTORY_PROBES          8                   // MCP9600_MAX_PROBES
+
+typedef struct
+{
+    uint32_t seq;           // assigned by history_push()
+    uint32_t time;          // unix seconds at the end of the period
+    int32_t temp_cF;
+    int32_t target_cF;
+    uint8_t bake_duty;      // percent of the period the relays were on
+    uint8_t broil_duty;
+    uint8_t outputs;
+    uint8_t probes;         // bit n set when probe n had a reading, never the oven's
+    int32_t probe_cF[HISTORY_PROBES];
+} history_record_t;
+
+// Allocate the rings, in PSRAM on boards built with it. A few minutes' worth if
+//   even that fails.
+extern void history_init();
+
+// A finished second, from the control task.
+extern void history_push(const history_record_t *record);
+
+#define HISTORY_BLOCK_SIZE 256
+
+typedef struct
+{
+    uint32_t first_seq;     // of the whole record at the start
+    uint16_t count;         // records
+    uint16_t used;          // bytes of data
+    uint8_t data[HISTORY_BLOCK_SIZE - 8];
+} history_block_t;
+
+// Decodes one level a block at a time, from a private copy of the block.
+typedef struct
+{
+    history_level_t level;
+    uint32_t since;         // last record handed out
+    uint32_t block;         // number of the block in copy, counting every block ever started
+    bool loaded;
+    uint16_t index;         // next record in the copy
+    uint16_t offset;
+    history_record_t prev;
+    history_block_t copy;
+} history_reader_t;
+
+// Start reading at the record after since, or the oldest one still held.
+extern void history_open(history_reader_t *r, history_level_t level, uint32_t since);
+// Returns false when caught up. Records dropped while reading are skipped.
+extern bool history_read(history_reader_t *r, history_record_t *out);
+
+// Oldest record still held at the level, and the number the next one will get.
+extern uint32_t history_first(history_level_t level);
+extern uint32_t history_next_seq(history_level_t level);
+
+// The record's probes as a JSON object of name: temperature, {} if it has none.
+extern int history_print_probes(char *buf, int size, const history_record_t *record);
+
+// GET /history?since=<seq>&res=<1|10|60>&max=<n>
+// "next" in the reply is the seq the next record will get, max=0 asks for only that.
+extern esp_err_t get_history(httpd_req_t *req);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HISTORY_H
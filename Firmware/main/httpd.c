@@ -2,12 +2,22 @@
 #include "mcp9600.h"
 #include "cooktimers.h"
 #include "stovectrl.h"
+#include "events.h"
+#include "i2c_bus.h"
+#include "clock_sync.h"
+#include "history.h"
+#include "cook_log.h"
+#include "metrics.h"
+#include "sysmon.h"
+#include "binlog.h"
+#include "trace.h"
 #include "urldecode.h"
 
 #include "nvs.h"
 #include "nvs_flash.h"
 #include "esp_wifi.h"
 #include "esp_http_server.h"
+#include "esp_timer.h"
 
 static httpd_handle_t server = NULL;
 
@@ -57,9 +67,11 @@ esp_err_t get_resource(httpd_req_t *req)
 
 esp_err_t get_temperature(httpd_req_t *req)
 {
-    const float temp = mcp9600_get_temp_F();
+    const int32_t temp = SC_current_temp_cF();
+    const uint32_t mag = (temp < 0) ? -(uint32_t)temp : temp;
     char response[100];
-    snprintf(response, sizeof(response), "%f", temp);
+    snprintf(response, sizeof(response), "%s%lu.%02lu", (temp < 0) ? "-" : "",
+             (unsigned long)(mag / 100), (unsigned long)(mag % 100));
     httpd_resp_set_type(req, "application/json");
     return httpd_resp_send(req, response, strlen(response));
 }
@@ -147,6 +159,85 @@ static httpd_uri_t uri_list[] = {
         .user_ctx = NULL,
         .handler = rm_timer
     },
+    {
+        .uri      = "/set_probe_name",
+        .method   = HTTP_POST,
+        .user_ctx = NULL,
+        .handler = set_probe_name
+    },
+    {
+        .uri      = "/set_probe_config",
+        .method   = HTTP_POST,
+        .user_ctx = NULL,
+        .handler = set_probe_config
+    },
+    {
+        .uri      = "/time.json",
+        .method   = HTTP_GET,
+        .user_ctx = NULL,
+        .handler = get_time_stats
+    },
+    {
+        .uri      = "/history",
+        .method   = HTTP_GET,
+        .user_ctx = NULL,
+        .handler = get_history
+    },
+    {
+        .uri      = "/logs.json",
+        .method   = HTTP_GET,
+        .user_ctx = NULL,
+        .handler = get_cook_logs
+    },
+    {
+        .uri      = "/logs/*",
+        .method   = HTTP_GET,
+        .user_ctx = NULL,
+        .handler = get_cook_log
+    },
+    {
+        .uri      = "/cooks.json",
+        .method   = HTTP_GET,
+        .user_ctx = NULL,
+        .handler = get_cook_summaries
+    },
+    {
+        .uri      = "/i2c_stats.json",
+        .method   = HTTP_GET,
+        .user_ctx = NULL,
+        .handler = get_i2c_stats
+    },
+    {
+        .uri      = "/metrics",
+        .method   = HTTP_GET,
+        .user_ctx = NULL,
+        .handler = get_metrics
+    },
+    {
+        .uri      = "/tasks.json",
+        .method   = HTTP_GET,
+        .user_ctx = NULL,
+        .handler = get_task_stats
+    },
+    {
+        .uri      = "/trace",
+        .method   = HTTP_GET,
+        .user_ctx = NULL,
+        .handler = get_trace
+    },
+    {
+        .uri      = "/set_trace",
+        .method   = HTTP_POST,
+        .user_ctx = NULL,
+        .handler = set_trace
+    },
+    {
+        .uri          = "/events",
+        .method       = HTTP_GET,
+        .user_ctx     = NULL,
+        .handler      = events_ws,
+        .is_websocket = true
+    },
     {
         .uri      = "/*",
         .method   = HTTP_GET,
@@ -155,11 +246,23 @@ static httpd_uri_t uri_list[] = {
     },
 };
 
+// Handlers are registered through here, with the real one in user_ctx, so every
+//   request's time lands in the HTTP histogram.
+static esp_err_t timed_handler(httpd_req_t *req)
+{
+    esp_err_t (*handler)(httpd_req_t *) = req->user_ctx;
+
+    const int64_t start = esp_timer_get_time();
+    const esp_err_t err = handler(req);
+    metrics_record(METRIC_HTTP, esp_timer_get_time() - start);
+    return err;
+}
+
 static void start_webserver()
 {
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.uri_match_fn = httpd_uri_match_wildcard;
-    config.max_uri_handlers = 20;
+    config.max_uri_handlers = sizeof(uri_list)/sizeof(httpd_uri_t);
 
     printf("Starting webserver\n");
 
@@ -172,7 +275,16 @@ static void start_webserver()
 
     /* Register URI handlers */
     for(int i = 0; i < sizeof(uri_list)/sizeof(httpd_uri_t); i++)
-        httpd_register_uri_handler(server, &uri_list[i]);
+    {
+        // The websocket handler sees the handshake and every frame, not requests.
+        httpd_uri_t uri = uri_list[i];
+        if (!uri.is_websocket)
+        {
+            uri.user_ctx = uri.handler;
+            uri.handler = timed_handler;
+        }
+        httpd_register_uri_handler(server, &uri);
+    }
 }
 
 static esp_err_t stop_webserver(httpd_handle_t server)
@@ -224,7 +336,7 @@ esp_err_t get_content(httpd_req_t *req, char *content, size_t content_size)
 
     if(req->content_len >= content_size)
     {
-        printf("HTTP POST too large!\n");
+        BINLOG(BL_POST_TOO_LARGE, (int)req->content_len);
         return ESP_FAIL;
     }
     int ret = httpd_req_recv(req, content, req->content_len);
@@ -239,13 +351,14 @@ esp_err_t get_content(httpd_req_t *req, char *content, size_t content_size)
             httpd_resp_send_408(req);
         }
 
-        printf("get content failed!!! %i\n", ret);
+        BINLOG(BL_POST_FAILED, ret);
         /* In case of error, returning ESP_FAIL will
          * ensure that the underlying socket is closed */
         return ESP_FAIL;
     }
 
     content[req->content_len] = 0;
+    trace_command(req->uri, content);
     return ESP_OK;
 }
 
@@ -1,16 +1,25 @@
 // https://github.com/gschorcht/sht3x-esp-idf/blob/master/components/esp8266_wrapper/esp8266_wrapper.c
 
 #include "i2c.h"
+#include "i2c_bus.h"
 #include <driver/i2c.h>
 
-#define I2C_ACK_VAL  0x0
-#define I2C_NACK_VAL 0x1
+#include "esp_rom_sys.h"
 
 #define I2C_MASTER_TX_BUF_DISABLE 0 /*!< I2C master doesn't need buffer */
 #define I2C_MASTER_RX_BUF_DISABLE 0 /*!< I2C master doesn't need buffer */
 
+// Remembered so the bus can be rebuilt after a fault.
+static gpio_num_t bus_scl;
+static gpio_num_t bus_sda;
+static uint32_t bus_freq;
+
 void initalize_i2c(i2c_port_t i2c_port, gpio_num_t scl, gpio_num_t sda, uint32_t freq)
 {
+    bus_scl = scl;
+    bus_sda = sda;
+    bus_freq = freq;
+
     i2c_config_t conf = {
         .mode = I2C_MODE_MASTER,
         .sda_io_num = sda,         // select GPIO specific to your project
@@ -26,18 +35,60 @@ void initalize_i2c(i2c_port_t i2c_port, gpio_num_t scl, gpio_num_t sda, uint32_t
 
 }
 
+/* A slave reset or brown out in the middle of a read can leave it holding SDA low,
+ *   waiting for clocks that will never come. Clock it out by hand (at most nine bits
+ *   gets it to the ACK slot), send a STOP, then rebuild the driver.
+ */
+bool i2c_recover_bus(i2c_port_t i2c_port)
+{
+    i2c_driver_delete(i2c_port);
+
+    // Take the pins back from the peripheral and drive them by hand.
+    gpio_reset_pin(bus_scl);
+    gpio_reset_pin(bus_sda);
+    gpio_set_direction(bus_scl, GPIO_MODE_INPUT_OUTPUT_OD);
+    gpio_set_direction(bus_sda, GPIO_MODE_INPUT_OUTPUT_OD);
+    gpio_set_pull_mode(bus_scl, GPIO_PULLUP_ONLY);
+    gpio_set_pull_mode(bus_sda, GPIO_PULLUP_ONLY);
+
+    gpio_set_level(bus_sda, 1);
+    gpio_set_level(bus_scl, 1);
+    esp_rom_delay_us(5);
+
+    for (int i = 0; (i < 9) && !gpio_get_level(bus_sda); i++)
+    {
+        gpio_set_level(bus_scl, 0);
+        esp_rom_delay_us(5);
+        gpio_set_level(bus_scl, 1);
+        esp_rom_delay_us(5);
+    }
+
+    // STOP: SDA low to high while SCL is high.
+    gpio_set_level(bus_scl, 0);
+    esp_rom_delay_us(5);
+    gpio_set_level(bus_sda, 0);
+    esp_rom_delay_us(5);
+    gpio_set_level(bus_scl, 1);
+    esp_rom_delay_us(5);
+    gpio_set_level(bus_sda, 1);
+    esp_rom_delay_us(5);
+
+    const bool released = gpio_get_level(bus_sda) && gpio_get_level(bus_scl);
+
+    initalize_i2c(i2c_port, bus_scl, bus_sda, bus_freq);
+
+    return released;
+}
+
+// Blocking helpers, kept for configuration and the third party drivers.
+// They run on the bus task like everything else; hot paths use i2c_bus_submit().
+
 int i2c_slave_write (i2c_port_t i2c_port, uint8_t addr, const uint8_t *reg, uint8_t *data, uint32_t len)
 {
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, addr << 1 | I2C_MASTER_WRITE, true);
-    if (reg)
-        i2c_master_write_byte(cmd, *reg, true);
-    if (data)
-        i2c_master_write(cmd, data, len, true);
-    i2c_master_stop(cmd);
-    esp_err_t err = i2c_master_cmd_begin(i2c_port, cmd, 1000 / portTICK_PERIOD_MS);
-    i2c_cmd_link_delete(cmd);
+    i2c_bus_txn_t txn;
+    esp_err_t err = i2c_bus_prepare_write(&txn, addr, reg, data, len);
+    if (err == ESP_OK)
+        err = i2c_bus_transfer(&txn);
 
     return err;
 }
@@ -46,25 +97,11 @@ int i2c_slave_read (i2c_port_t i2c_port, uint8_t addr, const uint8_t *reg, uint8
 {
     if (len == 0) return true;
 
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    if (reg)
-    {
-        i2c_master_start(cmd);
-        i2c_master_write_byte(cmd, ( addr << 1 ) | I2C_MASTER_WRITE, true);
-        i2c_master_write_byte(cmd, *reg, true);
-        if (!data)
-            i2c_master_stop(cmd);
-    }
-    if (data)
-    {
-        i2c_master_start(cmd);
-        i2c_master_write_byte(cmd, ( addr << 1 ) | I2C_MASTER_READ, true);
-        if (len > 1) i2c_master_read(cmd, data, len-1, I2C_ACK_VAL);
-        i2c_master_read_byte(cmd, data + len-1, I2C_NACK_VAL);
-        i2c_master_stop(cmd);
-    }
-    esp_err_t err = i2c_master_cmd_begin(i2c_port, cmd, 1000 / portTICK_PERIOD_MS);
-    i2c_cmd_link_delete(cmd);
+    i2c_bus_txn_t txn;
+    esp_err_t err = (data) ? i2c_bus_prepare_read(&txn, addr, reg, data, len)
+                           : i2c_bus_prepare_write(&txn, addr, reg, NULL, 0);
+    if (err == ESP_OK)
+        err = i2c_bus_transfer(&txn);
 
     return err;
 }
@@ -11,6 +11,9 @@ int i2c_slave_write (i2c_port_t i2c_port, uint8_t addr, const uint8_t *reg, uint
 
 int i2c_slave_read (i2c_port_t i2c_port, uint8_t addr, const uint8_t *reg, uint8_t *data, uint32_t len);
 
+// Free a stuck bus and reinstall the driver. Returns false if SDA or SCL are still held low.
+bool i2c_recover_bus(i2c_port_t i2c_port);
+
 void i2c_detect(i2c_port_t i2c_port);
 
 #ifdef __cplusplus
@@ -0,0 +1,302 @@
+#include "i2c_bus.h"
+#include "i2c.h"
+#include "metrics.h"
+#include "binlog.h"
+
+#include "esp_timer.h"
+#include "freertos/queue.h"
+
+#include <string.h>
+
+#define I2C_ACK_VAL  0x0
+#define I2C_NACK_VAL 0x1
+
+#define I2C_BUS_QUEUE_LEN   16  // room for every probe's poll plus the odd config write
+#define I2C_BUS_STACK_SIZE  2048
+#define I2C_BUS_TIMEOUT_MS  50
+
+typedef struct
+{
+    uint32_t count;
+    uint32_t errors;
+    uint64_t total_us;  // queued to done
+    uint32_t max_us;
+    uint32_t last_us;
+    uint32_t max_wait_us; // time spent queued behind other transfers
+} i2c_bus_stats_t;
+
+static i2c_port_t bus_port;
+static QueueHandle_t bus_queue = NULL;
+static portMUX_TYPE bus_mux = portMUX_INITIALIZER_UNLOCKED;
+static i2c_bus_stats_t stats[I2C_DEV_COUNT];
+static uint32_t bus_resets = 0;
+static uint32_t bus_reset_failures = 0;
+static volatile bool reset_queued = false;
+
+static StaticQueue_t queue_buf;
+static uint8_t queue_storage[I2C_BUS_QUEUE_LEN * sizeof(i2c_bus_txn_t *)];
+static StaticTask_t task_buf;
+static StackType_t task_stack[I2C_BUS_STACK_SIZE];
+
+static const char *device_name(i2c_bus_device_t dev)
+{
+    switch (dev)
+    {
+    case I2C_DEV_MCP9600: return "mcp9600";
+    case I2C_DEV_RX8900:  return "rx8900";
+    case I2C_DEV_SHT3X:   return "sht3x";
+    case I2C_DEV_OTHER:
+    case I2C_DEV_COUNT:   break;
+    }
+    return "other";
+}
+
+i2c_bus_device_t i2c_bus_device(uint8_t addr)
+{
+    if ((addr >= 0x60) && (addr <= 0x67)) return I2C_DEV_MCP9600;
+    if (addr == 0x32)                     return I2C_DEV_RX8900;
+    if ((addr == 0x44) || (addr == 0x45)) return I2C_DEV_SHT3X;
+    return I2C_DEV_OTHER;
+}
+
+static void record(i2c_bus_txn_t *txn, int64_t start_us, int64_t end_us)
+{
+    const uint32_t total = end_us - txn->queued_us;
+    const uint32_t wait = start_us - txn->queued_us;
+
+    metrics_record(METRIC_I2C, total);
+
+    portENTER_CRITICAL(&bus_mux);
+    i2c_bus_stats_t *s = &stats[txn->dev];
+    s->count++;
+    if (txn->err != ESP_OK)
+        s->errors++;
+    s->total_us += total;
+    s->last_us = total;
+    if (total > s->max_us)
+        s->max_us = total;
+    if (wait > s->max_wait_us)
+        s->max_wait_us = wait;
+    portEXIT_CRITICAL(&bus_mux);
+}
+
+// Runs on the bus task, between transfers, so nobody else is using the driver.
+static void reset_bus()
+{
+    const bool released = i2c_recover_bus(bus_port);
+
+    portENTER_CRITICAL(&bus_mux);
+    bus_resets++;
+    if (!released)
+        bus_reset_failures++;
+    portEXIT_CRITICAL(&bus_mux);
+
+    reset_queued = false;
+    BINLOG_STR(BL_I2C_BUS_RESET, released ? "" : ", lines still held low!");
+}
+
+static void i2c_bus_task(void *arg)
+{
+    while (1)
+    {
+        i2c_bus_txn_t *txn;
+        if (!xQueueReceive(bus_queue, &txn, portMAX_DELAY))
+            continue;
+
+        // NULL is a reset request from i2c_bus_recover().
+        if (!txn)
+        {
+            reset_bus();
+            continue;
+        }
+
+        const int64_t start = esp_timer_get_time();
+        txn->err = i2c_master_cmd_begin(bus_port, txn->cmd, I2C_BUS_TIMEOUT_MS / portTICK_PERIOD_MS);
+        record(txn, start, esp_timer_get_time());
+
+        // Copy out before clearing busy, the owner may resubmit immediately.
+        const i2c_bus_done_t done = txn->done;
+        const TaskHandle_t waiter = txn->waiter;
+        const esp_err_t err = txn->err;
+        txn->busy = false;
+
+        if (done)
+            done(txn, err);
+        if (waiter)
+            xTaskNotifyGive(waiter);
+    }
+}
+
+void i2c_bus_init(i2c_port_t i2c_port)
+{
+    bus_port = i2c_port;
+    bus_queue = xQueueCreateStatic(I2C_BUS_QUEUE_LEN, sizeof(i2c_bus_txn_t *), queue_storage, &queue_buf);
+
+    // Above the control loop so its requests are serviced within a tick.
+    xTaskCreateStatic(i2c_bus_task, "i2c_bus", I2C_BUS_STACK_SIZE, NULL, tskIDLE_PRIORITY+7, task_stack, &task_buf);
+}
+
+static void prepare(i2c_bus_txn_t *txn, uint8_t addr)
+{
+    memset(txn, 0, sizeof(*txn));
+    txn->dev = i2c_bus_device(addr);
+    txn->cmd = i2c_cmd_link_create_static(txn->cmd_buf, sizeof(txn->cmd_buf));
+}
+
+esp_err_t i2c_bus_prepare_read(i2c_bus_txn_t *txn, uint8_t addr, const uint8_t *reg, uint8_t *data, uint32_t len)
+{
+    if (!data || (len == 0))
+        return ESP_ERR_INVALID_ARG;
+
+    prepare(txn, addr);
+    if (!txn->cmd)
+        return ESP_ERR_NO_MEM;
+
+    i2c_cmd_handle_t cmd = txn->cmd;
+    if (reg)
+    {
+        i2c_master_start(cmd);
+        i2c_master_write_byte(cmd, ( addr << 1 ) | I2C_MASTER_WRITE, true);
+        i2c_master_write_byte(cmd, *reg, true);
+    }
+
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, ( addr << 1 ) | I2C_MASTER_READ, true);
+    if (len > 1) i2c_master_read(cmd, data, len-1, I2C_ACK_VAL);
+    i2c_master_read_byte(cmd, data + len-1, I2C_NACK_VAL);
+    return i2c_master_stop(cmd);
+}
+
+esp_err_t i2c_bus_prepare_write(i2c_bus_txn_t *txn, uint8_t addr, const uint8_t *reg, const uint8_t *data, uint32_t len)
+{
+    prepare(txn, addr);
+    if (!txn->cmd)
+        return ESP_ERR_NO_MEM;
+
+    i2c_cmd_handle_t cmd = txn->cmd;
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, addr << 1 | I2C_MASTER_WRITE, true);
+    if (reg)
+        i2c_master_write_byte(cmd, *reg, true);
+    if (data && len)
+        i2c_master_write(cmd, data, len, true);
+    return i2c_master_stop(cmd);
+}
+
+esp_err_t i2c_bus_submit(i2c_bus_txn_t *txn, i2c_bus_done_t done, void *arg)
+{
+    if (!bus_queue || !txn->cmd)
+        return ESP_ERR_INVALID_STATE;
+
+    portENTER_CRITICAL(&bus_mux);
+    const bool busy = txn->busy;
+    txn->busy = true;
+    portEXIT_CRITICAL(&bus_mux);
+
+    if (busy)
+        return ESP_ERR_INVALID_STATE;
+
+    txn->done = done;
+    txn->arg = arg;
+    txn->waiter = NULL;
+    txn->queued_us = esp_timer_get_time();
+
+    if (!xQueueSend(bus_queue, &txn, 0))
+    {
+        txn->busy = false;
+        return ESP_ERR_TIMEOUT;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t i2c_bus_recover()
+{
+    if (!bus_queue)
+        return ESP_ERR_INVALID_STATE;
+
+    // Several devices may fail on the same fault, one reset is enough.
+    portENTER_CRITICAL(&bus_mux);
+    const bool queued = reset_queued;
+    reset_queued = true;
+    portEXIT_CRITICAL(&bus_mux);
+
+    if (queued)
+        return ESP_OK;
+
+    i2c_bus_txn_t *marker = NULL;
+    if (!xQueueSend(bus_queue, &marker, 0))
+    {
+        reset_queued = false;
+        return ESP_ERR_TIMEOUT;
+    }
+
+    return ESP_OK;
+}
+
+uint32_t i2c_bus_resets()
+{
+    return bus_resets;
+}
+
+esp_err_t i2c_bus_transfer(i2c_bus_txn_t *txn)
+{
+    // Before the bus task exists (early boot) just run it here.
+    if (!bus_queue)
+        return i2c_master_cmd_begin(bus_port, txn->cmd, 1000 / portTICK_PERIOD_MS);
+
+    portENTER_CRITICAL(&bus_mux);
+    const bool busy = txn->busy;
+    txn->busy = true;
+    portEXIT_CRITICAL(&bus_mux);
+
+    if (busy)
+        return ESP_ERR_INVALID_STATE;
+
+    txn->done = NULL;
+    txn->arg = NULL;
+    txn->waiter = xTaskGetCurrentTaskHandle();
+    txn->queued_us = esp_timer_get_time();
+
+    if (!xQueueSend(bus_queue, &txn, portMAX_DELAY))
+    {
+        txn->busy = false;
+        return ESP_ERR_TIMEOUT;
+    }
+
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    return txn->err;
+}
+
+esp_err_t get_i2c_stats(httpd_req_t *req)
+{
+    i2c_bus_stats_t copy[I2C_DEV_COUNT];
+
+    portENTER_CRITICAL(&bus_mux);
+    memcpy(copy, stats, sizeof(copy));
+    const uint32_t resets = bus_resets;
+    const uint32_t reset_failures = bus_reset_failures;
+    portEXIT_CRITICAL(&bus_mux);
+
+    char json[640];
+    int len = snprintf(json, sizeof(json), "{ \"i2c\": {");
+    for (int i = 0; i < I2C_DEV_COUNT; i++)
+    {
+        const i2c_bus_stats_t *s = &copy[i];
+        len += snprintf(json + len, sizeof(json) - len,
+                        "%s\"%s\":{\"count\":%lu,\"errors\":%lu,\"avg_us\":%lu,\"max_us\":%lu,\"last_us\":%lu,\"max_wait_us\":%lu}",
+                        i ? "," : "",
+                        device_name(i),
+                        (unsigned long)s->count,
+                        (unsigned long)s->errors,
+                        (unsigned long)(s->count ? s->total_us / s->count : 0),
+                        (unsigned long)s->max_us,
+                        (unsigned long)s->last_us,
+                        (unsigned long)s->max_wait_us);
+    }
+    len += snprintf(json + len, sizeof(json) - len, "},\"bus_resets\":%lu,\"bus_reset_failures\":%lu}",
+                    (unsigned long)resets, (unsigned long)reset_failures);
+
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, json, len);
+}
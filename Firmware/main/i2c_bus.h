@@ -0,0 +1,78 @@
+#ifndef I2C_BUS_H
+#define I2C_BUS_H
+
+#include <driver/i2c.h>
+
+#include "esp_http_server.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* All I2C traffic goes through one bus task.
+ *
+ * A transaction owns a statically allocated command link which is built once by
+ *   i2c_bus_prepare_read()/i2c_bus_prepare_write() and can then be submitted over and
+ *   over. i2c_bus_submit() only queues a pointer, so the caller never waits on the bus;
+ *   the done callback runs on the bus task when the transfer finishes.
+ * The register, write data and read buffer are referenced, not copied, and must stay
+ *   valid for as long as the transaction is in use.
+ */
+
+typedef enum
+{
+    I2C_DEV_MCP9600,
+    I2C_DEV_RX8900,
+    I2C_DEV_SHT3X,
+    I2C_DEV_OTHER,
+    I2C_DEV_COUNT
+} i2c_bus_device_t;
+
+#define I2C_BUS_CMD_SIZE I2C_LINK_RECOMMENDED_SIZE(4)
+
+typedef struct i2c_bus_txn i2c_bus_txn_t;
+typedef void (*i2c_bus_done_t)(i2c_bus_txn_t *txn, esp_err_t err);
+
+struct i2c_bus_txn
+{
+    i2c_bus_device_t dev;
+    i2c_cmd_handle_t cmd;
+
+    i2c_bus_done_t done;    // optional, runs on the bus task
+    void *arg;              // for the done callback
+    TaskHandle_t waiter;    // notified on completion by i2c_bus_transfer()
+
+    esp_err_t err;          // result of the last transfer
+    volatile bool busy;     // queued or on the bus
+    int64_t queued_us;
+
+    uint8_t cmd_buf[I2C_BUS_CMD_SIZE];
+};
+
+extern void i2c_bus_init(i2c_port_t i2c_port);
+
+extern i2c_bus_device_t i2c_bus_device(uint8_t addr);
+
+extern esp_err_t i2c_bus_prepare_read(i2c_bus_txn_t *txn, uint8_t addr, const uint8_t *reg, uint8_t *data, uint32_t len);
+extern esp_err_t i2c_bus_prepare_write(i2c_bus_txn_t *txn, uint8_t addr, const uint8_t *reg, const uint8_t *data, uint32_t len);
+
+// Queue the transaction. Fails with ESP_ERR_INVALID_STATE if it is still in flight.
+extern esp_err_t i2c_bus_submit(i2c_bus_txn_t *txn, i2c_bus_done_t done, void *arg);
+
+// Queue the transaction and wait for it. Only for boot and configuration paths.
+extern esp_err_t i2c_bus_transfer(i2c_bus_txn_t *txn);
+
+// Ask the bus task to clock out a stuck slave and rebuild the driver before the next
+//   transfer. Requests made while one is already queued are merged.
+extern esp_err_t i2c_bus_recover();
+extern uint32_t i2c_bus_resets();
+
+extern esp_err_t get_i2c_stats(httpd_req_t *req);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // I2C_BUS_H
@@ -8,11 +8,21 @@
 
 #include "led.h"
 #include "i2c.h"
+#include "i2c_bus.h"
 #include "wifi.h"
 #include "httpd.h"
 #include "mcp9600.h"
+#include "bay_sensor.h"
+#include "clock_sync.h"
+#include "history.h"
+#include "cook_log.h"
+#include "energy.h"
 #include "stovectrl.h"
 #include "cooktimers.h"
+#include "metrics.h"
+#include "sysmon.h"
+#include "binlog.h"
+#include "trace.h"
 
 #include "nvs.h"
 #include "nvs_flash.h"
@@ -21,6 +31,7 @@
 #include "esp_event.h"
 #include "esp_sntp.h"
 #include "esp_task_wdt.h"
+#include "esp_timer.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
@@ -46,6 +57,7 @@ static void initialize_nvs()
 
 void sntp_sync_time(struct timeval *tv)
 {
+    clock_sync_sntp(tv);
     settimeofday(tv, NULL);
     sntp_set_sync_status(SNTP_SYNC_STATUS_COMPLETED);
 
@@ -60,12 +72,31 @@ void sntp_sync_time(struct timeval *tv)
            now.tm_hour, now.tm_min, now.tm_sec);
 }
 
+/* The deepest path is a timer firing inside update(): SC_task_event -> control ->
+ *   CT_update -> done_action -> EV_post -> snprintf. The firmware frames on it come to
+ *   ~400 bytes, newlib's vfprintf takes ~1.5K and an interrupt's saved context lands on
+ *   top, which is past the 2K this used to have. Check stack_free in /tasks.json.
+ */
+#define STOVE_CTRL_STACK_SIZE 4096
+
 static void stove_control_task(void * parm)
 {
     TickType_t last_wakeup = xTaskGetTickCount();
+    int64_t last_start = 0;
     while (1)
     {
+        const int64_t start = esp_timer_get_time();
+        if (last_start)
+        {
+            const int64_t late = (start - last_start) - 50000;
+            metrics_record(METRIC_WAKE_JITTER, (late < 0) ? -late : late);
+        }
+        last_start = start;
+
         SC_task_event();
+        CT_tick();
+        metrics_record(METRIC_TICK, esp_timer_get_time() - start);
+
         vTaskDelayUntil(&last_wakeup, 50 / portTICK_PERIOD_MS);
     }
 }
@@ -73,7 +104,6 @@ static void stove_control_task(void * parm)
 
 #define GPIO_INPUT_IO_0     0
 #define GPIO_INPUT_PIN_SEL  (1ULL<<GPIO_INPUT_IO_0)
-#define ESP_INTR_FLAG_DEFAULT 0
 
 static QueueHandle_t gpio_evt_queue = NULL;
 
@@ -120,14 +150,17 @@ void init_gpio_reset()
     //start gpio task
     xTaskCreate(task_gpio_reset, "gpio_reset", 2048, NULL, 10, NULL);
 
-    //install gpio isr service
-    gpio_install_isr_service(ESP_INTR_FLAG_DEFAULT);
+    //install gpio isr service. In IRAM, so the over temperature trip in stovectrl.cpp isn't
+    //  held off while the cook log, NVS or OTA write to flash. Every handler added to it
+    //  must be IRAM_ATTR and only touch DRAM.
+    gpio_install_isr_service(ESP_INTR_FLAG_IRAM);
     //hook isr handler for specific gpio pin
     gpio_isr_handler_add(GPIO_INPUT_IO_0, gpio_isr_handler, (void*) GPIO_INPUT_IO_0);
 }
 
 void app_main(void)
 {
+    binlog_init();
     SC_init_gpio();
 
     init_gpio_reset();
@@ -141,12 +174,26 @@ void app_main(void)
 
     printf("Bringing up I2C\n");
     initalize_i2c(i2c_port, SCL_PIN, SDA_PIN, 100000);
+    i2c_bus_init(i2c_port);
     mcp9600_set_port(i2c_port);
+    mcp9600_probe_bus();
+    mcp9600_init();
+    bay_sensor_init(i2c_port);
+
+    // Wall clock time before WiFi, so nothing has to wait for SNTP.
+    clock_sync_init(i2c_port);
+
+    history_init();
+    trace_init();
+    cook_log_init();
+    energy_init();
+    sysmon_init();
 
     printf("Starting LEDs\n");
     strip = led_strip_init(0, LED_PIN, 1);
 
     SC_init(strip);
+    SC_init_overtemp();
     CT_task_init();
 
     printf("Starting WiFi\n");
@@ -178,5 +225,5 @@ void app_main(void)
 
 //   xTaskCreate(check_rssi, "rssi", 2048, NULL, 5, NULL);
 
-    xTaskCreate(stove_control_task, "stove_ctrl", 2048, NULL, tskIDLE_PRIORITY+6, NULL);
+    xTaskCreate(stove_control_task, "stove_ctrl", STOVE_CTRL_STACK_SIZE, NULL, tskIDLE_PRIORITY+6, NULL);
 }
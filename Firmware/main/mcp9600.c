@@ -1,25 +1,24 @@
 #include "mcp9600.h"
 #include "i2c.h"
+#include "i2c_bus.h"
+#include "httpd.h"
 
-#include <float.h>
+#include "temp_filter.h"
+#include "thermocouple.h"
+#include "binlog.h"
 
-static const uint8_t dev_id = 0x60;
-static i2c_port_t i2c_port;
-static bool broken = false;
+#include "esp_timer.h"
+#include "nvs.h"
 
-void mcp9600_set_port(i2c_port_t i)
-{
-    i2c_port = i;
-}
+#include <string.h>
+#include <stdlib.h>
 
-static float compute_temp_C(uint8_t msb, uint8_t lsb)
-{
-    return ((float)msb)*16.0 + ((float)lsb)/16.0 - 4096.0 * ((float)!!(msb & 0xF0));
-}
+static i2c_port_t i2c_port;
 
-static float compute_temp_F(uint8_t msb, uint8_t lsb)
+// Temperature registers are two's complement, 1/16 C per LSB. Returns centi-C.
+static int32_t compute_temp_cC(uint8_t msb, uint8_t lsb)
 {
-    return compute_temp_C(msb, lsb) * 1.8 + 32.0;
+    return raw16_to_cC((int16_t)((msb << 8) | lsb));
 }
 
 enum Registers_t
@@ -50,19 +49,491 @@ enum Registers_t
     DeviceRevision = 0x20
 } Registers;
 
+/* Sampler configuration.
+ * The 16 bit ADC converts in ~80ms, a little slower than the control loop, so most
+ *   status polls find either nothing or exactly one new conversion.
+ * Filter coefficient 2 (of 0-7) takes the edge off ADC noise without adding much lag.
+ */
+#define DEVICE_CONF_ADC_18BIT   (0x0 << 5)
+#define DEVICE_CONF_ADC_16BIT   (0x1 << 5)
+#define DEVICE_CONF_BURST_1     (0x0 << 2)
+#define DEVICE_CONF_NORMAL      (0x0)
+#define TYPE_FILTER_MASK        0x07
+#define TYPE_SHIFT              4
+#define MCP9600_FILTER          2
+
+/* Linearizing ourselves.
+ * The raw ADC register holds the thermocouple voltage, 2uV per LSB at 18 bits, sign
+ *   extended to 24 bits. 18 bits takes ~320ms per conversion; at 16 bits the 8uV steps
+ *   would be ~0.2C, too coarse to be worth doing the conversion for.
+ */
+#define RAW_ADC_NV_PER_LSB      2000
+
+#define STATUS_TH_UPDATE        (1 << 6)
+
+#define DEVICE_ID_MCP9600       0x40
+#define DEVICE_ID_MCP9601       0x41
+
+static sample_ring_t samples;
+
+/* Fault handling.
+ * A failed read backs off exponentially before the next attempt. Every few failures in
+ *   a row we ask the bus task to clock out the bus and rebuild the driver, and once the
+ *   part answers again it is reconfigured in case it browned out and lost its settings.
+ * Nothing latches: as soon as reads succeed again we are healthy.
+ */
+#define RETRY_BASE_US           (50 * 1000)
+#define RETRY_MAX_US            (5 * 1000 * 1000)
+#define FAILURES_PER_RESET      3
+
+/* Probe registry, one entry per possible address.
+ * Each probe has its own pre-built transactions, chained on the bus task:
+ *   status read -> (conversion ready) -> hot junction read -> status clear
+ * or, when we linearize:
+ *   status read -> (conversion ready) -> raw ADC read -> cold junction read -> status clear
+ * The chains of all probes are queued together each tick and run back to back.
+ */
+typedef struct
+{
+    uint8_t addr;
+    bool present;
+    char name[MCP9600_NAME_LEN];
+
+    // Only changed by the sampler between chains, new_config is handed over from httpd.
+    mcp9600_config_t config;
+    mcp9600_config_t new_config;
+    volatile bool config_changed;
+
+    i2c_bus_txn_t status_txn;
+    i2c_bus_txn_t temp_txn;
+    i2c_bus_txn_t raw_txn;
+    i2c_bus_txn_t cj_txn;
+    i2c_bus_txn_t clear_txn;
+    uint8_t status_data[1];
+    uint8_t temp_data[2];
+    uint8_t raw_data[3];
+    uint8_t cj_data[2];
+    volatile bool sampling;
+
+    volatile uint32_t fail_streak;
+    volatile int64_t retry_at_us;
+    volatile bool reconfigure;
+    mcp9600_health_t health;
+} probe_t;
+
+static probe_t probes[MCP9600_MAX_PROBES];
+static portMUX_TYPE config_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static const uint8_t status_reg = Status;
+static const uint8_t temp_reg = HotJuncitonTemp;
+static const uint8_t raw_reg = RawDataADC;
+static const uint8_t cj_reg = ColdJunctionTemp;
+static const uint8_t status_clear = 0;
+
+static void sample_failed(probe_t *p)
+{
+    if (!p->fail_streak)
+        BINLOG_STR(BL_PROBE_READ_FAILED, p->name);
+
+    const uint32_t streak = ++p->fail_streak;
+    p->health.errors++;
+
+    int64_t backoff = RETRY_BASE_US << ((streak < 8) ? streak - 1 : 7);
+    if (backoff > RETRY_MAX_US)
+        backoff = RETRY_MAX_US;
+    p->retry_at_us = esp_timer_get_time() + backoff;
+
+    if ((streak % FAILURES_PER_RESET) == 0)
+    {
+        p->health.bus_resets_requested++;
+        p->reconfigure = true;
+        i2c_bus_recover();
+    }
+
+    p->sampling = false;
+}
+
+static void sample_ok(probe_t *p)
+{
+    if (p->fail_streak)
+    {
+        BINLOG_STR(BL_PROBE_RECOVERED, p->name, (int)p->fail_streak);
+        p->health.recoveries++;
+        p->fail_streak = 0;
+    }
+}
+
+// All of the callbacks run on the bus task.
+static void clear_done(i2c_bus_txn_t *txn, esp_err_t err)
+{
+    probe_t *p = txn->arg;
+
+    if (err != ESP_OK)
+    {
+        sample_failed(p);
+        return;
+    }
+
+    p->sampling = false;
+}
+
+// Hot junction in centi-C from the raw ADC and cold junction readings.
+static int32_t linearize(const probe_t *p, uint16_t *flags)
+{
+    int32_t adc = (p->raw_data[0] << 16) | (p->raw_data[1] << 8) | p->raw_data[2];
+    if (adc & 0x800000)
+        adc -= 0x1000000;
+
+    const int32_t nV = adc * RAW_ADC_NV_PER_LSB;
+    if (!tc_nV_in_range(p->config.type, nV))
+        *flags |= MCP9600_FLAG_RAW_RANGE;
+
+    const int32_t cold_cC = compute_temp_cC(p->cj_data[0], p->cj_data[1]);
+    return tc_hot_junction_cC(p->config.type, nV, cold_cC);
+}
+
+static void push_sample(probe_t *p, int32_t temp_cC, uint16_t flags)
+{
+    p->health.last_sample_us = esp_timer_get_time();
+
+    const sample_t sample = {
+        .time_us = p->health.last_sample_us,
+        .value = (int16_t)cC_to_raw16(tc_calibrate(&p->config.cal, temp_cC)),
+        .flags = flags,
+        .source = p->addr,
+    };
+    sample_ring_push(&samples, &sample);
+
+    // Clear the update flag only after reading, a conversion landing in between is
+    //   skipped rather than the old one being read twice.
+    if (ESP_OK != i2c_bus_submit(&p->clear_txn, clear_done, p))
+        p->sampling = false;
+}
+
+static void cj_done(i2c_bus_txn_t *txn, esp_err_t err)
+{
+    probe_t *p = txn->arg;
+
+    if (err != ESP_OK)
+    {
+        sample_failed(p);
+        return;
+    }
+
+    sample_ok(p);
+
+    uint16_t flags = p->status_data[0];
+    const int32_t temp_cC = linearize(p, &flags);
+    push_sample(p, temp_cC, flags);
+}
+
+static void raw_done(i2c_bus_txn_t *txn, esp_err_t err)
+{
+    probe_t *p = txn->arg;
+
+    if (err != ESP_OK)
+    {
+        sample_failed(p);
+        return;
+    }
+
+    if (ESP_OK != i2c_bus_submit(&p->cj_txn, cj_done, p))
+        p->sampling = false;
+}
+
+static void temp_done(i2c_bus_txn_t *txn, esp_err_t err)
+{
+    probe_t *p = txn->arg;
+
+    if (err != ESP_OK)
+    {
+        sample_failed(p);
+        return;
+    }
+
+    sample_ok(p);
+
+    // Without calibration this is exactly the register value.
+    push_sample(p, compute_temp_cC(p->temp_data[0], p->temp_data[1]), p->status_data[0]);
+}
+
+static void status_done(i2c_bus_txn_t *txn, esp_err_t err)
+{
+    probe_t *p = txn->arg;
+
+    if (err != ESP_OK)
+    {
+        sample_failed(p);
+        return;
+    }
+
+    sample_ok(p);
+
+    if (!(p->status_data[0] & STATUS_TH_UPDATE))
+    {
+        p->sampling = false;
+        return;
+    }
+
+    const esp_err_t e = p->config.linearize ? i2c_bus_submit(&p->raw_txn, raw_done, p)
+                                            : i2c_bus_submit(&p->temp_txn, temp_done, p);
+    if (e != ESP_OK)
+        p->sampling = false;
+}
+
+/* Alert configuration register bits.
+ * The alert outputs are open drain, so active low alerts from several pins can be
+ *   wired together onto one GPIO.
+ */
+#define ALERT_ENABLE            (1 << 0)
+#define ALERT_INTERRUPT_MODE    (1 << 1)
+#define ALERT_ACTIVE_HIGH       (1 << 2)
+#define ALERT_RISING            (1 << 3)
+#define ALERT_COLD_JUNCTION     (1 << 4)
+
+// Limits use the temperature register format, 0.25C resolution.
+static void encode_limit_cF(int32_t limit_cF, uint8_t *data)
+{
+    const int16_t raw = (int16_t)(cF_to_cC(limit_cF) * 4 / 25) & ~0x3;
+    data[0] = (uint16_t)raw >> 8;
+    data[1] = raw & 0xFF;
+}
+
+// The alerts are only used on the oven probe, that is where the hardware trip is wired.
+#define ALERT_ADDR (MCP9600_BASE_ADDR + MCP9600_OVEN)
+
+static i2c_bus_txn_t limit_txn[4];
+static uint8_t limit_reg[4];
+static uint8_t limit_data[4][2];
+
+// What the alerts were last set to, to put back after a reconfigure.
+static bool alert_configured[4];
+static int32_t alert_limit_cF[4];
+static uint8_t alert_hysteresis_C[4];
+
+void mcp9600_set_port(i2c_port_t i)
+{
+    i2c_port = i;
+}
+
+static bool config_ok(const mcp9600_config_t *c)
+{
+    if ((c->type < 0) || (c->type >= TC_TYPE_COUNT) || (c->cal.count > TC_CAL_POINTS))
+        return false;
+
+    for (int i = 1; i < c->cal.count; i++)
+    {
+        if (c->cal.measured_cC[i] <= c->cal.measured_cC[i - 1])
+            return false;
+    }
+    return true;
+}
+
+static void load_settings(probe_t *p, int probe)
+{
+    if (probe == MCP9600_OVEN)
+        snprintf(p->name, sizeof(p->name), "oven");
+    else
+        snprintf(p->name, sizeof(p->name), "probe%i", probe);
+
+    memset(&p->config, 0, sizeof(p->config));
+    p->config.type = TC_TYPE_K;
+
+    nvs_handle_t nvs;
+    if (ESP_OK != nvs_open("probes", NVS_READONLY, &nvs))
+        return;
+
+    char key[8];
+    snprintf(key, sizeof(key), "name%i", probe);
+    size_t len = sizeof(p->name);
+    char name[MCP9600_NAME_LEN];
+    if (ESP_OK == nvs_get_str(nvs, key, name, &len))
+        memcpy(p->name, name, len);
+
+    snprintf(key, sizeof(key), "cfg%i", probe);
+    mcp9600_config_t config;
+    len = sizeof(config);
+    if ((ESP_OK == nvs_get_blob(nvs, key, &config, &len)) && (len == sizeof(config)) && config_ok(&config))
+        p->config = config;
+
+    nvs_close(nvs);
+}
+
+int mcp9600_probe_bus()
+{
+    int found = 0;
+
+    for (int i = 0; i < MCP9600_MAX_PROBES; i++)
+    {
+        probe_t *p = &probes[i];
+        p->addr = MCP9600_BASE_ADDR + i;
+        load_settings(p, i);
+
+        uint8_t reg = DeviceRevision;
+        uint8_t data[2] = { 0 };
+        const esp_err_t err = i2c_slave_read(i2c_port, p->addr, &reg, data, 2);
+
+        p->present = (err == ESP_OK) && ((data[0] == DEVICE_ID_MCP9600) || (data[0] == DEVICE_ID_MCP9601));
+
+        // The oven sensor is always sampled, if it is missing now the fault handling
+        //   will keep trying to get it back.
+        if (i == MCP9600_OVEN)
+            p->present = true;
+
+        if (p->present)
+        {
+            printf("MCP9600 %s at 0x%02x, type %s%s%s\n", p->name, p->addr,
+                   tc_type_name(p->config.type),
+                   p->config.linearize ? ", linearized from raw ADC" : "",
+                   err ? " not answering" : "");
+            found++;
+        }
+    }
+
+    return found;
+}
+
+static uint8_t device_conf(const probe_t *p)
+{
+    const uint8_t adc = p->config.linearize ? DEVICE_CONF_ADC_18BIT : DEVICE_CONF_ADC_16BIT;
+    return adc | DEVICE_CONF_BURST_1 | DEVICE_CONF_NORMAL;
+}
+
+// The chip's type is set even when we linearize, the alerts use its result.
+static uint8_t type_conf(const probe_t *p)
+{
+    return (tc_mcp9600_type(p->config.type) << TYPE_SHIFT) | MCP9600_FILTER;
+}
+
+/* Setting alert n takes four writes: disable it so we don't trip on a half written
+ *   limit, hysteresis, limit, then comparator mode on the hot junction, asserted for
+ *   as long as we are over the limit.
+ */
+#define ALERT_WRITES 4
+
+static uint32_t alert_write(int n, int k, uint8_t *reg, uint8_t *data)
+{
+    switch (k)
+    {
+    case 0:
+        *reg = Alert1Configuration + n;
+        data[0] = 0;
+        return 1;
+    case 1:
+        *reg = Alert1Hystersis + n;
+        data[0] = alert_hysteresis_C[n];
+        return 1;
+    case 2:
+        *reg = Alert1Limit + n;
+        encode_limit_cF(alert_limit_cF[n], data);
+        return 2;
+    default:
+        *reg = Alert1Configuration + n;
+        data[0] = ALERT_RISING | ALERT_ENABLE;
+        return 1;
+    }
+}
+
+static esp_err_t configure(probe_t *p)
+{
+    uint8_t reg = DeviceConf;
+    uint8_t data[1] = { device_conf(p) };
+    esp_err_t err = i2c_slave_write(i2c_port, p->addr, &reg, data, 1);
+
+    reg = ThermocoupleType;
+    data[0] = type_conf(p);
+    if (!err)
+        err = i2c_slave_write(i2c_port, p->addr, &reg, data, 1);
+
+    if (err)
+        printf("Failed to configure MCP9600 %s!\n", p->name);
+
+    i2c_bus_prepare_read(&p->status_txn, p->addr, &status_reg, p->status_data, sizeof(p->status_data));
+    i2c_bus_prepare_read(&p->temp_txn, p->addr, &temp_reg, p->temp_data, sizeof(p->temp_data));
+    i2c_bus_prepare_read(&p->raw_txn, p->addr, &raw_reg, p->raw_data, sizeof(p->raw_data));
+    i2c_bus_prepare_read(&p->cj_txn, p->addr, &cj_reg, p->cj_data, sizeof(p->cj_data));
+    i2c_bus_prepare_write(&p->clear_txn, p->addr, &status_reg, &status_clear, 1);
+
+    return err;
+}
+
+esp_err_t mcp9600_init()
+{
+    esp_err_t err = ESP_OK;
+
+    for (int i = 0; i < MCP9600_MAX_PROBES; i++)
+    {
+        if (!probes[i].present)
+            continue;
+
+        const esp_err_t e = configure(&probes[i]);
+        if (!err)
+            err = e;
+    }
+
+    return err;
+}
+
+esp_err_t mcp9600_set_alert(int alert, int32_t limit_cF, uint8_t hysteresis_C)
+{
+    if ((alert < 1) || (alert > 4))
+        return ESP_ERR_INVALID_ARG;
+
+    const int n = alert - 1;
+
+    alert_configured[n] = true;
+    alert_limit_cF[n] = limit_cF;
+    alert_hysteresis_C[n] = hysteresis_C;
+
+    esp_err_t err = ESP_OK;
+    for (int k = 0; (k < ALERT_WRITES) && !err; k++)
+    {
+        uint8_t reg;
+        uint8_t data[2];
+        const uint32_t len = alert_write(n, k, &reg, data);
+        err = i2c_slave_write(i2c_port, ALERT_ADDR, &reg, data, len);
+    }
+
+    // A limit move may still be queued on it, and it's built the same way anyway.
+    limit_reg[n] = Alert1Limit + n;
+    if (!limit_txn[n].busy)
+        i2c_bus_prepare_write(&limit_txn[n], ALERT_ADDR, &limit_reg[n], limit_data[n], 2);
+
+    if (err)
+        printf("Failed to configure MCP9600 alert %i!\n", alert);
+
+    return err;
+}
+
+void mcp9600_move_alert_limit(int alert, int32_t limit_cF)
+{
+    if ((alert < 1) || (alert > 4))
+        return;
+
+    const int n = alert - 1;
+
+    // Skip if the last move is still on the bus, the next call will catch up.
+    if (limit_txn[n].busy || !limit_txn[n].cmd)
+        return;
+
+    alert_limit_cF[n] = limit_cF;
+    encode_limit_cF(limit_cF, limit_data[n]);
+    i2c_bus_submit(&limit_txn[n], NULL, NULL);
+}
+
 #define DEBUG_REGISTERS_8(a) \
     reg = a; \
-    i2c_slave_read(i2c_port, dev_id, &reg, data, 1); \
+    i2c_slave_read(i2c_port, ALERT_ADDR, &reg, data, 1); \
     printf( #a " = %x\n", data[0]);
 
 #define DEBUG_REGISTERS_16(a) \
     reg = a; \
-    i2c_slave_read(i2c_port, dev_id, &reg, data, 2); \
-    printf( #a " = %f; %x, %x\n", compute_temp_C(data[0], data[1]), data[0], data[1]);
+    i2c_slave_read(i2c_port, ALERT_ADDR, &reg, data, 2); \
+    printf( #a " = %li cC; %x, %x\n", (long)compute_temp_cC(data[0], data[1]), data[0], data[1]);
 
 #define DEBUG_REGISTERS_24(a) \
     reg = a; \
-    i2c_slave_read(i2c_port, dev_id, &reg, data, 3); \
+    i2c_slave_read(i2c_port, ALERT_ADDR, &reg, data, 3); \
     printf( #a " = %x %x %x\n", data[0], data[1], data[2]);
 
 void mcp9600_dump_state()
@@ -104,42 +575,341 @@ void mcp9600_update_temp()
     DEBUG_REGISTERS_24(RawDataADC);
 }
 
-float mcp9600_get_temp_F()
+/* Reconfiguring puts back everything a power cycle of the part would have lost, and
+ *   applies config changes from httpd. It runs as a chain of writes on the bus task,
+ *   one per done callback, so the control task never waits on the bus:
+ *   device config -> thermocouple type -> (oven probe) each alert that was set
+ * Reconfigures are rare, so the probes share one transaction and take turns. The probe
+ *   counts as sampling until its chain finishes, which also keeps its config still.
+ */
+static i2c_bus_txn_t config_txn;
+static probe_t *volatile config_probe;  // whose chain is running, NULL when free
+static int config_step;
+static uint8_t config_reg;
+static uint8_t config_data[2];
+
+// Build write config_step of the chain, skipping alerts never set. False when done.
+static bool prepare_config_write(probe_t *p)
 {
-    if (broken)
-        return FLT_MAX;
+    uint32_t len = 1;
+    for (;; config_step++)
+    {
+        if (config_step == 0)
+        {
+            config_reg = DeviceConf;
+            config_data[0] = device_conf(p);
+            break;
+        }
 
-    uint8_t data[8];
+        if (config_step == 1)
+        {
+            config_reg = ThermocoupleType;
+            config_data[0] = type_conf(p);
+            break;
+        }
+
+        const int n = (config_step - 2) / ALERT_WRITES;
+        if ((p->addr != ALERT_ADDR) || (n >= 4))
+            return false;
+
+        if (alert_configured[n])
+        {
+            len = alert_write(n, (config_step - 2) % ALERT_WRITES, &config_reg, config_data);
+            break;
+        }
+    }
+
+    // A failed prepare leaves no command, the submit then fails.
+    i2c_bus_prepare_write(&config_txn, p->addr, &config_reg, config_data, len);
+    return true;
+}
+
+// Runs on the bus task.
+static void config_done(i2c_bus_txn_t *txn, esp_err_t err)
+{
+    probe_t *p = txn->arg;
 
-    uint8_t reg = HotJuncitonTemp;
-    if (ESP_OK != i2c_slave_read(i2c_port, dev_id, &reg, data, 2))
+    if (err != ESP_OK)
     {
-        if (!broken)
-            printf("Failed to read temperature!\n");
-        broken = true;
-        return FLT_MAX;
+        config_probe = NULL;
+        sample_failed(p);
+        return;
     }
 
-    return compute_temp_F(data[0], data[1]);
+    config_step++;
+    if (prepare_config_write(p))
+    {
+        if (ESP_OK == i2c_bus_submit(&config_txn, config_done, p))
+            return;
+    }
+    else
+    {
+        p->reconfigure = false;
+    }
+
+    // Done, or the queue was full and it starts over next tick.
+    config_probe = NULL;
+    p->sampling = false;
 }
 
-void mcp9600_use_type_J()
+static void start_reconfigure(probe_t *p)
 {
-    // 0 typ 0 flt
-    // 0 001 0 000
+    if (config_probe)
+        return;
 
-    // typ == thermocouple type; 1 = J
-    // flt == filter coefficents; 0 == off
+    config_probe = p;
+    config_step = 0;
+    prepare_config_write(p);
 
-    uint8_t data[8];
+    p->sampling = true;
+    if (ESP_OK != i2c_bus_submit(&config_txn, config_done, p))
+    {
+        config_probe = NULL;
+        p->sampling = false;
+    }
+}
+
+void mcp9600_sample()
+{
+    const int64_t now = esp_timer_get_time();
+
+    for (int i = 0; i < MCP9600_MAX_PROBES; i++)
+    {
+        probe_t *p = &probes[i];
+        if (!p->present || p->sampling)
+            continue;
+
+        if (p->fail_streak && (now < p->retry_at_us))
+            continue;
+
+        if (p->config_changed)
+        {
+            portENTER_CRITICAL(&config_mux);
+            p->config = p->new_config;
+            p->config_changed = false;
+            portEXIT_CRITICAL(&config_mux);
+            p->reconfigure = true;
+        }
+
+        // The next poll comes after the chain is done.
+        if (p->reconfigure)
+        {
+            start_reconfigure(p);
+            continue;
+        }
+
+        p->sampling = true;
+        if (ESP_OK != i2c_bus_submit(&p->status_txn, status_done, p))
+            p->sampling = false;
+    }
+}
+
+const sample_ring_t *mcp9600_samples()
+{
+    return &samples;
+}
+
+static bool valid(int probe)
+{
+    return (probe >= 0) && (probe < MCP9600_MAX_PROBES) && probes[probe].present;
+}
+
+bool mcp9600_present(int probe)
+{
+    return valid(probe);
+}
+
+const char *mcp9600_name(int probe)
+{
+    return valid(probe) ? probes[probe].name : "";
+}
+
+esp_err_t mcp9600_set_name(int probe, const char *name)
+{
+    if (!valid(probe))
+        return ESP_ERR_INVALID_ARG;
+
+    // Names go straight into JSON, keep them plain.
+    char clean[MCP9600_NAME_LEN];
+    int len = 0;
+    for (; name[len] && (len < MCP9600_NAME_LEN - 1); len++)
+    {
+        const char c = name[len];
+        const bool ok = ((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) ||
+                        ((c >= '0') && (c <= '9')) || (c == '_') || (c == '-');
+        if (!ok)
+            return ESP_ERR_INVALID_ARG;
+        clean[len] = c;
+    }
+    clean[len] = 0;
+
+    if (len == 0)
+        return ESP_ERR_INVALID_ARG;
+
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open("probes", NVS_READWRITE, &nvs);
+    if (err)
+        return err;
+
+    char key[8];
+    snprintf(key, sizeof(key), "name%i", probe);
+    err = nvs_set_str(nvs, key, clean);
+    if (!err)
+        err = nvs_commit(nvs);
+    nvs_close(nvs);
+
+    if (!err)
+        memcpy(probes[probe].name, clean, len + 1);
+
+    return err;
+}
 
-    uint8_t reg = ThermocoupleType;
-    data[0] = 0x10;
+bool mcp9600_failed(int probe)
+{
+    return valid(probe) && (probes[probe].fail_streak != 0);
+}
 
-    if (ESP_OK != i2c_slave_write(i2c_port, dev_id, &reg, data, 1))
+mcp9600_health_t mcp9600_health(int probe)
+{
+    mcp9600_health_t h = { 0 };
+    if (valid(probe))
+    {
+        h = probes[probe].health;
+        h.fail_streak = probes[probe].fail_streak;
+    }
+    return h;
+}
+
+mcp9600_config_t mcp9600_config(int probe)
+{
+    mcp9600_config_t c = { .type = TC_TYPE_K };
+    if (valid(probe))
     {
-        broken = true;
-        printf("Failed to set thermocouple type to type J\n");
+        portENTER_CRITICAL(&config_mux);
+        c = probes[probe].config_changed ? probes[probe].new_config : probes[probe].config;
+        portEXIT_CRITICAL(&config_mux);
     }
+    return c;
+}
+
+esp_err_t mcp9600_set_config(int probe, const mcp9600_config_t *config)
+{
+    if (!valid(probe) || !config_ok(config))
+        return ESP_ERR_INVALID_ARG;
+
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open("probes", NVS_READWRITE, &nvs);
+    if (err)
+        return err;
+
+    char key[8];
+    snprintf(key, sizeof(key), "cfg%i", probe);
+    err = nvs_set_blob(nvs, key, config, sizeof(*config));
+    if (!err)
+        err = nvs_commit(nvs);
+    nvs_close(nvs);
+
+    if (err)
+        return err;
+
+    probe_t *p = &probes[probe];
+    portENTER_CRITICAL(&config_mux);
+    p->new_config = *config;
+    p->config_changed = true;
+    portEXIT_CRITICAL(&config_mux);
+
+    return ESP_OK;
 }
 
+esp_err_t set_probe_name(httpd_req_t *req)
+{
+    char content[64];
+    if (ESP_OK != get_content(req, content, sizeof(content)))
+        return ESP_FAIL;
+
+    // probe=1&name=meat
+    char probe[4];
+    char name[MCP9600_NAME_LEN];
+    if ((ESP_OK != httpd_query_key_value(content, "probe", probe, sizeof(probe))) ||
+        (ESP_OK != httpd_query_key_value(content, "name", name, sizeof(name))) ||
+        (ESP_OK != mcp9600_set_name(atoi(probe), name)))
+    {
+        BINLOG_STR(BL_BAD_PROBE_NAME, content);
+    }
+
+    return ack_http_post(req);
+}
+
+// "212:211.5,400:402" -> calibration points in F, as the probe read them : reference.
+static bool parse_calibration(const char *text, tc_calibration_t *cal)
+{
+    memset(cal, 0, sizeof(*cal));
+
+    while (*text)
+    {
+        if (cal->count == TC_CAL_POINTS)
+            return false;
+
+        char *end;
+        const double measured = strtod(text, &end);
+        if ((end == text) || (*end != ':'))
+            return false;
+
+        text = end + 1;
+        const double actual = strtod(text, &end);
+        if ((end == text) || (*end && (*end != ',')))
+            return false;
+
+        cal->measured_cC[cal->count] = cF_to_cC((int32_t)(measured * 100));
+        cal->actual_cC[cal->count] = cF_to_cC((int32_t)(actual * 100));
+        cal->count++;
+
+        text = *end ? end + 1 : end;
+    }
+
+    return true;
+}
+
+esp_err_t set_probe_config(httpd_req_t *req)
+{
+    char content[128];
+    if (ESP_OK != get_content(req, content, sizeof(content)))
+        return ESP_FAIL;
+
+    // probe=0&type=K&mode=raw&cal=212:211.5,400:402
+    char probe[4];
+    char type[4] = "";
+    char mode[8] = "";
+    char cal[96] = "";
+    if (ESP_OK != httpd_query_key_value(content, "probe", probe, sizeof(probe)))
+    {
+        BINLOG_STR(BL_BAD_PROBE_CONFIG, content);
+        return ack_http_post(req);
+    }
+
+    mcp9600_config_t config = mcp9600_config(atoi(probe));
+
+    bool ok = true;
+    if (ESP_OK == httpd_query_key_value(content, "type", type, sizeof(type)))
+    {
+        if (!strcmp(type, "K"))      config.type = TC_TYPE_K;
+        else if (!strcmp(type, "J")) config.type = TC_TYPE_J;
+        else                         ok = false;
+    }
+
+    if (ESP_OK == httpd_query_key_value(content, "mode", mode, sizeof(mode)))
+    {
+        if (!strcmp(mode, "chip"))     config.linearize = false;
+        else if (!strcmp(mode, "raw")) config.linearize = true;
+        else                           ok = false;
+    }
+
+    // An empty cal clears the calibration.
+    if (ESP_OK == httpd_query_key_value(content, "cal", cal, sizeof(cal)))
+        ok = ok && parse_calibration(cal, &config.cal);
+
+    if (!ok || (ESP_OK != mcp9600_set_config(atoi(probe), &config)))
+        BINLOG_STR(BL_BAD_PROBE_CONFIG, content);
+
+    return ack_http_post(req);
+}
@@ -3,13 +3,91 @@
 
 #include <driver/i2c.h>
 
+#include "sample_ring.h"
+#include "thermocouple.h"
+#include "esp_http_server.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+typedef struct
+{
+    uint32_t errors;                // failed transfers
+    uint32_t recoveries;            // times reads came back after failing
+    uint32_t bus_resets_requested;
+    uint32_t fail_streak;           // failures since the last good read, 0 when healthy
+    int64_t last_sample_us;         // last successful conversion read, 0 if never
+} mcp9600_health_t;
+
+/* Up to eight MCP9600s, one per address strap (0x60-0x67).
+ * Probes are numbered by address, probe 0 at 0x60 is the oven cavity sensor and the
+ *   only one with the hardware over-temperature alerts. Samples from all probes go
+ *   into the same ring, sample.source holds the address.
+ */
+#define MCP9600_MAX_PROBES  8
+#define MCP9600_BASE_ADDR   0x60
+#define MCP9600_OVEN        0
+#define MCP9600_NAME_LEN    16
+
+/* How a probe is read.
+ * By default the chip linearizes (its own type K/J curve) and we use its hot junction
+ *   register. With linearize set we read the raw ADC and cold junction instead and use
+ *   the NIST tables in thermocouple.h, at 18 bits and ~320ms per conversion.
+ * The calibration applies in either mode. Samples are 1/16 C regardless.
+ */
+typedef struct
+{
+    tc_type_t type;
+    bool linearize;
+    tc_calibration_t cal;
+} mcp9600_config_t;
+
+/* sample.flags is the Status register in the low byte, plus our own flags above it.
+ * Open and short circuit detection needs an MCP9601 with the sense pins wired, on a
+ *   plain MCP9600 an open input usually shows up as an ADC range error instead.
+ */
+#define MCP9600_STATUS_SHORT        (1 << 5)    // MCP9601
+#define MCP9600_STATUS_INPUT_RANGE  (1 << 4)    // ADC overrange, or open circuit on the MCP9601
+#define MCP9600_FLAG_RAW_RANGE      (1 << 8)    // raw ADC beyond the thermocouple type's range
+
+static inline int mcp9600_probe_index(uint16_t source)
+{
+    return source - MCP9600_BASE_ADDR;
+}
+
 extern void mcp9600_set_port(i2c_port_t i2c_port);
-extern void mcp9600_use_type_J();
-extern float mcp9600_get_temp_F();
+// Find which probes are fitted and load their names. Returns how many are sampled.
+extern int mcp9600_probe_bus();
+// Set ADC resolution and filter on every probe, and build the sampling transactions.
+extern esp_err_t mcp9600_init();
+
+extern bool mcp9600_present(int probe);
+extern const char *mcp9600_name(int probe);
+// Names are kept in NVS. Letters, digits, '-' and '_' only.
+extern esp_err_t mcp9600_set_name(int probe, const char *name);
+
+// Hardware alert n (1-4) on the oven probe's hot junction. Active low, asserted while the
+//   temperature is above limit_cF (centi-F) and released hysteresis_C below it.
+extern esp_err_t mcp9600_set_alert(int alert, int32_t limit_cF, uint8_t hysteresis_C);
+// Change an alert limit without waiting for the bus.
+extern void mcp9600_move_alert_limit(int alert, int32_t limit_cF);
+// Poll every probe for a finished conversion on the bus task; returns immediately.
+// Fresh conversions are pushed to mcp9600_samples(), value in 1/16 C.
+extern void mcp9600_sample();
+extern const sample_ring_t *mcp9600_samples();
+extern mcp9600_config_t mcp9600_config(int probe);
+// Stored in NVS, takes effect before the probe's next read.
+extern esp_err_t mcp9600_set_config(int probe, const mcp9600_config_t *config);
+
+// True while reads are failing. Retries continue in the background with backoff.
+extern bool mcp9600_failed(int probe);
+extern mcp9600_health_t mcp9600_health(int probe);
+
+// POST probe=<n>&name=<name>
+extern esp_err_t set_probe_name(httpd_req_t *req);
+// POST probe=<n>[&type=K|J][&mode=chip|raw][&cal=<read F>:<actual F>,...]
+extern esp_err_t set_probe_config(httpd_req_t *req);
 
 extern void mcp9600_dump_state();
 extern void mcp9600_update_temp();
@@ -0,0 +1,155 @@
+#include "metrics.h"
+
+#include "esp_timer.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdbool.h>
+
+// Upper bounds in us. Anything above the last lands in +Inf.
+static const uint32_t bounds_us[] = {
+    10, 25, 50, 100, 250, 500,
+    1000, 2500, 5000, 10000, 25000, 50000,
+    100000, 250000, 500000, 1000000,
+};
+#define BUCKETS (sizeof(bounds_us) / sizeof(bounds_us[0]) + 1)
+
+typedef struct
+{
+    uint32_t buckets[BUCKETS];  // not cumulative, summed up when served
+    uint32_t sum_lo;            // us, 64 bits wide without a lock
+    uint32_t sum_hi;
+    uint32_t max_us;
+} histogram_t;
+
+typedef struct
+{
+    const char *name;
+    const char *help;
+} metric_info_t;
+
+static const metric_info_t info[METRIC_COUNT] = {
+    [METRIC_TICK]        = { "stove_control_tick_seconds",       "Time spent in one control loop tick." },
+    [METRIC_WAKE_JITTER] = { "stove_control_wake_jitter_seconds", "Difference between the control task's wake interval and 50ms." },
+    [METRIC_MUTEX_WAIT]  = { "stove_control_mutex_wait_seconds",  "Time spent waiting for the controller's mutex." },
+    [METRIC_I2C]         = { "stove_i2c_transfer_seconds",        "I2C transfer time, queued to done." },
+    [METRIC_HTTP]        = { "stove_http_handler_seconds",        "Time spent in an HTTP request handler." },
+};
+
+static histogram_t histograms[METRIC_COUNT];
+
+void metrics_record(metric_t metric, uint32_t us)
+{
+    histogram_t *h = &histograms[metric];
+
+    int i = 0;
+    while ((i < BUCKETS - 1) && (us > bounds_us[i]))
+        i++;
+    __atomic_fetch_add(&h->buckets[i], 1, __ATOMIC_RELAXED);
+
+    // Carry into the high word when the low one wraps. A reader that lands in between
+    //   sees the sum short by 2^32us, once every 71 minutes of recorded time at most.
+    const uint32_t lo = __atomic_fetch_add(&h->sum_lo, us, __ATOMIC_RELAXED);
+    if (lo + us < lo)
+        __atomic_fetch_add(&h->sum_hi, 1, __ATOMIC_RELAXED);
+
+    uint32_t max = __atomic_load_n(&h->max_us, __ATOMIC_RELAXED);
+    while ((us > max) &&
+           !__atomic_compare_exchange_n(&h->max_us, &max, us, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+static uint64_t sum_us(const histogram_t *h)
+{
+    uint32_t hi, lo;
+    do
+    {
+        hi = __atomic_load_n(&h->sum_hi, __ATOMIC_RELAXED);
+        lo = __atomic_load_n(&h->sum_lo, __ATOMIC_RELAXED);
+    } while (hi != __atomic_load_n(&h->sum_hi, __ATOMIC_RELAXED));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+// Prometheus wants seconds.
+#define SECONDS(us) (unsigned long)((us) / 1000000), (unsigned long)((us) % 1000000)
+
+// Output is flushed whenever the buffer runs low, so a histogram needs no more than
+//   a few lines of stack.
+typedef struct
+{
+    httpd_req_t *req;
+    esp_err_t err;
+    int len;
+    char buf[512];
+} writer_t;
+
+static void flush(writer_t *w)
+{
+    if ((w->err == ESP_OK) && w->len)
+        w->err = httpd_resp_send_chunk(w->req, w->buf, w->len);
+    w->len = 0;
+}
+
+#define LINE_MAX 160
+
+static void line(writer_t *w, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static void line(writer_t *w, const char *fmt, ...)
+{
+    if (w->len > (int)sizeof(w->buf) - LINE_MAX)
+        flush(w);
+
+    va_list args;
+    va_start(args, fmt);
+    const int n = vsnprintf(w->buf + w->len, sizeof(w->buf) - w->len, fmt, args);
+    va_end(args);
+    if (n > 0)
+        w->len += (n < (int)sizeof(w->buf) - w->len) ? n : (int)sizeof(w->buf) - w->len - 1;
+}
+
+static void write_histogram(writer_t *w, metric_t metric)
+{
+    const histogram_t *h = &histograms[metric];
+    const char *name = info[metric].name;
+
+    line(w, "# HELP %s %s\n", name, info[metric].help);
+    line(w, "# TYPE %s histogram\n", name);
+
+    // Buckets are read one at a time, so a record landing meanwhile can make the count
+    //   and sum one sample out with the buckets. Scrapers don't mind.
+    uint32_t count = 0;
+    for (int i = 0; i < BUCKETS; i++)
+    {
+        count += __atomic_load_n(&h->buckets[i], __ATOMIC_RELAXED);
+        if (i < BUCKETS - 1)
+            line(w, "%s_bucket{le=\"%lu.%06lu\"} %lu\n", name, SECONDS(bounds_us[i]), (unsigned long)count);
+        else
+            line(w, "%s_bucket{le=\"+Inf\"} %lu\n", name, (unsigned long)count);
+    }
+
+    const uint64_t sum = sum_us(h);
+    line(w, "%s_sum %lu.%06lu\n", name, SECONDS(sum));
+    line(w, "%s_count %lu\n", name, (unsigned long)count);
+
+    const uint32_t max = __atomic_load_n(&h->max_us, __ATOMIC_RELAXED);
+    line(w, "# TYPE %s_max gauge\n", name);
+    line(w, "%s_max %lu.%06lu\n", name, SECONDS(max));
+}
+
+esp_err_t get_metrics(httpd_req_t *req)
+{
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+
+    writer_t w = { .req = req, .err = ESP_OK, .len = 0 };
+
+    const uint64_t uptime = esp_timer_get_time();
+    line(&w, "# TYPE stove_uptime_seconds gauge\n");
+    line(&w, "stove_uptime_seconds %lu.%06lu\n", SECONDS(uptime));
+
+    for (int m = 0; m < METRIC_COUNT; m++)
+        write_histogram(&w, m);
+
+    flush(&w);
+    if (w.err != ESP_OK)
+        return w.err;
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
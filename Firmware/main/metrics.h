@@ -0,0 +1,39 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+
+#include "esp_http_server.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Latency histograms for the control loop and the things that can hold it up.
+ *
+ * Every histogram has the same fixed buckets, 10us to 1s in 1-2.5-5 steps. Recording
+ *   is a handful of atomic adds, no lock, so it is cheap enough for every tick, I2C
+ *   transfer and HTTP request, and safe from any task.
+ * GET /metrics serves them in the Prometheus text format, in seconds, so a scraper
+ *   can keep the long term record and alert on the tails.
+ */
+
+typedef enum
+{
+    METRIC_TICK,        // SC_task_event() + CT_tick()
+    METRIC_WAKE_JITTER, // how far the control task's wake interval is off 50ms
+    METRIC_MUTEX_WAIT,  // waiting for the controller's mutex, every caller
+    METRIC_I2C,         // queued to done, every transfer
+    METRIC_HTTP,        // time in a request handler
+    METRIC_COUNT
+} metric_t;
+
+extern void metrics_record(metric_t metric, uint32_t us);
+
+extern esp_err_t get_metrics(httpd_req_t *req);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // METRICS_H
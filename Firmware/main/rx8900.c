@@ -2,6 +2,7 @@
 #include "i2c.h"
 
 #include <errno.h>
+#include <stdio.h>
 #include <string.h>
 
 // https://support.epson.biz/td/api/doc_check.php?dl=app_RX8900SA&lang=en
@@ -14,6 +15,9 @@
 #define REG_MIN  1
 #define REG_SEC  0
 
+#define REG_FLAG 0x0E
+#define FLAG_VLF (1 << 1) // oscillator stopped / supply dropped too low, time lost
+
 // From qemu-common.h
 /* Convert a byte between binary and BCD.  */
 static inline uint8_t to_bcd(uint8_t val)
@@ -70,15 +74,23 @@ void set_hwclock(i2c_port_t i2c_port, date_time_t dt)
     if(!err)
     {
         const uint8_t reg[] = { REG_DAY };
-        const uint8_t data[] = {
+        uint8_t data[] = {
             to_bcd(dt.day),
             to_bcd(dt.month),
-            to_bcd(dt.year)
+            to_bcd(dt.year - 2000)
         };
 
         err = i2c_slave_write(i2c_port, 0x32, reg, data, len);
     }
 
+    // The time is good again.
+    if (!err)
+    {
+        const uint8_t reg[] = { REG_FLAG };
+        uint8_t data[] = { 0 };
+        err = i2c_slave_write(i2c_port, 0x32, reg, data, 1);
+    }
+
     if (err)
     {
         printf ("error %d on writing %d byte\n", err, len);
@@ -86,6 +98,16 @@ void set_hwclock(i2c_port_t i2c_port, date_time_t dt)
     }
 }
 
+bool rx8900_time_valid(i2c_port_t i2c_port)
+{
+    uint8_t reg[] = { REG_FLAG };
+    uint8_t data[1];
+    if (i2c_slave_read(i2c_port, 0x32, reg, data, 1))
+        return false;
+
+    return !(data[0] & FLAG_VLF);
+}
+
 
 void set_hwclock_2(i2c_port_t i2c_port, date_time_t dt)
 {
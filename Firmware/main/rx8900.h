@@ -1,3 +1,6 @@
+#ifndef RX8900_H
+#define RX8900_H
+
 #include <sys/time.h>
 #include <driver/i2c.h>
 
@@ -17,9 +20,13 @@ typedef struct {
 void set_hwclock(i2c_port_t i2c_port, date_time_t dt);
 void set_hwclock_2(i2c_port_t i2c_port, date_time_t dt);
 date_time_t get_hwclock(i2c_port_t i2c_port);
+// False if the clock lost power or stopped since it was last set, or can't be read.
+bool rx8900_time_valid(i2c_port_t i2c_port);
 
 float rx8900_get_temp(i2c_port_t i2c_port);
 
 #ifdef __cplusplus
 }
 #endif
+
+#endif // RX8900_H
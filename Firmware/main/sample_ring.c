@@ -0,0 +1,47 @@
+#include "sample_ring.h"
+
+#define MASK (SAMPLE_RING_SIZE - 1)
+
+void sample_ring_push(sample_ring_t *ring, const sample_t *sample)
+{
+    const uint32_t n = ring->head;
+    sample_slot_t *slot = &ring->slots[n & MASK];
+
+    __atomic_store_n(&slot->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    slot->sample = *sample;
+    __atomic_store_n(&slot->seq, n + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&ring->head, n + 1, __ATOMIC_RELEASE);
+}
+
+// Copy sample n if the slot still holds it.
+static bool read_slot(const sample_ring_t *ring, uint32_t n, sample_t *out)
+{
+    const sample_slot_t *slot = &ring->slots[n & MASK];
+
+    if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != n + 1)
+        return false;
+
+    *out = slot->sample;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    return __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == n + 1;
+}
+
+bool sample_ring_next(const sample_ring_t *ring, uint32_t *cursor, sample_t *out)
+{
+    while (1)
+    {
+        const uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if (*cursor == head)
+            return false;
+
+        // Lapped, skip to the oldest sample that is still there.
+        if (head - *cursor > SAMPLE_RING_SIZE)
+            *cursor = head - SAMPLE_RING_SIZE;
+
+        const uint32_t n = (*cursor)++;
+        if (read_slot(ring, n, out))
+            return true;
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef SAMPLE_RING_H
+#define SAMPLE_RING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Single producer, many consumer ring of timestamped samples.
+ *
+ * The producer never waits. Every consumer keeps its own cursor and sees every
+ *   sample once. A consumer that falls more than SAMPLE_RING_SIZE behind skips
+ *   forward to the oldest sample still held.
+ * Each slot carries the sequence number of the sample in it, which lets a reader
+ *   detect that the producer lapped it mid-copy without taking a lock.
+ */
+
+#define SAMPLE_RING_SIZE 64 // power of two
+
+typedef struct
+{
+    int64_t time_us;   // esp_timer_get_time() when the sample was taken
+    int32_t value;
+    uint16_t flags;
+    uint16_t source;
+} sample_t;
+
+typedef struct
+{
+    uint32_t seq;      // sample number + 1, 0 while being written
+    sample_t sample;
+} sample_slot_t;
+
+typedef struct
+{
+    uint32_t head;     // number of samples ever pushed
+    sample_slot_t slots[SAMPLE_RING_SIZE];
+} sample_ring_t;
+
+extern void sample_ring_push(sample_ring_t *ring, const sample_t *sample);
+
+// Copy the sample after *cursor into out and advance the cursor.
+// Returns false when the consumer is caught up.
+extern bool sample_ring_next(const sample_ring_t *ring, uint32_t *cursor, sample_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SAMPLE_RING_H
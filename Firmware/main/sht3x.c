@@ -46,6 +46,9 @@
 #include <stdlib.h>
 #include <sys/time.h>
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
 #include "i2c.h"
 #include "sht3x.h"
 
@@ -307,6 +310,14 @@ bool sht3x_get_results (sht3x_sensor_t* dev, float* temperature, float* humidity
     return sht3x_compute_values (raw_data, temperature, humidity);
 }
 
+bool sht3x_check_raw_data (const sht3x_raw_data_t raw_data)
+{
+    if (!raw_data) return false;
+
+    return (crc8((uint8_t *)raw_data, 2) == raw_data[2]) &&
+           (crc8((uint8_t *)raw_data + 3, 2) == raw_data[5]);
+}
+
 /* Functions for internal use only */
 
 static bool sht3x_is_measuring (sht3x_sensor_t* dev)
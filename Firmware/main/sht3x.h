@@ -273,6 +273,17 @@ bool sht3x_get_results (sht3x_sensor_t* dev,
                         float* temperature, float* humidity);
 
 
+/**
+ * @brief   Check the CRC checksums of raw data read without this driver
+ *
+ * For callers that fetch the results themselves, e.g. asynchronously.
+ *
+ * @param   raw_data    byte array that contains raw data
+ * @return              true if both checksums match
+ */
+bool sht3x_check_raw_data (const sht3x_raw_data_t raw_data);
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,12 +1,34 @@
 #include "stovectrl.h"
 
 #include "cooktimers.h"
+#include "diagnostics.h"
+#include "events.h"
+#include "binlog.h"
+#include "history.h"
+#include "cook_log.h"
+#include "cook_summary.h"
+#include "energy.h"
+#include "trace.h"
 
 #include "mcp9600.h"
+#include "bay_sensor.h"
+#include "temp_filter.h"
+#include "i2c_bus.h"
 #include "httpd.h"
 #include "led.h"
+#include "metrics.h"
 
+#include "esp_timer.h"
+
+#include <cmath>
+#include <ctime>
+#include <cstdint>
+#include <cstdlib>
+#include <array>
 #include <mutex>
+#include <atomic>
+
+static_assert(HISTORY_PROBES == MCP9600_MAX_PROBES, "history has a slot for every probe");
 
 constexpr const static gpio_num_t Downdraft_Low  = gpio_num_t(42);
 constexpr const static gpio_num_t Downdraft_High = gpio_num_t(41);
@@ -27,6 +49,40 @@ constexpr const static gpio_num_t Door_Locked    = gpio_num_t( 3);
 constexpr const static gpio_num_t Door_Unlocked  = gpio_num_t( 2);
 constexpr const static gpio_num_t Cancel         = gpio_num_t( 1);
 
+// MCP9600 ALERT1 and ALERT2 (TP1/TP2 on rev1) wired together, active low.
+constexpr const static gpio_num_t Over_Temp      = gpio_num_t( 6);
+
+/* Hardware over-temperature trip.
+ * MCP9600 alert 1 is a fixed ceiling. Alert 2 is a ceiling we keep moving to just above
+ *   where the oven could be if it were heating as fast as it ever should, so it trips
+ *   on a runaway rate of rise, and also if this firmware stops moving it.
+ * Either alert pulls Over_Temp low and the ISR drops the heating relays itself rather
+ *   than waiting for the control task.
+ */
+/* The ISR runs with the cache off (ESP_INTR_FLAG_IRAM, see main.c), so it and its data
+ *   are in IRAM and DRAM, and gpio_set_level() is too (CONFIG_GPIO_CTRL_FUNC_IN_IRAM).
+ * overtemp_isr_took_us is from entering the ISR to the relays being off. The interrupt
+ *   latency from the alert's edge comes on top and isn't measured.
+ */
+static DRAM_ATTR volatile bool overtemp_pending = false;
+static DRAM_ATTR volatile int64_t overtemp_isr_us = 0;
+static DRAM_ATTR volatile uint32_t overtemp_isr_took_us = 0;
+
+static void IRAM_ATTR overtemp_isr(void *)
+{
+    const int64_t start = esp_timer_get_time();
+
+    gpio_set_level(Bake_A,          false);
+    gpio_set_level(Bake_B,          false);
+    gpio_set_level(Broil_A,         false);
+    gpio_set_level(Broil_B,         false);
+    gpio_set_level(Convection_A,    false);
+
+    overtemp_isr_took_us = esp_timer_get_time() - start;
+    overtemp_isr_us = start;
+    overtemp_pending = true;
+}
+
 static std::string to_string(StoveCtrlMode mode)
 {
     switch (mode)
@@ -38,6 +94,16 @@ static std::string to_string(StoveCtrlMode mode)
     return "";
 };
 
+// Fixed point centi-units as a JSON number, "-1.05"
+static std::string centi_to_string(int32_t centi)
+{
+    char buf[16];
+    const uint32_t mag = (centi < 0) ? -(uint32_t)centi : centi;
+    snprintf(buf, sizeof(buf), "%s%lu.%02lu", (centi < 0) ? "-" : "",
+             (unsigned long)(mag / 100), (unsigned long)(mag % 100));
+    return buf;
+}
+
 static std::string to_string(FanSpeed speed)
 {
     switch (speed)
@@ -75,22 +141,51 @@ class ElementCtrl
     bool top_burner_used { false };
     bool bot_burner_used { false };
 
+    // What the relays were last told, for diagnostics.
+    bool m_bake_on { false };
+    bool m_broil_on { false };
+
+    // Times each pair of relays was switched on, since boot.
+    uint32_t m_bake_starts { 0 };
+    uint32_t m_broil_starts { 0 };
+
 public:
+    // Bake is the bottom element, broil the top. Both poles of each are switched together.
+    void set(bool bake, bool broil)
+    {
+        m_bake_starts += bake && !m_bake_on;
+        m_broil_starts += broil && !m_broil_on;
+        m_bake_on = bake;
+        m_broil_on = broil;
+        gpio_set_level(Bake_A,          bake);
+        gpio_set_level(Bake_B,          bake);
+        gpio_set_level(Broil_A,         broil);
+        gpio_set_level(Broil_B,         broil);
+    }
+
     void off()
     {
-        gpio_set_level(Bake_A,          false);
-        gpio_set_level(Bake_B,          false);
-        gpio_set_level(Broil_A,         false);
-        gpio_set_level(Broil_B,         false);
+        set(false, false);
         gpio_set_level(Convection_A,    false);
     }
 
+    bool bakeOn() const { return m_bake_on; }
+    bool broilOn() const { return m_broil_on; }
+    uint32_t bakeStarts() const { return m_bake_starts; }
+    uint32_t broilStarts() const { return m_broil_starts; }
+
     // Thermal power can be used to estimate the needed heat rise to guess how long
     //    to keep the element(s) on given the current temperature.
     static constexpr int top_element_power_w = 1100;
     static constexpr int bot_element_power_w = 1500;
     static constexpr int q_loss = 1; // heat flow lost from box due to imperfect insulation
 
+    // Millijoules for the elements' on times, at their ratings.
+    static uint64_t energy_mJ(uint64_t bake_ms, uint64_t broil_ms)
+    {
+        return bake_ms * bot_element_power_w + broil_ms * top_element_power_w;
+    }
+
     /* From https://www.engineeringtoolbox.com/convective-heat-transfer-d_430.html
      * Here we can define Newton's Law of Cooling:
      *      q = hc A dT
@@ -126,10 +221,58 @@ class StoveCtrl
 
     ElementCtrl m_elementCtrl;
 
-    static constexpr float m_auto_cool_temp { 150.0 };
+    // All temperatures are centi-degrees F, rates centi-F per second.
+    static constexpr int32_t m_auto_cool_temp { 15000 };
 
-    float m_current_temp { 0.0 };
-    float m_target_temp { 0.0 };
+    // Filtered reading of one MCP9600 probe.
+    struct ProbeReading
+    {
+        temp_filter_t filter {};
+        int64_t last_sample_us { 0 };
+        int32_t temp { 0 };
+        int32_t rate { 0 };
+    };
+
+    std::array<ProbeReading, MCP9600_MAX_PROBES> m_probes {};
+    uint32_t m_sample_cursor { 0 };
+
+    // The oven probe, everything below controls on this.
+    int32_t m_current_temp { 0 };
+    int32_t m_temp_rate { 0 };
+
+    /* Sensor health. A reading older than m_stale_after_ms can't be trusted to control
+     *   heat, so we drop to degraded: elements held off, everything else (mode, program,
+     *   targets) left alone so the cook carries on once readings come back.
+     */
+    static constexpr int m_stale_after_ms { 2000 }; // conversions land every ~80ms
+    bool m_degraded { false };
+    uint32_t m_degraded_count { 0 };
+    int32_t m_target_temp { 0 };
+    bool m_target_reached { false };
+
+    // Preheat tracking. The target counts as stable once we have held it for a while,
+    //   until then we estimate how long that will take from the recent rate of rise.
+    static constexpr int m_ticks_per_s { 20 }; // stove_control_task runs every 50ms
+    static constexpr int m_tick_ms { 1000 / m_ticks_per_s };
+    static constexpr int32_t m_stable_band { 1000 };
+    static constexpr int m_stable_time_s { 60 };
+    static constexpr int m_rate_window_s { 30 };
+
+    int m_ticks_in_band { 0 };
+    int m_tick_count { 0 };
+    size_t m_history_count { 0 };
+    std::array<int32_t, m_rate_window_s> m_temp_history {}; // one sample per second
+    std::atomic<int> m_preheat_eta_s { -1 };
+
+    static constexpr int32_t m_hard_limit { 60000 };
+    static constexpr int32_t m_max_rise_per_s { 200 };
+    static constexpr int m_ceiling_period_s { 10 };
+    static constexpr int m_ceiling_window_s { 30 };
+
+    int m_ceiling_ticks { 0 };
+    uint32_t m_trip_count { 0 };
+    uint32_t m_trip_isr_us { 0 }; // ISR entry to relays off, not from the alert's edge
+    uint32_t m_trip_ack_ms { 0 }; // ISR to the control loop noticing
 
     StoveCtrlMode m_mode { SCM_Off };
     StoveCtrlMode m_prev_mode { SCM_Off };
@@ -142,6 +285,44 @@ class StoveCtrl
 
     int m_cancel_count { 0 };
 
+    /* Electronics bay. The relay board shares it with the SHT3x, so the cooling fan also
+     *   runs whenever the bay is warm or damp, on top of whatever else turned it on.
+     *   Past m_bay_shutdown the cook is cancelled to save the board.
+     * With no bay reading the fan runs whenever the oven is on, to be safe.
+     */
+    static constexpr int32_t m_bay_fan_on { 4500 };      // centi-C
+    static constexpr int32_t m_bay_fan_off { 4000 };
+    static constexpr int32_t m_bay_humid_on { 8000 };    // centi-%RH
+    static constexpr int32_t m_bay_humid_off { 7000 };
+    static constexpr int32_t m_bay_shutdown { 7000 };    // centi-C
+    static constexpr int32_t m_bay_resume { 6000 };
+
+    bay_reading_t m_bay {};
+    bool m_bay_hot { false };
+    bool m_bay_humid { false };
+    bool m_bay_fan { false };
+    bool m_bay_overheat { false };
+
+    uint32_t m_element_faults { 0 };
+
+    /* Everything a tick acts on is read once at its start, so the whole tick sees the
+     *   same inputs and a trace records exactly those.
+     */
+    int64_t m_now_us { 0 };
+    uint32_t m_wall_time { 0 };
+    uint8_t m_inputs { 0 }; // TRACE_IN_*
+
+    // Relay on time over the second being recorded for history.
+    int m_history_ticks { 0 };
+    int m_bake_ticks { 0 };
+    int m_broil_ticks { 0 };
+
+    // The cook being summarised, and its relay switch-ons and energy as of the last second.
+    bool m_cooking { false };
+    uint32_t m_cook_bake_starts { 0 };
+    uint32_t m_cook_broil_starts { 0 };
+    uint64_t m_cook_energy_J { 0 };
+
     void state_off()
     {
         m_target_temp = 0;
@@ -171,7 +352,7 @@ class StoveCtrl
 
     void check_cancel()
     {
-        if(!gpio_get_level(Cancel))
+        if(!(m_inputs & TRACE_IN_CANCEL))
         {
             m_cancel_count = 0;
         }
@@ -185,19 +366,354 @@ class StoveCtrl
         }
     }
 
+    void read_inputs()
+    {
+        m_now_us = esp_timer_get_time();
+        m_wall_time = time(nullptr);
+
+        const bool tripped = __atomic_exchange_n(&overtemp_pending, false, __ATOMIC_ACQUIRE);
+        m_inputs = (gpio_get_level(Cancel) ? TRACE_IN_CANCEL : 0) |
+                   (gpio_get_level(Door_Open) ? TRACE_IN_DOOR_OPEN : 0) |
+                   (!gpio_get_level(Over_Temp) ? TRACE_IN_OVER_TEMP : 0) |
+                   (tripped ? TRACE_IN_TRIPPED : 0);
+
+        trace_tick_begin(m_now_us, m_wall_time, m_inputs);
+    }
+
     void update_temp()
     {
-        m_current_temp = mcp9600_get_temp_F();
-        if (m_current_temp > 800)
+        // Only fresh conversions show up here, each one goes through its probe's filter.
+        sample_t sample;
+        while (sample_ring_next(mcp9600_samples(), &m_sample_cursor, &sample))
+        {
+            trace_sample(&sample);
+
+            const int i = mcp9600_probe_index(sample.source);
+            if ((i < 0) || (i >= MCP9600_MAX_PROBES))
+                continue;
+
+            DG_probe_sample(i, sample.flags, sample.value);
+
+            ProbeReading &probe = m_probes[i];
+            temp_filter_update(&probe.filter, sample.value, sample.time_us);
+            probe.last_sample_us = sample.time_us;
+            probe.temp = cC_to_cF(temp_filter_cC(&probe.filter));
+            probe.rate = delta_cC_to_cF(temp_filter_rate_cC(&probe.filter));
+        }
+
+        m_current_temp = m_probes[MCP9600_OVEN].temp;
+        m_temp_rate = m_probes[MCP9600_OVEN].rate;
+
+        mcp9600_sample();
+        update_degraded();
+
+        if (!m_degraded && (m_current_temp > 80000))
+        {
+            if (m_mode != SCM_Off)
+                EV_post(SE_Fault, m_current_temp / 100, "runaway");
+
+            cancel();
+            BINLOG(BL_RUNAWAY);
+        }
+    }
+
+    int sampleAgeMs(int probe = MCP9600_OVEN) const
+    {
+        return (m_now_us - m_probes[probe].last_sample_us) / 1000;
+    }
+
+    bool probeOk(int probe) const
+    {
+        return mcp9600_present(probe) && m_probes[probe].filter.primed &&
+               (sampleAgeMs(probe) <= m_stale_after_ms) && !DG_probe_faults(probe);
+    }
+
+    void update_degraded()
+    {
+        // An open or shorted probe still converts, but the reading means nothing.
+        const bool faulty = DG_probe_faults(MCP9600_OVEN) != 0;
+        const bool stale = sampleAgeMs() > m_stale_after_ms;
+        if ((stale || faulty) == m_degraded)
+            return;
+
+        m_degraded = stale || faulty;
+        if (m_degraded)
+        {
+            m_degraded_count++;
+            if (faulty)
+                BINLOG(BL_PROBE_FAULT_HOLD);
+            else
+                BINLOG(BL_NO_TEMPERATURE, sampleAgeMs());
+            EV_post(SE_Fault, m_current_temp / 100, "sensor_lost");
+        }
+        else
+        {
+            BINLOG(BL_TEMPERATURE_BACK);
+            EV_post(SE_Recovered, m_current_temp / 100, "sensor");
+        }
+    }
+
+    // Above on turns it on, below off turns it off, in between it stays as it was.
+    static bool hysteresis(bool state, int32_t value, int32_t on, int32_t off)
+    {
+        if (value >= on)
+            return true;
+        if (value <= off)
+            return false;
+        return state;
+    }
+
+    void update_bay()
+    {
+        bay_sensor_sample();
+        m_bay = bay_sensor_latest();
+        trace_bay(&m_bay);
+
+        if (m_bay.ok)
+        {
+            m_bay_hot = hysteresis(m_bay_hot, m_bay.temp_cC, m_bay_fan_on, m_bay_fan_off);
+            m_bay_humid = hysteresis(m_bay_humid, m_bay.humidity_c, m_bay_humid_on, m_bay_humid_off);
+            m_bay_fan = m_bay_hot || m_bay_humid;
+
+            const bool overheat = hysteresis(m_bay_overheat, m_bay.temp_cC, m_bay_shutdown, m_bay_resume);
+            if (overheat && !m_bay_overheat)
+            {
+                BINLOG(BL_BAY_OVERHEAT, (int)m_bay.temp_cC);
+                EV_post(SE_Fault, cC_to_cF(m_bay.temp_cC) / 100, "bay_overheat");
+            }
+            m_bay_overheat = overheat;
+        }
+        else
+        {
+            m_bay_fan = (m_mode != SCM_Off);
+            m_bay_overheat = false;
+        }
+
+        if (m_bay_overheat && (m_mode != SCM_Off))
+            cancel();
+
+        applyCoolingFan();
+    }
+
+    void applyCoolingFan()
+    {
+        gpio_set_level(Cooling_Fan, m_cooling_fan_state || m_bay_fan);
+    }
+
+    void update_preheat()
+    {
+        if (++m_tick_count >= m_ticks_per_s)
+        {
+            m_tick_count = 0;
+            m_temp_history[m_history_count++ % m_temp_history.size()] = m_current_temp;
+        }
+
+        if (m_target_temp <= 0)
+        {
+            m_ticks_in_band = 0;
+            m_preheat_eta_s = -1;
+            return;
+        }
+
+        if (std::abs(m_current_temp - m_target_temp) <= m_stable_band)
+            m_ticks_in_band = std::min(m_ticks_in_band + 1, m_stable_time_s * m_ticks_per_s);
+        else
+            m_ticks_in_band = 0;
+
+        if (m_ticks_in_band > 0)
+        {
+            m_preheat_eta_s = m_stable_time_s - m_ticks_in_band / m_ticks_per_s;
+            return;
+        }
+
+        // Need a full window of history before the rate means anything.
+        if (m_history_count < m_temp_history.size())
+        {
+            m_preheat_eta_s = -1;
+            return;
+        }
+
+        const int32_t oldest = m_temp_history[m_history_count % m_temp_history.size()];
+        const int32_t rise = m_current_temp - oldest; // over the window
+        const int32_t remaining = (m_target_temp - m_stable_band) - m_current_temp;
+
+        // At least 0.01F per second, slower than that and the estimate is meaningless.
+        if ((remaining > 0) && (rise > m_rate_window_s))
+            m_preheat_eta_s = remaining * m_rate_window_s / rise + m_stable_time_s;
+        else
+            m_preheat_eta_s = -1;
+    }
+
+    void update_overtemp()
+    {
+        if (m_inputs & TRACE_IN_TRIPPED)
+        {
+            m_trip_count++;
+            m_trip_isr_us = overtemp_isr_took_us;
+            m_trip_ack_ms = (esp_timer_get_time() - overtemp_isr_us) / 1000;
+
+            BINLOG(BL_HW_OVERTEMP, (int)m_trip_isr_us);
+            EV_post(SE_Fault, m_trip_isr_us, "hw_overtemp");
+        }
+
+        // Stay off for as long as the alert is asserted.
+        if (m_inputs & TRACE_IN_OVER_TEMP)
+            cancel();
+
+        // Only move the ceiling off the hard limit on a real, current reading.
+        if (m_degraded || !m_probes[MCP9600_OVEN].filter.primed)
+            return;
+
+        if (++m_ceiling_ticks >= m_ceiling_period_s * m_ticks_per_s)
         {
+            m_ceiling_ticks = 0;
+            const int32_t ceiling = m_current_temp + m_max_rise_per_s * m_ceiling_window_s;
+            mcp9600_move_alert_limit(2, std::min(ceiling, m_hard_limit));
+        }
+    }
+
+    void update_diagnostics()
+    {
+        const diag_inputs_t in = {
+            .now_us = m_now_us,
+            .oven_cF = m_current_temp,
+            .oven_ok = !m_degraded && m_probes[MCP9600_OVEN].filter.primed,
+            .bake_on = m_elementCtrl.bakeOn(),
+            .broil_on = m_elementCtrl.broilOn(),
+            .door_open = isDoorOpen(),
+        };
+        DG_update(&in);
+
+        // A dead element or stuck relay ends the cook when first found. It stays flagged
+        //   until a later check passes, but a new cook gets the chance to prove it.
+        const uint32_t faults = DG_element_faults();
+        if ((faults & ~m_element_faults) && (m_mode != SCM_Off))
             cancel();
-            printf("Run away or error state!\n");
+        m_element_faults = faults;
+    }
+
+    // A cook is logged from the oven coming on until it goes off again.
+    void update_cook_log()
+    {
+        const bool cooking = m_mode != SCM_Off;
+        if (cooking == m_cooking)
+            return;
+        m_cooking = cooking;
+
+        if (cooking)
+        {
+            cook_log_start();
+            cook_summary_start();
+            energy_session_start();
+            m_cook_bake_starts = m_elementCtrl.bakeStarts();
+            m_cook_broil_starts = m_elementCtrl.broilStarts();
+            m_cook_energy_J = 0;
+        }
+        else
+        {
+            cook_summary_t summary;
+            cook_summary_end(&summary);
+            cook_log_summary(&summary);
+            cook_log_end();
+            energy_session_end();
+        }
+    }
+
+    void update_cook_summary()
+    {
+        // From the same meter as /state, the whole cook's energy less what was already added.
+        const energy_on_time_t on = energy_session();
+        const uint64_t energy_J = ElementCtrl::energy_mJ(on.bake_ms, on.broil_ms) / 1000;
+
+        const cook_second_t second = {
+            .temp_cF = m_current_temp,
+            .target_cF = m_target_temp,
+            .temp_ok = !m_degraded && m_probes[MCP9600_OVEN].filter.primed,
+            .bake_starts = uint16_t(m_elementCtrl.bakeStarts() - m_cook_bake_starts),
+            .broil_starts = uint16_t(m_elementCtrl.broilStarts() - m_cook_broil_starts),
+            .energy_J = uint32_t(energy_J - m_cook_energy_J),
+        };
+        cook_summary_add(&second);
+
+        m_cook_bake_starts = m_elementCtrl.bakeStarts();
+        m_cook_broil_starts = m_elementCtrl.broilStarts();
+        m_cook_energy_J = energy_J;
+    }
+
+    void update_energy()
+    {
+        energy_tick(m_elementCtrl.bakeOn(), m_elementCtrl.broilOn(), m_now_us, m_tick_ms);
+    }
+
+    void update_history()
+    {
+        m_bake_ticks += m_elementCtrl.bakeOn();
+        m_broil_ticks += m_elementCtrl.broilOn();
+        if (++m_history_ticks < m_ticks_per_s)
+            return;
+
+        history_record_t record = {};
+        record.time = m_wall_time;
+        record.temp_cF = m_current_temp;
+        record.target_cF = m_target_temp;
+        record.bake_duty = m_bake_ticks * 100 / m_history_ticks;
+        record.broil_duty = m_broil_ticks * 100 / m_history_ticks;
+        record.outputs = historyOutputs();
+        for (int i = 0; i < MCP9600_MAX_PROBES; i++)
+        {
+            if ((i == MCP9600_OVEN) || !probeOk(i))
+                continue;
+            record.probes |= 1 << i;
+            record.probe_cF[i] = m_probes[i].temp;
+        }
+        history_push(&record);
+        cook_log_sample(&record);
+        if (m_cooking)
+            update_cook_summary();
+
+        m_history_ticks = 0;
+        m_bake_ticks = 0;
+        m_broil_ticks = 0;
+    }
+
+    uint8_t historyOutputs() const
+    {
+        return m_convection_fan_speed | (m_downdraft_fan_speed << 2) |
+               ((m_cooling_fan_state || m_bay_fan) ? HISTORY_COOLING_FAN : 0) |
+               (m_light_state ? HISTORY_LIGHT : 0);
+    }
+
+    uint16_t traceOutputs() const
+    {
+        return historyOutputs() |
+               (m_elementCtrl.bakeOn() ? TRACE_OUT_BAKE : 0) |
+               (m_elementCtrl.broilOn() ? TRACE_OUT_BROIL : 0) |
+               (m_mode << 8);
+    }
+
+    // Announce the first time the oven comes up to a new target.
+    void check_target_reached()
+    {
+        if (m_target_reached || (m_target_temp <= 0))
+            return;
+
+        if (m_current_temp >= m_target_temp)
+        {
+            m_target_reached = true;
+            EV_post(SE_Target_Reached, m_target_temp / 100, "");
         }
     }
 
 public:
     explicit StoveCtrl(led_strip_t *led) : m_led(led)
     {
+        // Give the first conversion the same grace as any other.
+        m_now_us = esp_timer_get_time();
+        m_probes[MCP9600_OVEN].last_sample_us = m_now_us;
+
+        mcp9600_set_alert(1, m_hard_limit, 5);
+        mcp9600_set_alert(2, m_hard_limit, 2);
+
         state_off();
         setDowndraftFan(FS_Off);
         setLight(false);
@@ -206,8 +722,14 @@ public:
         led->refresh(led, 100);
     }
 
-    void setTargetTemp(float target_temp)
+    void setTargetTemp(int32_t target_temp)
     {
+        if (target_temp != m_target_temp)
+        {
+            m_target_reached = false;
+            m_ticks_in_band = 0;
+        }
+
         m_target_temp = target_temp;
     }
 
@@ -233,7 +755,7 @@ public:
     void setCoolingFan(bool state)
     {
         m_cooling_fan_state = state;
-        gpio_set_level(Cooling_Fan,  state);
+        applyCoolingFan();
     }
 
     void setLight(bool light)
@@ -257,9 +779,9 @@ public:
         m_mode = mode;
     }
 
-    bool isDoorOpen()
+    bool isDoorOpen() const
     {
-        return gpio_get_level(Door_Open);
+        return m_inputs & TRACE_IN_DOOR_OPEN;
     }
 
     void cancel()
@@ -268,15 +790,68 @@ public:
         m_mode = SCM_Off;
     }
 
+    bool targetStable() const
+    {
+        return (m_target_temp > 0) && (m_ticks_in_band >= m_stable_time_s * m_ticks_per_s);
+    }
+
+    int preheatETA() const
+    {
+        return m_preheat_eta_s;
+    }
+
+    int32_t currentTemp() const
+    {
+        return m_current_temp;
+    }
+
+    // INT32_MIN if the probe isn't fitted or has no current reading.
+    int32_t probeTemp(int probe) const
+    {
+        if ((probe < 0) || (probe >= MCP9600_MAX_PROBES) || !probeOk(probe))
+            return INT32_MIN;
+
+        return m_probes[probe].temp;
+    }
+
     void update()
+    {
+        read_inputs();
+        control();
+        trace_tick_end(traceOutputs(), m_target_temp);
+    }
+
+private:
+    void control()
     {
         update_temp();
+        update_overtemp();
+        update_preheat();
+        update_bay();
+        update_diagnostics();
+        update_energy();
+        update_cook_log();
+        update_history();
 
-        switch (m_mode)
+        if (m_mode == SCM_Off)
         {
-        case SCM_Off:
             state_off();
             return;
+        }
+
+        // Without a temperature the program can't make progress, hold it where it is.
+        if (m_degraded)
+        {
+            m_elementCtrl.off();
+            check_cancel();
+            m_prev_mode = m_mode;
+            return;
+        }
+
+        switch (m_mode)
+        {
+        case SCM_Off:
+            break;
 
         case SCM_Manual:
             state_manual();
@@ -288,6 +863,7 @@ public:
         }
 
         check_cancel();
+        check_target_reached();
 
         // previous commands could have errored out.
         // If so they are required to have called cancel() for us!
@@ -303,17 +879,79 @@ public:
         m_prev_mode = m_mode;
     }
 
+public:
+    static std::string faultNames(uint32_t mask)
+    {
+        char names[64];
+        DG_fault_names(mask, names, sizeof(names));
+        return names;
+    }
+
     void toJSON(std::string &buf)
     {
-        buf += "\"current_temp\":"     + std::to_string(m_current_temp) + ","
-               "\"target_temp\":"      + std::to_string(m_target_temp) + ","
+        const mcp9600_health_t health = mcp9600_health(MCP9600_OVEN);
+
+        // This cook's, or the last one's while off.
+        const energy_on_time_t cook = energy_session();
+        const energy_on_time_t life = energy_lifetime();
+        const uint64_t cook_mJ = ElementCtrl::energy_mJ(cook.bake_ms, cook.broil_ms);
+        const uint64_t life_mJ = ElementCtrl::energy_mJ(life.bake_ms, life.broil_ms);
+
+        buf += "\"current_temp\":"     + centi_to_string(m_current_temp) + ","
+               "\"temp_rate\":"        + centi_to_string(m_temp_rate) + ","
+               "\"target_temp\":"      + centi_to_string(m_target_temp) + ","
                "\"stove_mode\":\""     + to_string(m_mode) + "\","
                "\"downdraft_fan\":\""  + to_string(m_downdraft_fan_speed) + "\","
                "\"convection_fan\":\"" + to_string(m_convection_fan_speed) + "\","
                "\"cooling_fan\":"      + std::to_string(m_cooling_fan_state) + ","
+               "\"bay_fan\":"          + std::to_string(m_bay_fan) + ","
+               "\"bay_ok\":"           + std::to_string(m_bay.ok) + ","
+               "\"bay_temp\":"         + centi_to_string(cC_to_cF(m_bay.temp_cC)) + ","
+               "\"bay_humidity\":"     + centi_to_string(m_bay.humidity_c) + ","
+               "\"bay_errors\":"       + std::to_string(m_bay.errors) + ","
+               "\"bay_overheat\":"     + std::to_string(m_bay_overheat) + ","
                "\"light\":"            + std::to_string(m_light_state) + ","
                "\"use_top_burner\":"   + std::to_string(m_elementCtrl.use_top_burner()) + ","
-               "\"use_bot_burner\":"   + std::to_string(m_elementCtrl.use_bot_burner());
+               "\"use_bot_burner\":"   + std::to_string(m_elementCtrl.use_bot_burner()) + ","
+               "\"timers_version\":"   + std::to_string(CT_version()) + ","
+               "\"hw_alert\":"         + std::to_string(!gpio_get_level(Over_Temp)) + ","
+               "\"hw_trips\":"         + std::to_string(m_trip_count) + ","
+               "\"hw_trip_isr_us\":"   + std::to_string(m_trip_isr_us) + ","
+               "\"hw_trip_ack_ms\":"   + std::to_string(m_trip_ack_ms) + ","
+               "\"sensor_ok\":"        + std::to_string(!m_degraded) + ","
+               "\"sensor_age_ms\":"    + std::to_string(sampleAgeMs()) + ","
+               "\"sensor_errors\":"    + std::to_string(health.errors) + ","
+               "\"sensor_recoveries\":" + std::to_string(health.recoveries) + ","
+               "\"degraded_count\":"   + std::to_string(m_degraded_count) + ","
+               "\"i2c_bus_resets\":"   + std::to_string(i2c_bus_resets()) + ","
+               "\"faults\":\""        + faultNames(DG_element_faults()) + "\","
+               "\"fault_count\":"      + std::to_string(DG_fault_count()) + ","
+               "\"bake_on_s\":"        + std::to_string(cook.bake_ms / 1000) + ","
+               "\"broil_on_s\":"       + std::to_string(cook.broil_ms / 1000) + ","
+               "\"energy_wh\":"        + centi_to_string(int32_t(cook_mJ / 36000)) + ","
+               "\"lifetime_kwh\":"     + centi_to_string(int32_t(life_mJ / 36000000)) + ","
+               "\"probes\":[";
+
+        bool first = true;
+        for (int i = 0; i < MCP9600_MAX_PROBES; i++)
+        {
+            if (!mcp9600_present(i))
+                continue;
+
+            const mcp9600_config_t config = mcp9600_config(i);
+            buf += std::string(first ? "" : ",") +
+                   "{\"index\":"  + std::to_string(i) + ","
+                   "\"name\":\""  + mcp9600_name(i) + "\","
+                   "\"type\":\""  + tc_type_name(config.type) + "\","
+                   "\"mode\":\""  + (config.linearize ? "raw" : "chip") + "\","
+                   "\"calibrated\":" + std::to_string(config.cal.count != 0) + ","
+                   "\"temp\":"    + centi_to_string(m_probes[i].temp) + ","
+                   "\"rate\":"    + centi_to_string(m_probes[i].rate) + ","
+                   "\"faults\":\"" + faultNames(DG_probe_faults(i)) + "\","
+                   "\"ok\":"      + std::to_string(probeOk(i)) + "}";
+            first = false;
+        }
+        buf += "]";
     }
 };
 
@@ -328,15 +966,47 @@ void SC_init(led_strip_t *led)
 // None of these functions may run while update() is running
 static std::mutex mutex;
 
+static std::unique_lock<std::mutex> lock_controller()
+{
+    const int64_t start = esp_timer_get_time();
+    std::unique_lock<std::mutex> lock(mutex);
+    metrics_record(METRIC_MUTEX_WAIT, esp_timer_get_time() - start);
+    return lock;
+}
+
 void SC_set_target_temp(double target_temp)
 {
     // No Mutex. Only called by cook timer from SC->update()
-    SC->setTargetTemp(target_temp);
+    SC->setTargetTemp(int32_t(target_temp * 100));
+}
+
+bool SC_target_stable()
+{
+    // No Mutex. Only called by cook timer from SC->update()
+    return SC->targetStable();
+}
+
+int SC_preheat_eta_s()
+{
+    // No Mutex. Atomic, may be read while update() runs
+    return SC->preheatETA();
+}
+
+int32_t SC_probe_temp_cF(int probe)
+{
+    // No Mutex. Only called by cook timer from SC->update()
+    return SC->probeTemp(probe);
+}
+
+int32_t SC_current_temp_cF()
+{
+    const auto lock = lock_controller();
+    return SC->currentTemp();
 }
 
 void SC_task_event()
 {
-    const std::lock_guard<std::mutex> lock(mutex);
+    const auto lock = lock_controller();
     SC->update();
 }
 
@@ -362,11 +1032,28 @@ void SC_init_gpio()
     io_conf.pull_up_en = GPIO_PULLUP_DISABLE;
 
     gpio_config(&io_conf);
+
+    io_conf.intr_type = GPIO_INTR_NEGEDGE;
+    io_conf.mode = GPIO_MODE_INPUT;
+    io_conf.pin_bit_mask = (1ULL << Over_Temp);
+    io_conf.pull_up_en = GPIO_PULLUP_ENABLE;
+
+    gpio_config(&io_conf);
+}
+
+void SC_init_overtemp()
+{
+    // Needs the ISR service from init_gpio_reset()
+    gpio_isr_handler_add(Over_Temp, overtemp_isr, nullptr);
+
+    // Already asserted at boot, no edge will come.
+    if (!gpio_get_level(Over_Temp))
+        overtemp_isr(nullptr);
 }
 
 esp_err_t get_state(httpd_req_t *req)
 {
-    const std::lock_guard<std::mutex> lock(mutex);
+    const auto lock = lock_controller();
 
     std::string json;
     json.reserve(1024);
@@ -385,16 +1072,21 @@ esp_err_t set_target_temperature(httpd_req_t *req)
     if (ESP_OK != get_content(req, content, sizeof(content)))
         return ESP_FAIL;
 
-    double new_temp = std::stod(content);
+    char *end;
+    const double new_temp = strtod(content, &end);
+    if ((end == content) || *end || !std::isfinite(new_temp))
+    {
+        BINLOG_STR(BL_BAD_TARGET, content);
+        return ack_http_post(req);
+    }
+
     if ((new_temp < 500) && (new_temp >= 0))
     {
-        const std::lock_guard<std::mutex> lock(mutex);
-        SC->setTargetTemp(new_temp);
+        const auto lock = lock_controller();
+        SC->setTargetTemp(int32_t(new_temp * 100));
     }
 
-    printf("Set Target!\n");
-    printf(content);
-    printf("\n");
+    BINLOG_STR(BL_SET_TARGET, content);
 
     return ack_http_post(req);
 }
@@ -406,13 +1098,11 @@ esp_err_t set_light(httpd_req_t *req)
         return ESP_FAIL;
 
     {
-        const std::lock_guard<std::mutex> lock(mutex);
+        const auto lock = lock_controller();
         SC->setLight(std::string(content) == "1");
     }
 
-    printf("Set Light!\n");
-    printf(content);
-    printf("\n");
+    BINLOG_STR(BL_SET_LIGHT, content);
 
     return ack_http_post(req);
 }
@@ -424,14 +1114,12 @@ esp_err_t set_cooling_fan(httpd_req_t *req)
         return ESP_FAIL;
 
     {
-        const std::lock_guard<std::mutex> lock(mutex);
+        const auto lock = lock_controller();
         SC->setCoolingFan(std::string(content) == "1");
     }
 
     // SC_set_temp
-    printf("Set Cooling Fan!\n");
-    printf(content);
-    printf("\n");
+    BINLOG_STR(BL_SET_COOLING_FAN, content);
 
     return ack_http_post(req);
 }
@@ -444,7 +1132,7 @@ esp_err_t set_downdraft_fan(httpd_req_t *req)
 
     {
         const std::string_view str(content);
-        const std::lock_guard<std::mutex> lock(mutex);
+        const auto lock = lock_controller();
 
         if (str == "0")
         {
@@ -461,9 +1149,7 @@ esp_err_t set_downdraft_fan(httpd_req_t *req)
     }
 
     // SC_set_temp
-    printf("Set Downdraft Fan!\n");
-    printf(content);
-    printf("\n");
+    BINLOG_STR(BL_SET_DOWNDRAFT_FAN, content);
 
     return ack_http_post(req);
 }
@@ -476,7 +1162,7 @@ esp_err_t set_convection_fan(httpd_req_t *req)
 
     {
         const std::string_view str(content);
-        const std::lock_guard<std::mutex> lock(mutex);
+        const auto lock = lock_controller();
 
         if (str == "0")
         {
@@ -493,9 +1179,7 @@ esp_err_t set_convection_fan(httpd_req_t *req)
     }
 
     // SC_set_temp
-    printf("Set Convection Fan!\n");
-    printf(content);
-    printf("\n");
+    BINLOG_STR(BL_SET_CONVECTION_FAN, content);
 
     return ack_http_post(req);
 }
@@ -508,7 +1192,7 @@ esp_err_t set_stove_mode(httpd_req_t *req)
 
     {
         const std::string_view str(content);
-        const std::lock_guard<std::mutex> lock(mutex);
+        const auto lock = lock_controller();
 
         if (str == "0")
         {
@@ -525,9 +1209,7 @@ esp_err_t set_stove_mode(httpd_req_t *req)
     }
 
     // SC_set_temp
-    printf("Set Use Top Element!\n");
-    printf(content);
-    printf("\n");
+    BINLOG_STR(BL_SET_STOVE_MODE, content);
 
     return ack_http_post(req);
 }
@@ -539,14 +1221,12 @@ esp_err_t set_use_top_element(httpd_req_t *req)
         return ESP_FAIL;
 
     {
-        const std::lock_guard<std::mutex> lock(mutex);
+        const auto lock = lock_controller();
         SC->setUseTopElement(std::string(content) == "1");
     }
 
     // SC_set_temp
-    printf("Set Use Top Element!\n");
-    printf(content);
-    printf("\n");
+    BINLOG_STR(BL_SET_USE_TOP, content);
 
     return ack_http_post(req);
 }
@@ -558,14 +1238,12 @@ esp_err_t set_use_bottom_element(httpd_req_t *req)
         return ESP_FAIL;
 
     {
-        const std::lock_guard<std::mutex> lock(mutex);
+        const auto lock = lock_controller();
         SC->setUseBottomElement(std::string(content) == "1");
     }
 
     // SC_set_temp
-    printf("Set Use Bottom Element!\n");
-    printf(content);
-    printf("\n");
+    BINLOG_STR(BL_SET_USE_BOTTOM, content);
 
     return ack_http_post(req);
 }
@@ -3,6 +3,8 @@
 
 #include "esp_http_server.h"
 
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -25,11 +27,22 @@ enum FanSpeed
 
 extern void SC_init_gpio();
 extern void SC_init(led_strip_t *led);
+extern void SC_init_overtemp();
 
 extern void SC_task_event();
 
 extern void SC_set_target_temp(double temp);
 
+// Filtered oven temperature in centi-degrees F.
+extern int32_t SC_current_temp_cF();
+// Filtered temperature of an MCP9600 probe in centi-degrees F, INT32_MIN if it has none.
+extern int32_t SC_probe_temp_cF(int probe);
+
+// True once the oven has held the target temperature long enough to start cooking.
+extern bool SC_target_stable();
+// Predicted seconds until SC_target_stable(), or -1 when we can't tell yet.
+extern int SC_preheat_eta_s();
+
 extern esp_err_t get_state(httpd_req_t *req);
 extern esp_err_t set_target_temperature(httpd_req_t *req);
 
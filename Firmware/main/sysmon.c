@@ -0,0 +1,225 @@
+#include "sysmon.h"
+
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+#define SYSMON_MAX_TASKS    20
+
+typedef struct
+{
+    char name[configMAX_TASK_NAME_LEN];
+    uint32_t number;        // xTaskNumber, to find the task in the next sample
+    uint32_t runtime;       // run time counter at the sample
+    uint16_t cpu_permille;  // since the sample before
+    uint16_t stack_free;    // bytes never used
+    uint8_t priority;
+    uint8_t state;          // eTaskState
+    bool low;
+} task_info_t;
+
+typedef struct
+{
+    uint32_t free;
+    uint32_t min_free;
+    uint32_t largest;
+    uint32_t allocated_blocks;
+    int32_t allocs;         // change in allocated_blocks since the sample before
+} heap_info_t;
+
+typedef struct
+{
+    uint32_t time_s;
+    uint32_t total_runtime;
+    uint8_t count;
+    uint8_t low_stack;
+    bool overflow;          // more tasks than SYSMON_MAX_TASKS, the rest not shown
+    heap_info_t internal;
+    heap_info_t psram;
+    uint32_t failed_allocs;
+    uint32_t failed_size;
+    task_info_t tasks[SYSMON_MAX_TASKS];
+} snapshot_t;
+
+static portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+static snapshot_t current;      // under mux, read by the handler
+static snapshot_t next;         // sampler task only
+static TaskStatus_t status[SYSMON_MAX_TASKS + 4];
+
+static uint32_t failed_allocs = 0;
+static uint32_t failed_size = 0;
+
+// Runs in whichever task asked, keep it short.
+static void alloc_failed(size_t size, uint32_t caps, const char *function_name)
+{
+    __atomic_fetch_add(&failed_allocs, 1, __ATOMIC_RELAXED);
+    failed_size = size;
+}
+
+static void sample_heap(heap_info_t *h, const heap_info_t *prev, uint32_t caps)
+{
+    multi_heap_info_t info;
+    heap_caps_get_info(&info, caps);
+
+    h->free = info.total_free_bytes;
+    h->min_free = info.minimum_free_bytes;
+    h->largest = info.largest_free_block;
+    h->allocated_blocks = info.allocated_blocks;
+    h->allocs = (int32_t)(info.allocated_blocks - prev->allocated_blocks);
+}
+
+static const task_info_t *find(const snapshot_t *s, uint32_t number)
+{
+    for (int i = 0; i < s->count; i++)
+        if (s->tasks[i].number == number)
+            return &s->tasks[i];
+    return NULL;
+}
+
+static void sample(const snapshot_t *prev)
+{
+    snapshot_t *s = &next;
+    uint32_t total = 0;
+    const UBaseType_t n = uxTaskGetSystemState(status, sizeof(status) / sizeof(status[0]), &total);
+
+    s->time_s = esp_timer_get_time() / 1000000;
+    s->total_runtime = total;
+    s->overflow = (n == 0) || (n > SYSMON_MAX_TASKS);
+    s->count = (n > SYSMON_MAX_TASKS) ? SYSMON_MAX_TASKS : n;
+    s->low_stack = 0;
+
+    // The counter is 32 bit us and wraps every 71 minutes, the differences don't care.
+    const uint32_t elapsed = total - prev->total_runtime;
+
+    for (int i = 0; i < s->count; i++)
+    {
+        const TaskStatus_t *ts = &status[i];
+        task_info_t *t = &s->tasks[i];
+        const task_info_t *before = find(prev, ts->xTaskNumber);
+
+        snprintf(t->name, sizeof(t->name), "%s", ts->pcTaskName);
+        t->number = ts->xTaskNumber;
+        t->runtime = ts->ulRunTimeCounter;
+        t->priority = ts->uxCurrentPriority;
+        t->state = ts->eCurrentState;
+        t->stack_free = ts->usStackHighWaterMark;
+
+        // A task started since the last sample has all its run time in this period.
+        const uint32_t ran = t->runtime - (before ? before->runtime : 0);
+        t->cpu_permille = elapsed ? (uint16_t)(((uint64_t)ran * 1000) / elapsed) : 0;
+
+        t->low = t->stack_free < SYSMON_STACK_LOW;
+        if (t->low)
+        {
+            s->low_stack++;
+            if (!before || !before->low)
+                printf("Task %s is low on stack, %u bytes never used\n", t->name, t->stack_free);
+        }
+    }
+
+    sample_heap(&s->internal, &prev->internal, MALLOC_CAP_INTERNAL);
+    sample_heap(&s->psram, &prev->psram, MALLOC_CAP_SPIRAM);
+    s->failed_allocs = __atomic_load_n(&failed_allocs, __ATOMIC_RELAXED);
+    s->failed_size = failed_size;
+
+    if (s->failed_allocs != prev->failed_allocs)
+        printf("%lu allocations failed, last was %lu bytes\n",
+               (unsigned long)(s->failed_allocs - prev->failed_allocs), (unsigned long)s->failed_size);
+
+    portENTER_CRITICAL(&mux);
+    memcpy(&current, s, sizeof(current));
+    portEXIT_CRITICAL(&mux);
+}
+
+static void sysmon_task(void *arg)
+{
+    while (1)
+    {
+        // current is only written from here, no need for the lock to read it.
+        sample(&current);
+        vTaskDelay(SYSMON_PERIOD_S * 1000 / portTICK_PERIOD_MS);
+    }
+}
+
+void sysmon_init()
+{
+    heap_caps_register_failed_alloc_callback(alloc_failed);
+    xTaskCreate(sysmon_task, "sysmon", 2560, NULL, tskIDLE_PRIORITY+1, NULL);
+}
+
+static const char *state_name(uint8_t state)
+{
+    switch (state)
+    {
+    case eRunning:   return "running";
+    case eReady:     return "ready";
+    case eBlocked:   return "blocked";
+    case eSuspended: return "suspended";
+    case eDeleted:   return "deleted";
+    default:         break;
+    }
+    return "invalid";
+}
+
+static int heap_json(char *buf, int size, const char *name, const heap_info_t *h)
+{
+    // How much of the free memory can't be had in one piece.
+    const uint32_t fragmentation = h->free ? 100 - (uint64_t)h->largest * 100 / h->free : 0;
+
+    return snprintf(buf, size,
+                    "\"%s\":{\"free\":%lu,\"min_free\":%lu,\"largest_free\":%lu,\"fragmentation\":%lu,"
+                    "\"allocated_blocks\":%lu,\"allocs\":%ld}",
+                    name,
+                    (unsigned long)h->free,
+                    (unsigned long)h->min_free,
+                    (unsigned long)h->largest,
+                    (unsigned long)fragmentation,
+                    (unsigned long)h->allocated_blocks,
+                    (long)h->allocs);
+}
+
+esp_err_t get_task_stats(httpd_req_t *req)
+{
+    // The server runs one handler at a time.
+    static snapshot_t copy;
+    portENTER_CRITICAL(&mux);
+    memcpy(&copy, &current, sizeof(copy));
+    portEXIT_CRITICAL(&mux);
+
+    httpd_resp_set_type(req, "application/json");
+
+    char buf[384];
+    int len = snprintf(buf, sizeof(buf),
+                       "{\"uptime_s\":%lu,\"period_s\":%d,\"stack_low\":%d,\"low_stack\":%u,\"overflow\":%s,"
+                       "\"failed_allocs\":%lu,\"failed_size\":%lu,",
+                       (unsigned long)copy.time_s, SYSMON_PERIOD_S, SYSMON_STACK_LOW, copy.low_stack,
+                       copy.overflow ? "true" : "false",
+                       (unsigned long)copy.failed_allocs, (unsigned long)copy.failed_size);
+    len += heap_json(buf + len, sizeof(buf) - len, "heap", &copy.internal);
+    len += snprintf(buf + len, sizeof(buf) - len, ",");
+    len += heap_json(buf + len, sizeof(buf) - len, "psram", &copy.psram);
+    len += snprintf(buf + len, sizeof(buf) - len, ",\"tasks\":[");
+    esp_err_t err = httpd_resp_send_chunk(req, buf, len);
+
+    for (int i = 0; (i < copy.count) && (err == ESP_OK); i++)
+    {
+        const task_info_t *t = &copy.tasks[i];
+        len = snprintf(buf, sizeof(buf),
+                       "%s{\"name\":\"%s\",\"priority\":%u,\"state\":\"%s\",\"cpu\":%u.%u,\"stack_free\":%u,\"low\":%s}",
+                       i ? "," : "", t->name, t->priority, state_name(t->state),
+                       t->cpu_permille / 10, t->cpu_permille % 10, t->stack_free,
+                       t->low ? "true" : "false");
+        err = httpd_resp_send_chunk(req, buf, len);
+    }
+
+    if (err == ESP_OK)
+        err = httpd_resp_send_chunk(req, "]}", 2);
+    if (err != ESP_OK)
+        return err;
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
@@ -0,0 +1,32 @@
+#ifndef SYSMON_H
+#define SYSMON_H
+
+#include "esp_http_server.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Periodic snapshot of the tasks and the heap.
+ *
+ * A low priority task wakes every SYSMON_PERIOD_S and records, per task, the stack high
+ *   water mark and its share of the CPU since the last sample, and for the heap, free
+ *   and largest free block (fragmentation), live allocation count and failed allocations.
+ * A task with less than SYSMON_STACK_LOW bytes of stack left unused is flagged and
+ *   reported on the console once.
+ * Needs CONFIG_FREERTOS_USE_TRACE_FACILITY and CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS.
+ */
+
+#define SYSMON_PERIOD_S     10
+#define SYSMON_STACK_LOW    512     // bytes
+
+extern void sysmon_init();
+
+// GET /tasks.json, the last snapshot.
+extern esp_err_t get_task_stats(httpd_req_t *req);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SYSMON_H
@@ -0,0 +1,67 @@
+#include "temp_filter.h"
+
+#include <string.h>
+
+/* Gains in 1/256. The conversion interval is ~80ms with the 16 bit ADC.
+ * beta = alpha^2 / (2 - alpha) is the Benedict-Bordner choice, well damped for a
+ *   target that mostly moves at a steady rate, which is what an oven does.
+ */
+#define ALPHA               64  // 0.25
+#define BETA                9   // ~0.036
+
+// After a gap this long (sensor fault) the old state means nothing, start over.
+#define MAX_GAP_US          (2 * 1000 * 1000)
+
+void temp_filter_reset(temp_filter_t *f)
+{
+    memset(f, 0, sizeof(*f));
+}
+
+static int32_t median3(int32_t a, int32_t b, int32_t c)
+{
+    if (a > b) { const int32_t t = a; a = b; b = t; }
+    if (b > c) { b = c; }
+    return (a > b) ? a : b;
+}
+
+static int32_t prefilter(temp_filter_t *f, int32_t raw)
+{
+    f->window[f->next] = raw;
+    f->next = (f->next + 1) % 3;
+    if (f->count < 3)
+        f->count++;
+
+    if (f->count < 3)
+        return raw;
+
+    return median3(f->window[0], f->window[1], f->window[2]);
+}
+
+void temp_filter_update(temp_filter_t *f, int32_t raw, int64_t time_us)
+{
+    const int64_t dt = time_us - f->last_us;
+
+    if (f->primed && (dt > MAX_GAP_US))
+        temp_filter_reset(f);
+
+    const int32_t z = raw16_to_cC(prefilter(f, raw)) << TEMP_FILTER_SHIFT;
+
+    if (!f->primed || (dt <= 0))
+    {
+        if (!f->primed)
+        {
+            f->x = z;
+            f->v = 0;
+            f->primed = true;
+        }
+        f->last_us = time_us;
+        return;
+    }
+
+    const int32_t predicted = f->x + (int32_t)((int64_t)f->v * dt / 1000000);
+    const int32_t residual = z - predicted;
+
+    f->x = predicted + (int32_t)(((int64_t)residual * ALPHA) >> 8);
+    f->v += (int32_t)((((int64_t)residual * BETA * 1000000) / dt) >> 8);
+    f->last_us = time_us;
+}
@@ -0,0 +1,80 @@
+#ifndef TEMP_FILTER_H
+#define TEMP_FILTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Fixed point temperature filter, the S2 has no FPU.
+ *
+ * A median of the last three conversions throws out single sample glitches, then an
+ *   alpha-beta filter tracks the temperature and its rate of change. The sample times
+ *   drive the prediction step, so a skipped or late conversion is handled properly.
+ * Temperatures are centi-degrees (1/100), rates centi-degrees per second.
+ */
+
+typedef struct
+{
+    int32_t window[3];  // last raw conversions, 1/16 C
+    uint8_t count;
+    uint8_t next;
+
+    int64_t last_us;
+    int32_t x;          // centi-C << TEMP_FILTER_SHIFT
+    int32_t v;          // centi-C per second << TEMP_FILTER_SHIFT
+    bool primed;
+} temp_filter_t;
+
+#define TEMP_FILTER_SHIFT 8
+
+extern void temp_filter_reset(temp_filter_t *f);
+
+// Feed one MCP9600 conversion (1/16 C) taken at time_us.
+extern void temp_filter_update(temp_filter_t *f, int32_t raw, int64_t time_us);
+
+static inline int32_t temp_filter_cC(const temp_filter_t *f)
+{
+    return f->x >> TEMP_FILTER_SHIFT;
+}
+
+static inline int32_t temp_filter_rate_cC(const temp_filter_t *f)
+{
+    return f->v >> TEMP_FILTER_SHIFT;
+}
+
+// 1/16 C -> centi-C
+static inline int32_t raw16_to_cC(int32_t raw)
+{
+    return raw * 25 / 4;
+}
+
+// Rounded to the nearest 1/16 C.
+static inline int32_t cC_to_raw16(int32_t cC)
+{
+    return (cC * 4 + ((cC < 0) ? -12 : 12)) / 25;
+}
+
+static inline int32_t cC_to_cF(int32_t cC)
+{
+    return cC * 9 / 5 + 3200;
+}
+
+static inline int32_t cF_to_cC(int32_t cF)
+{
+    return (cF - 3200) * 5 / 9;
+}
+
+// A temperature difference or rate, no offset.
+static inline int32_t delta_cC_to_cF(int32_t cC)
+{
+    return cC * 9 / 5;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TEMP_FILTER_H
@@ -0,0 +1,251 @@
+#include "thermocouple.h"
+
+#include <array>
+#include <cstddef>
+
+/* NIST ITS-90 thermocouple reference functions, E in mV for T in C.
+ *   https://srdata.nist.gov/its90/main/
+ * Evaluated in double at compile time only, the firmware just carries the tables.
+ */
+
+namespace {
+
+struct Polynomial
+{
+    double t_max;           // upper end of the range this applies to
+    std::size_t n;
+    double c[11];
+};
+
+struct Reference
+{
+    int t_min;              // table range, C
+    int t_max;
+    Polynomial ranges[2];
+    bool k_exponential;     // type K adds a0 * exp(a1 * (T - a2)^2) above 0C
+};
+
+constexpr Reference type_k = {
+    -200, 1372,
+    {
+        { 0.0, 11, {
+            0.000000000000E+00,  0.394501280250E-01,  0.236223735980E-04,
+           -0.328589067840E-06, -0.499048287770E-08, -0.675090591730E-10,
+           -0.574103274280E-12, -0.310888728940E-14, -0.104516093650E-16,
+           -0.198892668780E-19, -0.163226974860E-22 } },
+        { 1372.0, 10, {
+           -0.176004136860E-01,  0.389212049750E-01,  0.185587700320E-04,
+           -0.994575928740E-07,  0.318409457190E-09, -0.560728448890E-12,
+            0.560750590590E-15, -0.320207200030E-18,  0.971511471520E-22,
+           -0.121047212750E-25 } },
+    },
+    true
+};
+
+constexpr Reference type_j = {
+    -200, 1200,
+    {
+        { 760.0, 9, {
+            0.000000000000E+00,  0.503811878150E-01,  0.304758369300E-04,
+           -0.856810657200E-07,  0.132281952950E-09, -0.170529583370E-12,
+            0.209480906970E-15, -0.125383953360E-18,  0.156317256970E-22 } },
+        { 1200.0, 6, {
+            0.296456256810E+03, -0.149761277860E+01,  0.317871039240E-02,
+           -0.318476867010E-05,  0.157208190040E-08, -0.306913690560E-12 } },
+    },
+    false
+};
+
+// std::exp isn't constexpr. Only needed for x <= 0 here.
+constexpr double cexp(double x)
+{
+    if (x > 0)
+        return 1.0 / cexp(-x);
+
+    // exp(x) = exp(x / 2^k)^(2^k), with x / 2^k small enough for a short series.
+    int k = 0;
+    while (x < -0.5)
+    {
+        x /= 2;
+        k++;
+    }
+
+    double sum = 1.0;
+    double term = 1.0;
+    for (int i = 1; i < 20; i++)
+    {
+        term *= x / i;
+        sum += term;
+    }
+
+    while (k-- > 0)
+        sum *= sum;
+
+    return sum;
+}
+
+constexpr double reference_mV(const Reference &ref, double t)
+{
+    const Polynomial &p = (t <= ref.ranges[0].t_max) ? ref.ranges[0] : ref.ranges[1];
+
+    double e = 0;
+    for (std::size_t i = p.n; i-- > 0;)
+        e = e * t + p.c[i];
+
+    if (ref.k_exponential && (t > 0))
+        e += 0.118597600000E+00 * cexp(-0.118343200000E-03 * (t - 0.126968600000E+03) * (t - 0.126968600000E+03));
+
+    return e;
+}
+
+// 4C steps keep the interpolation error around 0.01C each way on both types above
+//   -50C (0.03C at -200C), well under the 2uV (~0.05C) resolution of the ADC.
+//   replay/thermocouple_test checks this against NIST.
+constexpr int step_C = 4;
+
+template <std::size_t N>
+struct Table
+{
+    int t_min;
+    std::array<int32_t, N> nV;
+};
+
+constexpr std::size_t table_size(const Reference &ref)
+{
+    return (ref.t_max - ref.t_min) / step_C + 1;
+}
+
+template <std::size_t N>
+constexpr Table<N> make_table(const Reference &ref)
+{
+    Table<N> table { ref.t_min, {} };
+    for (std::size_t i = 0; i < N; i++)
+    {
+        const double mV = reference_mV(ref, ref.t_min + double(i) * step_C);
+        const double nV = mV * 1e6;
+        table.nV[i] = int32_t(nV < 0 ? nV - 0.5 : nV + 0.5);
+    }
+    return table;
+}
+
+constexpr auto table_k = make_table<table_size(type_k)>(type_k);
+constexpr auto table_j = make_table<table_size(type_j)>(type_j);
+
+// Spot checks against the NIST tables (mV at 100C / 500C), to 1uV.
+static_assert((table_k.nV[(100 + 200) / step_C] > 4095000) && (table_k.nV[(100 + 200) / step_C] < 4097000), "type K table");
+static_assert((table_k.nV[(500 + 200) / step_C] > 20643000) && (table_k.nV[(500 + 200) / step_C] < 20645000), "type K table");
+static_assert((table_j.nV[(100 + 200) / step_C] > 5268000) && (table_j.nV[(100 + 200) / step_C] < 5270000), "type J table");
+static_assert((table_j.nV[(500 + 200) / step_C] > 27392000) && (table_j.nV[(500 + 200) / step_C] < 27394000), "type J table");
+
+struct TableView
+{
+    int t_min;
+    const int32_t *nV;
+    std::size_t size;
+};
+
+template <std::size_t N>
+constexpr TableView view(const Table<N> &t)
+{
+    return { t.t_min, t.nV.data(), N };
+}
+
+TableView table_for(tc_type_t type)
+{
+    return (type == TC_TYPE_J) ? view(table_j) : view(table_k);
+}
+
+int32_t interpolate(int32_t x, int32_t x0, int32_t x1, int32_t y0, int32_t y1)
+{
+    if (x1 == x0)
+        return y0;
+    return y0 + int32_t((int64_t)(x - x0) * (y1 - y0) / (x1 - x0));
+}
+
+} // namespace
+
+int32_t tc_nV_from_cC(tc_type_t type, int32_t t_cC)
+{
+    const TableView t = table_for(type);
+    const int32_t min_cC = t.t_min * 100;
+    const int32_t step_cC = step_C * 100;
+
+    int32_t i = (t_cC - min_cC) / step_cC;
+    if (t_cC < min_cC)
+        i = 0;
+    if (i > int32_t(t.size) - 2)
+        i = t.size - 2;
+
+    const int32_t x0 = min_cC + i * step_cC;
+    return interpolate(t_cC, x0, x0 + step_cC, t.nV[i], t.nV[i + 1]);
+}
+
+int32_t tc_cC_from_nV(tc_type_t type, int32_t nV)
+{
+    const TableView t = table_for(type);
+
+    if (nV <= t.nV[0])
+        return t.t_min * 100;
+    if (nV >= t.nV[t.size - 1])
+        return (t.t_min + int32_t(t.size - 1) * step_C) * 100;
+
+    // E(T) is monotonic over the table, find the segment holding nV.
+    std::size_t lo = 0;
+    std::size_t hi = t.size - 1;
+    while (hi - lo > 1)
+    {
+        const std::size_t mid = (lo + hi) / 2;
+        if (t.nV[mid] <= nV)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    const int32_t x0 = (t.t_min + int32_t(lo) * step_C) * 100;
+    return interpolate(nV, t.nV[lo], t.nV[hi], x0, x0 + step_C * 100);
+}
+
+bool tc_nV_in_range(tc_type_t type, int32_t nV)
+{
+    const TableView t = table_for(type);
+    return (nV >= t.nV[0]) && (nV <= t.nV[t.size - 1]);
+}
+
+int32_t tc_hot_junction_cC(tc_type_t type, int32_t measured_nV, int32_t cold_cC)
+{
+    return tc_cC_from_nV(type, measured_nV + tc_nV_from_cC(type, cold_cC));
+}
+
+int32_t tc_calibrate(const tc_calibration_t *cal, int32_t t_cC)
+{
+    if (!cal || (cal->count == 0))
+        return t_cC;
+
+    if (cal->count == 1)
+        return t_cC + cal->actual_cC[0] - cal->measured_cC[0];
+
+    // Segment containing t, or the nearest end segment.
+    int i = 0;
+    while ((i < cal->count - 2) && (t_cC > cal->measured_cC[i + 1]))
+        i++;
+
+    return interpolate(t_cC, cal->measured_cC[i], cal->measured_cC[i + 1],
+                       cal->actual_cC[i], cal->actual_cC[i + 1]);
+}
+
+uint8_t tc_mcp9600_type(tc_type_t type)
+{
+    // Type register bits 6:4, K = 0, J = 1.
+    return (type == TC_TYPE_J) ? 0x1 : 0x0;
+}
+
+const char *tc_type_name(tc_type_t type)
+{
+    switch (type)
+    {
+    case TC_TYPE_K:     return "K";
+    case TC_TYPE_J:     return "J";
+    case TC_TYPE_COUNT: break;
+    }
+    return "";
+}
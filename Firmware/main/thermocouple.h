@@ -0,0 +1,61 @@
+#ifndef THERMOCOUPLE_H
+#define THERMOCOUPLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Thermocouple linearization in fixed point, NIST ITS-90 reference functions.
+ *
+ * The thermocouple voltage only depends on the difference between the hot and cold
+ *   junctions through a non-linear function E(T). So the cold junction temperature is
+ *   turned into the voltage it would produce, added to the measured voltage, and the
+ *   sum turned back into a temperature.
+ * E(T) is tabulated at compile time; both directions interpolate in that table.
+ * Voltages are nV, temperatures centi-C.
+ */
+
+typedef enum
+{
+    TC_TYPE_K,
+    TC_TYPE_J,
+    TC_TYPE_COUNT
+} tc_type_t;
+
+#define TC_CAL_POINTS 4
+
+// Multi-point calibration: what the probe read (measured) against the reference.
+//   One point is an offset, more are joined by straight lines and the end
+//   segments extended.
+typedef struct
+{
+    uint8_t count;
+    int32_t measured_cC[TC_CAL_POINTS]; // ascending
+    int32_t actual_cC[TC_CAL_POINTS];
+} tc_calibration_t;
+
+// E(T) for a junction at t_cC referenced to 0C.
+extern int32_t tc_nV_from_cC(tc_type_t type, int32_t t_cC);
+// Inverse of the above. Clamps to the ends of the type's range.
+extern int32_t tc_cC_from_nV(tc_type_t type, int32_t nV);
+// False for a voltage no junction of this type could produce, an open or miswired input.
+extern bool tc_nV_in_range(tc_type_t type, int32_t nV);
+
+// Hot junction temperature from the measured thermocouple voltage and the cold
+//   junction temperature.
+extern int32_t tc_hot_junction_cC(tc_type_t type, int32_t measured_nV, int32_t cold_cC);
+
+extern int32_t tc_calibrate(const tc_calibration_t *cal, int32_t t_cC);
+
+// MCP9600 thermocouple type register encoding.
+extern uint8_t tc_mcp9600_type(tc_type_t type);
+extern const char *tc_type_name(tc_type_t type);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // THERMOCOUPLE_H
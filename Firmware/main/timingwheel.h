@@ -0,0 +1,153 @@
+#ifndef TIMINGWHEEL_H
+#define TIMINGWHEEL_H
+
+#include <array>
+#include <cstdint>
+
+/* Hierarchical timing wheel (Varghese & Lauck, "Hashed and Hierarchical Timing Wheels").
+ *
+ * Each level has 2^SlotBits slots. Level 0 slots are one tick wide, level 1 slots
+ *   are 2^SlotBits ticks wide, and so on. A timer is filed in the lowest level whose
+ *   span covers its remaining time and is pushed down a level ("cascaded") when the
+ *   wheel below wraps around to it.
+ *
+ * Scheduling and cancelling are O(1) list operations on an intrusive node, and each
+ *   tick touches at most one slot per level, so the cost of a tick does not depend on
+ *   how many timers are pending.
+ */
+
+struct TimingWheelNode
+{
+    TimingWheelNode *prev { nullptr };
+    TimingWheelNode *next { nullptr };
+    uint32_t expires { 0 }; // absolute tick
+
+    TimingWheelNode() = default;
+
+    // Nodes are linked by address, so a copy always starts out unscheduled.
+    TimingWheelNode(const TimingWheelNode &) {}
+    TimingWheelNode &operator=(const TimingWheelNode &) { return *this; }
+
+    ~TimingWheelNode() { unlink(); }
+
+    bool scheduled() const { return next != nullptr; }
+
+    void unlink()
+    {
+        if (!scheduled())
+            return;
+
+        prev->next = next;
+        next->prev = prev;
+        prev = next = nullptr;
+    }
+};
+
+template <unsigned SlotBits = 6, unsigned Levels = 3>
+class TimingWheel
+{
+    static constexpr uint32_t Slots = 1u << SlotBits;
+    static constexpr uint32_t Mask = Slots - 1;
+
+    // Each slot is the sentinel of a circular list.
+    std::array<std::array<TimingWheelNode, Slots>, Levels> m_slots;
+    uint32_t m_now { 0 };
+
+    static uint32_t span(unsigned level)
+    {
+        return 1u << (SlotBits * level);
+    }
+
+    void insert(TimingWheelNode &node)
+    {
+        const uint32_t delta = node.expires - m_now;
+
+        unsigned level = 0;
+        while ((level + 1 < Levels) && (delta >= span(level + 1)))
+            level++;
+
+        TimingWheelNode &head = m_slots[level][(node.expires >> (SlotBits * level)) & Mask];
+        node.prev = head.prev;
+        node.next = &head;
+        head.prev->next = &node;
+        head.prev = &node;
+    }
+
+    void cascade(unsigned level, uint32_t slot)
+    {
+        TimingWheelNode &head = m_slots[level][slot];
+        while (head.next != &head)
+        {
+            TimingWheelNode &node = *head.next;
+            node.unlink();
+            insert(node);
+        }
+    }
+
+public:
+    TimingWheel()
+    {
+        for (auto &level : m_slots)
+            for (auto &head : level)
+                head.prev = head.next = &head;
+    }
+
+    TimingWheel(const TimingWheel &) = delete;
+    TimingWheel &operator=(const TimingWheel &) = delete;
+
+    // Longest delay the wheel can represent; longer requests are clamped.
+    static constexpr uint32_t range()
+    {
+        return (1u << (SlotBits * Levels)) - 1;
+    }
+
+    uint32_t now() const
+    {
+        return m_now;
+    }
+
+    // Fire the node after 'delay' ticks (at least one).
+    void schedule(TimingWheelNode &node, uint32_t delay)
+    {
+        node.unlink();
+
+        if (delay < 1)
+            delay = 1;
+        if (delay > range())
+            delay = range();
+
+        node.expires = m_now + delay;
+        insert(node);
+    }
+
+    void cancel(TimingWheelNode &node)
+    {
+        node.unlink();
+    }
+
+    // Advance one tick and hand every expired node to fire(TimingWheelNode &).
+    // The node is unlinked before fire() is called, so it may be rescheduled or destroyed.
+    template <typename F>
+    void tick(F &&fire)
+    {
+        m_now++;
+
+        for (unsigned level = 1; level < Levels; level++)
+        {
+            if (m_now & (span(level) - 1))
+                break;
+
+            cascade(level, (m_now >> (SlotBits * level)) & Mask);
+        }
+
+        TimingWheelNode &head = m_slots[0][m_now & Mask];
+        while (head.next != &head)
+        {
+            TimingWheelNode &node = *head.next;
+            node.unlink();
+            fire(node);
+        }
+    }
+};
+
+#endif // TIMINGWHEEL_H
@@ -0,0 +1,376 @@
+#include "trace.h"
+#include "binlog.h"
+#include "mcp9600.h"
+#include "httpd.h"
+
+#include "esp_heap_caps.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/* The ring holds records back to back, each after its uint16 length. head and tail
+ *   count bytes ever written, so they only grow and the position in the ring is the
+ *   low bits. The control task is the only writer: it moves tail past whole records to
+ *   make room, then writes. Readers copy a record out and then check that tail hasn't
+ *   passed it meanwhile, so they never need a lock.
+ */
+_Static_assert((TRACE_RING_SIZE & (TRACE_RING_SIZE - 1)) == 0, "ring size must be a power of two");
+#define MASK (TRACE_RING_SIZE - 1)
+
+static uint8_t *ring = NULL;
+static uint32_t head = 0;
+static uint32_t tail = 0;
+
+static volatile bool enabled = false;
+static bool start_requested = false;    // by POST /set_trace, for the control task
+static trace_header_t header = { .type = TRACE_HEADER, .version = TRACE_VERSION };
+
+// The tick being recorded, control task only.
+static uint32_t tick_seq = 0;
+static bool recording = false;
+static trace_tick_t tick;
+static trace_bay_t bay;
+static bool bay_changed = false;
+static trace_sample_t samples[TRACE_MAX_SAMPLES];
+static uint8_t record[TRACE_RECORD_MAX + 1];
+
+// POSTs waiting for the next tick.
+typedef struct
+{
+    trace_command_t c;
+    char uri[TRACE_URI_LEN];
+    char content[TRACE_CONTENT_LEN];
+} command_t;
+
+static portMUX_TYPE command_mux = portMUX_INITIALIZER_UNLOCKED;
+static command_t commands[TRACE_MAX_COMMANDS];
+static uint8_t command_count = 0;
+
+// Taken for the tick when it starts, anything later was applied after it.
+static command_t tick_commands[TRACE_MAX_COMMANDS];
+
+static void copy_in(uint32_t pos, const void *data, uint32_t len)
+{
+    const uint32_t at = pos & MASK;
+    const uint32_t first = (len < TRACE_RING_SIZE - at) ? len : TRACE_RING_SIZE - at;
+    memcpy(ring + at, data, first);
+    memcpy(ring, (const uint8_t *)data + first, len - first);
+}
+
+static void copy_out(uint32_t pos, void *data, uint32_t len)
+{
+    const uint32_t at = pos & MASK;
+    const uint32_t first = (len < TRACE_RING_SIZE - at) ? len : TRACE_RING_SIZE - at;
+    memcpy(data, ring + at, first);
+    memcpy((uint8_t *)data + first, ring, len - first);
+}
+
+static void ring_write(const uint8_t *data, uint16_t len)
+{
+    const uint32_t need = len + sizeof(len);
+
+    uint32_t t = tail;
+    while (head + need - t > TRACE_RING_SIZE)
+    {
+        uint16_t old;
+        copy_out(t, &old, sizeof(old));
+        t += old + sizeof(old);
+    }
+    __atomic_store_n(&tail, t, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    copy_in(head, &len, sizeof(len));
+    copy_in(head + sizeof(len), data, len);
+    __atomic_store_n(&head, head + need, __ATOMIC_RELEASE);
+}
+
+// Copy out the record at *cursor and step past it. False when caught up.
+static bool ring_read(uint32_t *cursor, uint8_t *data, uint16_t *len)
+{
+    while (1)
+    {
+        if (*cursor == __atomic_load_n(&head, __ATOMIC_ACQUIRE))
+            return false;
+
+        // Lapped, carry on from the oldest record.
+        const uint32_t t = __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+        if ((int32_t)(*cursor - t) < 0)
+            *cursor = t;
+
+        uint16_t n;
+        copy_out(*cursor, &n, sizeof(n));
+        if (n <= TRACE_RECORD_MAX)
+            copy_out(*cursor + sizeof(n), data, n);
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if ((int32_t)(*cursor - __atomic_load_n(&tail, __ATOMIC_ACQUIRE)) < 0)
+            continue;
+
+        *len = n;
+        *cursor += n + sizeof(n);
+        return true;
+    }
+}
+
+static void start()
+{
+    header.present = 0;
+    for (int i = 0; i < MCP9600_MAX_PROBES; i++)
+        if (mcp9600_present(i))
+            header.present |= 1 << i;
+    header.first_tick = tick_seq + 1;
+
+    portENTER_CRITICAL(&command_mux);
+    command_count = 0;
+    portEXIT_CRITICAL(&command_mux);
+
+    // Whatever is left from an earlier trace can't be replayed with this header.
+    __atomic_store_n(&tail, head, __ATOMIC_RELEASE);
+    enabled = true;
+}
+
+static bool allocate()
+{
+#if CONFIG_SPIRAM
+    const uint32_t caps = MALLOC_CAP_SPIRAM;
+#else
+    const uint32_t caps = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+#endif
+
+    if (!ring)
+        ring = heap_caps_malloc(TRACE_RING_SIZE, caps);
+    if (!ring)
+        BINLOG(BL_TRACE_NO_MEMORY, TRACE_RING_SIZE);
+    return ring != NULL;
+}
+
+void trace_init()
+{
+    nvs_handle_t nvs;
+    uint8_t on = 0;
+    if (ESP_OK == nvs_open("trace", NVS_READONLY, &nvs))
+    {
+        nvs_get_u8(nvs, "on", &on);
+        nvs_close(nvs);
+    }
+
+    if (on && allocate())
+    {
+        start();
+        printf("Tracing the control loop\n");
+    }
+}
+
+bool trace_enabled()
+{
+    return enabled;
+}
+
+void trace_tick_begin(int64_t now_us, uint32_t time, uint8_t inputs)
+{
+    // start() moves tail and rewrites the header, so only the writer may run it.
+    if (__atomic_exchange_n(&start_requested, false, __ATOMIC_ACQ_REL))
+        start();
+
+    tick_seq++;
+    recording = enabled;
+    if (!recording)
+        return;
+
+    tick.type = TRACE_TICK;
+    tick.inputs = inputs;
+    tick.samples = 0;
+    tick.seq = tick_seq;
+    tick.now_us = now_us;
+    tick.time = time;
+
+    portENTER_CRITICAL(&command_mux);
+    memcpy(tick_commands, commands, command_count * sizeof(command_t));
+    tick.commands = command_count;
+    command_count = 0;
+    portEXIT_CRITICAL(&command_mux);
+}
+
+void trace_bay(const bay_reading_t *reading)
+{
+    if (!recording)
+        return;
+
+    const trace_bay_t b = {
+        .ok = reading->ok,
+        .temp_cC = reading->temp_cC,
+        .humidity_c = reading->humidity_c,
+        .age_us = (int32_t)(tick.now_us - reading->time_us),
+        .errors = reading->errors,
+    };
+
+    // Always in the first tick, so a replay has it from the start.
+    bay_changed = (tick.seq == header.first_tick) || (b.ok != bay.ok) || (b.temp_cC != bay.temp_cC) ||
+                  (b.humidity_c != bay.humidity_c) || (b.errors != bay.errors);
+    bay = b;
+}
+
+void trace_sample(const sample_t *sample)
+{
+    if (!recording || (tick.samples == TRACE_MAX_SAMPLES))
+        return;
+
+    trace_sample_t *s = &samples[tick.samples++];
+    s->age_us = (int32_t)(tick.now_us - sample->time_us);
+    s->value = sample->value;
+    s->flags = sample->flags;
+    s->source = sample->source;
+}
+
+void trace_tick_end(uint16_t outputs, int32_t target_cF)
+{
+    if (!recording)
+        return;
+
+    tick.outputs = outputs;
+    tick.target_cF = target_cF;
+    if (bay_changed)
+        tick.inputs |= TRACE_IN_BAY;
+
+    int len = sizeof(tick);
+    if (bay_changed)
+    {
+        memcpy(record + len, &bay, sizeof(bay));
+        len += sizeof(bay);
+    }
+    memcpy(record + len, samples, tick.samples * sizeof(trace_sample_t));
+    len += tick.samples * sizeof(trace_sample_t);
+
+    for (int i = 0; i < tick.commands; i++)
+    {
+        const command_t *c = &tick_commands[i];
+        memcpy(record + len, &c->c, sizeof(c->c));
+        len += sizeof(c->c);
+        memcpy(record + len, c->uri, c->c.uri_len);
+        len += c->c.uri_len;
+        memcpy(record + len, c->content, c->c.content_len);
+        len += c->c.content_len;
+    }
+
+    memcpy(record, &tick, sizeof(tick));
+    ring_write(record, len);
+    bay_changed = false;
+}
+
+void trace_command(const char *uri, const char *content)
+{
+    if (!enabled)
+        return;
+
+    command_t c;
+    c.c.uri_len = strnlen(uri, sizeof(c.uri));
+    c.c.content_len = strnlen(content, sizeof(c.content));
+    memcpy(c.uri, uri, c.c.uri_len);
+    memcpy(c.content, content, c.c.content_len);
+
+    portENTER_CRITICAL(&command_mux);
+    if (command_count < TRACE_MAX_COMMANDS)
+        commands[command_count++] = c;
+    portEXIT_CRITICAL(&command_mux);
+}
+
+static int header_line(char *line)
+{
+    uint8_t data[sizeof(header) + 1];
+    memcpy(data, &header, sizeof(header));
+    return binlog_frame(line, TRACE_TAG, data, sizeof(header));
+}
+
+bool trace_console()
+{
+    // binlog task only.
+    static uint32_t cursor = 0;
+    static uint32_t first_tick = 0;
+    static uint8_t data[TRACE_RECORD_MAX + 1];
+    static char line[BINLOG_LINE_SIZE(TRACE_RECORD_MAX)];
+
+    if (!enabled)
+        return false;
+
+    // A new trace, start it with its header.
+    if (first_tick != header.first_tick)
+    {
+        first_tick = header.first_tick;
+        cursor = __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+        fwrite(line, 1, header_line(line), stdout);
+    }
+
+    bool any = false;
+    uint16_t len;
+    while (ring_read(&cursor, data, &len))
+    {
+        fwrite(line, 1, binlog_frame(line, TRACE_TAG, data, len), stdout);
+        any = true;
+    }
+    return any;
+}
+
+esp_err_t get_trace(httpd_req_t *req)
+{
+    // The server runs one handler at a time.
+    static uint8_t data[TRACE_RECORD_MAX + 1];
+    static char buf[2048];
+
+    httpd_resp_set_type(req, "text/plain");
+    if (!ring)
+        return httpd_resp_send(req, "", 0);
+
+    int len = header_line(buf);
+    esp_err_t err = ESP_OK;
+
+    // Only what was there when we started, a running trace would never end.
+    uint32_t cursor = __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+    const uint32_t end = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+    uint16_t n;
+    while ((err == ESP_OK) && ((int32_t)(end - cursor) > 0) && ring_read(&cursor, data, &n))
+    {
+        if (len + BINLOG_LINE_SIZE(n) > sizeof(buf))
+        {
+            err = httpd_resp_send_chunk(req, buf, len);
+            len = 0;
+        }
+        len += binlog_frame(buf + len, TRACE_TAG, data, n);
+    }
+
+    if (err == ESP_OK)
+        err = httpd_resp_send_chunk(req, buf, len);
+    if (err != ESP_OK)
+        return err;
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+esp_err_t set_trace(httpd_req_t *req)
+{
+    char content[8];
+    if (ESP_OK != get_content(req, content, sizeof(content)))
+        return ESP_FAIL;
+
+    // Started by the control task at its next tick.
+    const bool on = !strcmp(content, "1") && allocate();
+    if (on && !enabled)
+    {
+        __atomic_store_n(&start_requested, true, __ATOMIC_RELEASE);
+    }
+    else if (!on)
+    {
+        __atomic_store_n(&start_requested, false, __ATOMIC_RELEASE);
+        enabled = false;
+    }
+
+    nvs_handle_t nvs;
+    if (ESP_OK == nvs_open("trace", NVS_READWRITE, &nvs))
+    {
+        if (ESP_OK == nvs_set_u8(nvs, "on", on))
+            nvs_commit(nvs);
+        nvs_close(nvs);
+    }
+
+    return ack_http_post(req);
+}
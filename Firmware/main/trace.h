@@ -0,0 +1,141 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "bay_sensor.h"
+#include "sample_ring.h"
+#include "esp_http_server.h"
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Trace of everything the control loop reads, so a cook can be replayed on the host.
+ *
+ * When enabled every tick records what StoveCtrl acted on: the time, the Cancel, door and
+ *   over temperature inputs, the probe samples it took from the ring, the bay reading
+ *   when it changed, and the POSTs that came in since the tick before. The outputs it
+ *   drove are recorded too, so a replay can tell where it goes another way.
+ * Records go to a ring, and out on the console as binlog lines tagged 'T' for as long
+ *   as someone is capturing. GET /trace dumps the ring in the same format. The replay
+ *   tool under replay/ feeds either back through a host build of StoveCtrl and the
+ *   cook timers.
+ * A tick is ~40 bytes, so with PSRAM (sdkconfig.wrover) the ring holds about 20
+ *   minutes. Without it the ring is in internal RAM and only covers ~20s, enough to
+ *   ride out the console falling behind; long traces are captured from the console.
+ * Tracing is switched with POST /set_trace (1 or 0) and kept in NVS, so a trace can be
+ *   taken from boot.
+ */
+
+#define TRACE_TAG           'T'
+#define TRACE_VERSION       1
+#if CONFIG_SPIRAM
+#define TRACE_RING_SIZE     (1024 * 1024)
+#else
+#define TRACE_RING_SIZE     (16 * 1024)
+#endif
+
+#define TRACE_MAX_SAMPLES   8       // per tick, more than a tick ever sees
+#define TRACE_MAX_COMMANDS  4       // POSTs between two ticks
+#define TRACE_URI_LEN       24
+#define TRACE_CONTENT_LEN   128
+
+enum
+{
+    TRACE_HEADER = 1,
+    TRACE_TICK = 2,
+};
+
+// trace_tick_t.inputs
+#define TRACE_IN_CANCEL     (1 << 0)    // Cancel button held
+#define TRACE_IN_DOOR_OPEN  (1 << 1)
+#define TRACE_IN_OVER_TEMP  (1 << 2)    // alert line asserted
+#define TRACE_IN_TRIPPED    (1 << 3)    // the alert ISR ran since the tick before
+#define TRACE_IN_BAY        (1 << 4)    // a trace_bay_t follows
+
+// trace_tick_t.outputs, the low bits as history_record_t.outputs
+#define TRACE_OUT_BAKE      (1 << 6)
+#define TRACE_OUT_BROIL     (1 << 7)
+#define TRACE_OUT_MODE(o)   (((o) >> 8) & 0x3)  // StoveCtrlMode
+
+// All records are packed little endian, starting with their type.
+typedef struct __attribute__((packed))
+{
+    uint8_t type;           // TRACE_HEADER
+    uint8_t version;
+    uint8_t present;        // bit per MCP9600 probe fitted
+    uint8_t reserved;
+    uint32_t first_tick;    // seq of the first tick traced
+} trace_header_t;
+
+typedef struct __attribute__((packed))
+{
+    uint8_t type;           // TRACE_TICK
+    uint8_t inputs;
+    uint8_t samples;        // trace_sample_t that follow
+    uint8_t commands;       // trace_command_t that follow
+    uint32_t seq;           // control loop tick number
+    int64_t now_us;         // esp_timer_get_time() for the tick
+    uint32_t time;          // unix seconds
+    uint16_t outputs;       // after the tick
+    int32_t target_cF;      // after the tick
+} trace_tick_t;
+
+// Followed in order by the bay reading, the samples, then the commands.
+typedef struct __attribute__((packed))
+{
+    uint8_t ok;
+    int32_t temp_cC;
+    int32_t humidity_c;
+    int32_t age_us;         // now_us - time_us
+    uint32_t errors;
+} trace_bay_t;
+
+typedef struct __attribute__((packed))
+{
+    int32_t age_us;         // now_us - time_us
+    int32_t value;
+    uint16_t flags;
+    uint16_t source;
+} trace_sample_t;
+
+// uri_len bytes of uri, then content_len of the POST body, neither terminated.
+typedef struct __attribute__((packed))
+{
+    uint8_t uri_len;
+    uint8_t content_len;
+} trace_command_t;
+
+#define TRACE_RECORD_MAX (sizeof(trace_tick_t) + sizeof(trace_bay_t) + \
+                          TRACE_MAX_SAMPLES * sizeof(trace_sample_t) + \
+                          TRACE_MAX_COMMANDS * (sizeof(trace_command_t) + TRACE_URI_LEN + TRACE_CONTENT_LEN))
+
+// Reads the setting from NVS and allocates the ring if tracing is on.
+extern void trace_init();
+extern bool trace_enabled();
+
+// From the control task, in this order, once per tick.
+extern void trace_tick_begin(int64_t now_us, uint32_t time, uint8_t inputs);
+extern void trace_bay(const bay_reading_t *bay);
+extern void trace_sample(const sample_t *sample);
+extern void trace_tick_end(uint16_t outputs, int32_t target_cF);
+
+// A POST body, from get_content(). Lands in the next tick.
+extern void trace_command(const char *uri, const char *content);
+
+// Send records not yet on the console, from the binlog task. True if there were any.
+extern bool trace_console();
+
+// GET /trace, header and ring as console lines. Empty if the ring couldn't be had.
+extern esp_err_t get_trace(httpd_req_t *req);
+// POST /set_trace, "1" or "0".
+extern esp_err_t set_trace(httpd_req_t *req);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TRACE_H
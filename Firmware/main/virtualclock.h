@@ -0,0 +1,45 @@
+#ifndef VIRTUALCLOCK_H
+#define VIRTUALCLOCK_H
+
+#include <chrono>
+#include <cstdint>
+
+/* A steady clock that only moves when told to.
+ *
+ * Host builds use it in place of std::chrono::steady_clock so timer scenarios
+ *   (hours long cook programs, pause/resume, removal mid-run) can be stepped
+ *   through instantly and give the same result every time.
+ */
+struct VirtualClock
+{
+    using rep = int64_t;
+    using period = std::micro;
+    using duration = std::chrono::duration<rep, period>;
+    using time_point = std::chrono::time_point<VirtualClock>;
+    static constexpr bool is_steady = true;
+
+    static time_point now()
+    {
+        return time_point(offset());
+    }
+
+    static void advance(duration d)
+    {
+        offset() += d;
+    }
+
+    // ElapsedTimer treats time_point{} as "not running", so never hand that out.
+    static void reset()
+    {
+        offset() = std::chrono::seconds(1);
+    }
+
+private:
+    static duration &offset()
+    {
+        static duration d = std::chrono::seconds(1);
+        return d;
+    }
+};
+
+#endif // VIRTUALCLOCK_H
@@ -183,6 +183,33 @@ function to_time(seconds)
     return new Date(seconds * 1000).toISOString().slice(11, 19);
 }
 
+// The oven's monotonic clock (ms) minus ours, measured on the last timer fetch
+clock_offset = 0
+timers = []
+timers_version = -1
+
+function device_now()
+{
+    return Date.now() + clock_offset;
+}
+
+// Time left on the timer, or how long until a preheat timer starts counting
+function remaining_text(timer)
+{
+    if (timer.waiting)
+    {
+        if (timer.starts_in < 0)
+            return "preheating";
+
+        return "starts in " + to_time(timer.starts_in);
+    }
+
+    if (timer.deadline >= 0)
+        return to_time(Math.max(0, Math.round((timer.deadline - device_now()) / 1000)));
+
+    return to_time(timer.duration - timer.elapsed);
+}
+
 function add_timer(timer)
 {
     var tr = document.createElement('TR');
@@ -201,7 +228,7 @@ function add_timer(timer)
     if (argument_val == undefined)
         argument_val = "";
 
-    td[0].appendChild(document.createTextNode(to_time(timer.duration - timer.elapsed)));
+    td[0].appendChild(document.createTextNode(remaining_text(timer)));
     td[1].appendChild(document.createTextNode(to_time(timer.duration)));
     td[2].appendChild(document.createTextNode(argument_val));
     td[3].appendChild(document.createTextNode(timer.action));
@@ -224,7 +251,10 @@ function update_timer(timer)
     if (argument_val == undefined)
         argument_val = "";
 
-    elapsed.innerHTML = to_time(timer.duration - timer.elapsed);
+    if (timer.probe >= 0)
+        argument_val += " until " + probe_name(timer.probe) + " " + timer.until + "&#8457;";
+
+    elapsed.innerHTML = remaining_text(timer);
     duration.innerHTML = to_time(timer.duration);
     argument.innerHTML = argument_val;
     action.value = timer.action;
@@ -295,6 +325,9 @@ function make_timer()
     var new_duration = document.getElementById("new_task_hour").value;
     var new_action   = document.getElementById("new_timer_action").value;
     var new_argument = document.getElementById("new_task_argument").value;
+    var new_preheat  = document.getElementById("new_task_preheat").checked;
+    var new_probe    = document.getElementById("new_task_probe").value;
+    var new_until    = document.getElementById("new_task_until").value;
 
     if ((new_action == "") || (new_duration == ""))
     {
@@ -326,9 +359,16 @@ function make_timer()
     var data = {
         duration: new_duration * 3600,
         argument: new_argument,
-        action:   new_action
+        action:   new_action,
+        preheat:  new_preheat ? 1 : 0
     };
 
+    if ((new_probe >= 0) && (new_until != ""))
+    {
+        data.probe = new_probe;
+        data.until = new_until;
+    }
+
     $.ajax({
         type:'post',
         url:'add_timer',
@@ -359,9 +399,83 @@ function set_input_state(state)
     document.getElementById("use_top_element-input").checked = state.use_top_burner;
 }
 
+// Probes from the last state, [{index, name, temp, rate, ok}], the oven is index 0.
+probes = []
+
+function probe_name(index)
+{
+    for (const probe of probes)
+        if (probe.index == index)
+            return probe.name;
+    return "probe" + index;
+}
+
+function show_probes(new_probes)
+{
+    var text = "";
+    for (const probe of new_probes)
+    {
+        if (probe.index == 0)
+            continue;
+        var reading = probe.ok ? parseFloat(probe.temp).toFixed(1) + "&#8457;" : "no reading";
+        if (probe.faults)
+            reading = probe.faults.replace(/_/g, " ");
+        text += probe.name + ": " + reading + "<br/>";
+    }
+    document.getElementById("act_probes").innerHTML = text;
+
+    // Rebuild the probe choices only when the set of probes changes.
+    var names = new_probes.map(p => p.index + p.name).join();
+    if (names == probes.map(p => p.index + p.name).join())
+    {
+        probes = new_probes;
+        return;
+    }
+    probes = new_probes;
+
+    var select = document.getElementById("new_task_probe");
+    select.length = 1;
+    for (const probe of probes)
+    {
+        if (probe.index == 0)
+            continue;
+        var option = document.createElement("option");
+        option.value = probe.index;
+        option.text = probe.name;
+        select.add(option);
+    }
+}
+
 function set_temp_state(state)
 {
-    document.getElementById("act_current_temp").innerHTML = parseFloat(state.current_temp).toFixed(2) + "&#8457;";
+    var current = parseFloat(state.current_temp).toFixed(2) + "&#8457;";
+    var rate = parseFloat(state.temp_rate) * 60;
+    if (Math.abs(rate) >= 1)
+        current += " (" + (rate > 0 ? "+" : "") + rate.toFixed(0) + "&#8457;/min)";
+    var oven_faults = (state.probes != undefined && state.probes.length) ? state.probes[0].faults : "";
+    if (state.sensor_ok == false && oven_faults)
+        current += " (" + oven_faults.replace(/_/g, " ") + ", heat held off)";
+    else if (state.sensor_ok == false)
+        current += " (no reading for " + Math.round(state.sensor_age_ms / 1000) + "s, heat held off)";
+    document.getElementById("act_current_temp").innerHTML = current;
+
+    if (state.faults != undefined)
+        document.getElementById("act_faults").innerHTML = state.faults ? "Fault: " + state.faults.replace(/_/g, " ").replace(/,/g, ", ") : "";
+
+    if (state.probes != undefined)
+        show_probes(state.probes);
+
+    if (state.bay_ok != undefined)
+    {
+        var bay = "no reading";
+        if (state.bay_ok)
+            bay = parseFloat(state.bay_temp).toFixed(0) + "&#8457; " + parseFloat(state.bay_humidity).toFixed(0) + "%RH";
+        if (state.bay_fan)
+            bay += ", fan on";
+        if (state.bay_overheat)
+            bay += ", too hot to cook!";
+        document.getElementById("act_bay").innerHTML = "Electronics bay: " + bay;
+    }
     document.getElementById("act_target_temp").innerHTML = state.target_temp + "&#8457;";
 }
 
@@ -378,23 +492,34 @@ function set_state(state)
     }
 
     set_temp_state(state);
+
+    // Waiting timers carry a preheat estimate which moves without the list changing.
+    var waiting = timers.some(function(t) { return t.waiting; });
+    if ((state.timers_version != timers_version) || (waiting && (update_counter % 5 == 0)))
+        fetch_timers();
 }
 
-// Schedule getting the cook timers
-function get_timers()
+function fetch_timers()
 {
-    var call = function() { $.ajax({
+    $.ajax({
         type:'get',
         url:'get_timers.json',
         success: function(data)
         {
+            clock_offset = data.now - Date.now();
+            timers_version = data.version;
             timers = data.timers;
             show_timers(timers);
         }
-    })};
+    });
+}
 
-    setInterval(call, 1000);
-    call();
+// Count the cook timers down locally. The oven is only asked again when
+//   get_state.json reports a new timers_version.
+function get_timers()
+{
+    setInterval(function() { show_timers(timers); }, 1000);
+    fetch_timers();
 }
 
 // Schedule getting the oven status
@@ -413,6 +538,279 @@ function get_state()
     call();
 }
 
+// Chart of the last hour: temperature and setpoint, element duty underneath.
+// Points are [seq, time, temp, target, bake %, broil %, outputs, {probe: temp}] as
+//   /history sends them, one a second, so the chart runs on seq rather than the oven's
+//   wall clock.
+const chart_span_s = 3600;
+chart_points = []
+history_last = 0       // seq of the newest point we have
+history_fetching = false
+history_again = false  // a point arrived mid-fetch that the fetch may not cover
+
+function add_points(points)
+{
+    for (const point of points)
+    {
+        if (point[0] <= history_last)
+            continue;
+        chart_points.push(point);
+        history_last = point[0];
+    }
+
+    while (chart_points.length && (chart_points[0][0] <= history_last - chart_span_s))
+        chart_points.shift();
+
+    draw_chart();
+}
+
+// Everything after history_last, in pages. The first time only the last hour of it.
+function fetch_history()
+{
+    if (history_fetching)
+    {
+        history_again = true;
+        return;
+    }
+    history_fetching = true;
+    history_again = false;
+
+    var since = history_last;
+    var sizing = (history_last == 0); // only asking how far the oven has got
+    var done = function()
+    {
+        history_fetching = false;
+        if (history_again)
+            fetch_history();
+    };
+
+    var page = function()
+    {
+        $.ajax({
+            type:'get',
+            url:'history?res=1&max=' + (sizing ? 0 : 600) + '&since=' + since,
+            success: function(data)
+            {
+                // The oven has rebooted, its numbering starts over.
+                if (data.next <= history_last)
+                {
+                    chart_points = [];
+                    history_last = 0;
+                    sizing = true;
+                    page();
+                    return;
+                }
+
+                if (sizing)
+                {
+                    sizing = false;
+                    since = Math.max(0, data.next - 1 - chart_span_s);
+                    page();
+                    return;
+                }
+
+                add_points(data.points);
+                since = data.last;
+                if (data.more)
+                    page();
+                else
+                    done();
+            },
+            error: done
+        });
+    };
+
+    page();
+}
+
+function chart_point(point)
+{
+    if (point[0] == history_last + 1)
+        add_points([point]);
+    else if (point[0] > history_last + 1)
+        fetch_history();
+}
+
+function draw_chart()
+{
+    var canvas = document.getElementById("chart");
+    var scale = window.devicePixelRatio || 1;
+    var width = canvas.clientWidth * scale;
+    var height = canvas.clientHeight * scale;
+    if ((canvas.width != width) || (canvas.height != height))
+    {
+        canvas.width = width;
+        canvas.height = height;
+    }
+
+    var ctx = canvas.getContext("2d");
+    ctx.clearRect(0, 0, width, height);
+    if (chart_points.length < 2)
+        return;
+
+    // The newest point at the right edge.
+    var x = function(point) { return width - (history_last - point[0]) * width / chart_span_s; };
+
+    // Duty in the bottom fifth, bake up from the bottom and broil stacked on it.
+    var duty_h = height / 5;
+    for (const point of chart_points)
+    {
+        var bake = point[4] * duty_h / 100;
+        var broil = point[5] * duty_h / 100;
+        var w = Math.max(1, width / chart_span_s);
+        ctx.fillStyle = "rgba(229, 87, 3, 0.6)";
+        ctx.fillRect(x(point), height - bake, w, bake);
+        ctx.fillStyle = "rgba(229, 172, 3, 0.6)";
+        ctx.fillRect(x(point), height - bake - broil, w, broil);
+    }
+
+    // Temperatures above it, scaled to what is on screen.
+    var low = Infinity, high = -Infinity;
+    var probes = [];
+    for (const point of chart_points)
+    {
+        low = Math.min(low, point[2], point[3] > 0 ? point[3] : point[2]);
+        high = Math.max(high, point[2], point[3]);
+        for (const name in (point[7] || {}))
+        {
+            low = Math.min(low, point[7][name]);
+            high = Math.max(high, point[7][name]);
+            if (!probes.includes(name))
+                probes.push(name);
+        }
+    }
+    low = Math.floor(low / 50) * 50;
+    high = Math.max(low + 50, Math.ceil(high / 50) * 50);
+
+    var temp_h = height - duty_h;
+    var y = function(temp) { return temp_h - (temp - low) * temp_h / (high - low); };
+
+    ctx.font = (12 * scale) + "px sans-serif";
+    ctx.fillStyle = "#888";
+    ctx.strokeStyle = "#ddd";
+    ctx.lineWidth = scale;
+    for (var t = low; t <= high; t += 50)
+    {
+        ctx.beginPath();
+        ctx.moveTo(0, y(t));
+        ctx.lineTo(width, y(t));
+        ctx.stroke();
+        ctx.fillText(t + "\u2109", 2 * scale, y(t) - 2 * scale);
+    }
+
+    // value(point) is undefined where the line has a gap.
+    var line = function(value, color, dash)
+    {
+        ctx.strokeStyle = color;
+        ctx.lineWidth = 2 * scale;
+        ctx.setLineDash(dash);
+        ctx.beginPath();
+        var pen_up = true;
+        var last;
+        for (const point of chart_points)
+        {
+            var v = value(point);
+            if (v === undefined)
+            {
+                pen_up = true;
+                continue;
+            }
+
+            if (pen_up)
+                ctx.moveTo(x(point), y(v));
+            else
+                ctx.lineTo(x(point), y(v));
+            pen_up = false;
+            last = v;
+        }
+        ctx.stroke();
+        ctx.setLineDash([]);
+        return last;
+    };
+
+    // No setpoint while the oven is off.
+    line(function(point) { return (point[3] > 0) ? point[3] : undefined; }, "#2196F3", [6 * scale, 4 * scale]);
+    line(function(point) { return point[2]; }, "rgb(229, 3, 56)", []);
+
+    // Food probes, named at the right edge where they end.
+    const probe_colors = ["#4CAF50", "#9C27B0", "#795548", "#009688", "#FF9800", "#607D8B", "#E91E63"];
+    probes.forEach(function(name, i)
+    {
+        var color = probe_colors[i % probe_colors.length];
+        var last = line(function(point) { return (point[7] || {})[name]; }, color, []);
+        if (last !== undefined)
+        {
+            ctx.fillStyle = color;
+            ctx.textAlign = "right";
+            ctx.fillText(name, width - 2 * scale, y(last) - 4 * scale);
+            ctx.textAlign = "left";
+        }
+    });
+}
+
+// Last event we were told about. On reconnect the oven replays everything after it.
+last_event_seq = 0
+
+function handle_event(ev)
+{
+    // Chart points aren't numbered with the events.
+    if (ev.type == "point")
+    {
+        chart_point(ev.point);
+        return;
+    }
+
+    last_event_seq = ev.seq;
+
+    switch (ev.type)
+    {
+    case "timer_fired":
+        console.log("Timer " + ev.argument + " fired");
+        fetch_timers();
+        if (ev.detail == "Alert Webpage")
+            alert("Timer done!");
+        break;
+
+    case "target_reached":
+        console.log("Reached " + ev.argument + "F");
+        break;
+
+    case "fault":
+        alert("Oven fault: " + ev.detail + " (" + ev.argument + "F)");
+        break;
+
+    case "recovered":
+        console.log("Recovered: " + ev.detail);
+        break;
+
+    case "lost":
+        console.log("Missed some events while disconnected");
+        break;
+    }
+}
+
+// Listen for pushed events, reconnecting whenever the socket drops
+function listen_events()
+{
+    var ws = new WebSocket("ws://" + window.location.host + "/events?since=" + last_event_seq);
+
+    // Catch up on the points missed while we were away.
+    ws.onopen = function()
+    {
+        fetch_history();
+    };
+
+    ws.onmessage = function(msg)
+    {
+        handle_event(JSON.parse(msg.data));
+    };
+
+    ws.onclose = function()
+    {
+        setTimeout(listen_events, 2000);
+    };
+}
+
 
 // READY! SET! GO!
 $(document).ready(function()
@@ -440,5 +838,10 @@ $(document).ready(function()
     resize_window();
     get_timers();
     get_state();
-    window.onresize = resize_window;
+    listen_events();
+    window.onresize = function()
+    {
+        resize_window();
+        draw_chart();
+    };
 });
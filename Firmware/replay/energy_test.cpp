@@ -0,0 +1,216 @@
+/* Host test: energy.c, the element on time meter. See Makefile, "make test".
+ *
+ * Drives energy_tick() the way the control task does, with the clock and the relays
+ *   chosen here, and checks what is metered for late, early and uneven ticks and when
+ *   the lifetime totals are handed to the writer. NVS and the writer task are stubs
+ *   that only count. Exits 1 if any check failed.
+ */
+
+#include "energy.h"
+
+#include "nvs.h"
+#include "freertos/task.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+
+static int checks = 0, failures = 0;
+
+#define CHECK(cond, ...)                                    \
+    do {                                                    \
+        checks++;                                           \
+        if (!(cond))                                        \
+        {                                                   \
+            failures++;                                     \
+            printf("%s:%d: ", __FILE__, __LINE__);          \
+            printf(__VA_ARGS__);                            \
+            printf("\n");                                   \
+        }                                                   \
+    } while (0)
+
+// What NVS holds, and how often the writer was woken.
+static uint64_t stored[2] = { 7200000, 3600000 };
+static int saves = 0;
+static bool writer_started = false;
+
+esp_err_t nvs_open(const char *, nvs_open_mode_t, nvs_handle_t *handle)
+{
+    *handle = 1;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t, const char *key, void *value, size_t *length)
+{
+    if (strcmp(key, "lifetime") || (*length < sizeof(stored)))
+        return ESP_ERR_NOT_FOUND;
+    memcpy(value, stored, sizeof(stored));
+    *length = sizeof(stored);
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t, const char *, const void *, size_t)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t)
+{
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t)
+{
+}
+
+BaseType_t xTaskCreate(TaskFunction_t, const char *, uint32_t, void *, UBaseType_t, TaskHandle_t *handle)
+{
+    static int task;
+    *handle = &task;
+    writer_started = true;
+    return pdTRUE;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t)
+{
+    saves++;
+    return pdTRUE;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t, TickType_t)
+{
+    return 0;
+}
+
+static const uint32_t tick_ms = 50;
+static int64_t now_us = 1000000;
+
+// One control tick, dt_us after the one before.
+static void tick(int64_t dt_us, bool bake, bool broil)
+{
+    now_us += dt_us;
+    energy_tick(bake, broil, now_us, tick_ms);
+}
+
+static void loads_lifetime()
+{
+    energy_init();
+    CHECK(writer_started, "writer task started");
+    CHECK(energy_lifetime().bake_ms == 7200000 && energy_lifetime().broil_ms == 3600000,
+          "lifetime loaded from NVS, %llu/%llu ms", (unsigned long long)energy_lifetime().bake_ms,
+          (unsigned long long)energy_lifetime().broil_ms);
+
+    // The first tick has nothing to measure from.
+    tick(0, true, false);
+    CHECK(energy_session().bake_ms == 0, "first tick counts nothing, got %llu ms",
+          (unsigned long long)energy_session().bake_ms);
+}
+
+static void counts_measured_time()
+{
+    energy_session_start();
+    for (int i = 0; i < 20; i++)
+        tick(50000, true, false);
+    for (int i = 0; i < 10; i++)
+        tick(50000, true, true);
+    for (int i = 0; i < 10; i++)
+        tick(50000, false, false);
+
+    CHECK(energy_session().bake_ms == 1500, "bake 1500 ms, got %llu", (unsigned long long)energy_session().bake_ms);
+    CHECK(energy_session().broil_ms == 500, "broil 500 ms, got %llu", (unsigned long long)energy_session().broil_ms);
+    CHECK(energy_lifetime().bake_ms == 7201500, "lifetime adds the same, got %llu",
+          (unsigned long long)energy_lifetime().bake_ms);
+
+    // Late ticks count what they were, as long as they are under two ticks.
+    energy_session_start();
+    tick(50000, true, false);
+    tick(80000, true, false);
+    tick(30000, true, false);
+    CHECK(energy_session().bake_ms == 160, "uneven ticks add up, got %llu", (unsigned long long)energy_session().bake_ms);
+}
+
+static void clamps_stalls_and_steps()
+{
+    energy_session_start();
+    tick(50000, true, false);
+
+    // A stall, or the clock stepping forward: two ticks' worth at most.
+    tick(10 * 1000000, true, false);
+    CHECK(energy_session().bake_ms == 150, "10s stall counts 2 ticks, got %llu",
+          (unsigned long long)energy_session().bake_ms);
+
+    // Back in time: nothing, and the next tick measures from the new time.
+    tick(-5 * 1000000, true, false);
+    CHECK(energy_session().bake_ms == 150, "negative interval counts nothing, got %llu",
+          (unsigned long long)energy_session().bake_ms);
+    tick(50000, true, false);
+    CHECK(energy_session().bake_ms == 200, "counting carries on after a step back, got %llu",
+          (unsigned long long)energy_session().bake_ms);
+}
+
+static void carries_sub_ms()
+{
+    energy_session_start();
+    tick(50000, false, false);
+
+    // 50.4 ms ticks: 0.4 ms a tick adds up rather than being dropped.
+    for (int i = 0; i < 100; i++)
+        tick(50400, false, true);
+    CHECK(energy_session().broil_ms == 5040, "100 ticks of 50.4 ms are 5040 ms, got %llu",
+          (unsigned long long)energy_session().broil_ms);
+
+    // The carry goes when the elements do, it is not added to the next time they come on.
+    tick(50600, false, true);
+    tick(50000, false, false);
+    tick(50500, false, true);
+    CHECK(energy_session().broil_ms == 5040 + 50 + 50, "carry dropped while off, got %llu",
+          (unsigned long long)energy_session().broil_ms);
+}
+
+static void saves_while_heating()
+{
+    // Start from nothing unsaved.
+    energy_session_end();
+    saves = 0;
+    energy_session_end();
+    CHECK(saves == 0, "nothing to save, nothing written");
+
+    // Heating from here on: the first save ENERGY_SAVE_S after the first unsaved on time.
+    energy_session_start();
+    const int64_t start_us = now_us;
+    int64_t first_save_us = 0;
+    for (int i = 0; i < 2 * ENERGY_SAVE_S * 20 + 10; i++)
+    {
+        tick(50000, true, false);
+        if (saves && !first_save_us)
+            first_save_us = now_us;
+    }
+
+    const double first_s = (first_save_us - start_us - 50000) / 1e6;
+    CHECK(first_save_us && (first_s >= ENERGY_SAVE_S) && (first_s < ENERGY_SAVE_S + 0.1),
+          "first save %.2fs into heating, want %d", first_s, ENERGY_SAVE_S);
+    CHECK(saves == 2, "%d saves in twice ENERGY_SAVE_S of heating", saves);
+
+    // Idle ticks add nothing, so there is nothing to save for them.
+    for (int i = 0; i < 2 * ENERGY_SAVE_S * 20; i++)
+        tick(50000, false, false);
+    CHECK(saves == 2, "no saves while idle, %d", saves);
+
+    // A cook ending saves what is outstanding at once, and only that.
+    energy_session_end();
+    CHECK(saves == 3, "end of a cook saves, %d", saves);
+    energy_session_end();
+    CHECK(saves == 3, "saved once, %d", saves);
+}
+
+int main()
+{
+    loads_lifetime();
+    counts_measured_time();
+    clamps_stalls_and_steps();
+    carries_sub_ms();
+    saves_while_heating();
+
+    printf("energy_test: %d checks, %d failed\n", checks, failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,205 @@
+/* Host test: temp_filter.c on synthetic conversions. See Makefile, "make test".
+ *
+ * Feeds the filter what the MCP9600 would give it, 1/16 C every 80ms, and checks how
+ *   far behind a step or a ramp it runs and how much of the ADC noise and glitches
+ *   make it through. Exits 1 if any check failed.
+ */
+
+#include "temp_filter.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <functional>
+
+static int checks = 0, failures = 0;
+
+#define CHECK(cond, ...)                                    \
+    do {                                                    \
+        checks++;                                           \
+        if (!(cond))                                        \
+        {                                                   \
+            failures++;                                     \
+            printf("%s:%d: ", __FILE__, __LINE__);          \
+            printf(__VA_ARGS__);                            \
+            printf("\n");                                   \
+        }                                                   \
+    } while (0)
+
+static const int64_t conversion_us = 80 * 1000;
+
+// C -> what the MCP9600 would report, rounded to 1/16 C.
+static int32_t raw(double C)
+{
+    return (int32_t)std::lround(C * 16);
+}
+
+// Deterministic noise, uniform in [-amplitude, amplitude].
+static uint32_t seed = 1;
+static double noise(double amplitude)
+{
+    seed = seed * 1103515245 + 12345;
+    return amplitude * (((seed >> 8) & 0xFFFF) / 32767.5 - 1);
+}
+
+// Feeds n conversions of temperature(t in seconds), calling check after each.
+static int64_t feed(temp_filter_t *f, int64_t start_us, int n, const std::function<double(double)> &temperature,
+                    const std::function<void(double)> &check = nullptr)
+{
+    int64_t t = start_us;
+    for (int i = 0; i < n; i++)
+    {
+        t += conversion_us;
+        temp_filter_update(f, raw(temperature(t / 1e6)), t);
+        if (check)
+            check(t / 1e6);
+    }
+    return t;
+}
+
+static double filtered_C(const temp_filter_t *f)
+{
+    return temp_filter_cC(f) / 100.0;
+}
+
+// The oven door opens, or a cold probe goes into the oven: 20C -> 200C.
+static void step_response()
+{
+    temp_filter_t f;
+    temp_filter_reset(&f);
+    int64_t t = feed(&f, 0, 50, [](double) { return 20.0; });
+    CHECK(std::abs(filtered_C(&f) - 20) < 0.1, "settled at 20C, got %.2f", filtered_C(&f));
+
+    const double step_at = t / 1e6;
+    double t90 = -1, peak = 0;
+    t = feed(&f, t, 200, [](double) { return 200.0; }, [&](double now) {
+        if ((t90 < 0) && (filtered_C(&f) >= 20 + 0.9 * 180))
+            t90 = now - step_at;
+        if (filtered_C(&f) > peak)
+            peak = filtered_C(&f);
+    });
+
+    CHECK((t90 > 0) && (t90 <= 1.0), "90%% of a step within 1s, took %.2fs", t90);
+    CHECK(peak - 200 <= 0.25 * 180, "step overshoot %.1fC, at most 25%%", peak - 200);
+    CHECK(std::abs(filtered_C(&f) - 200) < 0.1, "settled at 200C after 16s, got %.2f", filtered_C(&f));
+    CHECK(std::abs(temp_filter_rate_cC(&f)) < 10, "rate back to 0, got %d cC/s", (int)temp_filter_rate_cC(&f));
+}
+
+// Preheating, about 10C a minute: tracked with no steady lag and the rate right.
+static void ramp_tracking()
+{
+    temp_filter_t f;
+    temp_filter_reset(&f);
+    const double rate = 10.0 / 60;
+    const auto ramp = [&](double now) { return 25 + rate * now; };
+
+    int64_t t = feed(&f, 0, 1000, ramp);
+    const double lag = ramp(t / 1e6) - filtered_C(&f);
+    CHECK(std::abs(lag) < 0.1, "ramp lag %.3fC", lag);
+    CHECK(std::abs(temp_filter_rate_cC(&f) - rate * 100) < 2, "ramp rate %d cC/s, want %.1f",
+          (int)temp_filter_rate_cC(&f), rate * 100);
+}
+
+// ADC noise of +-1C on a steady oven.
+static void noise_rejection()
+{
+    temp_filter_t f;
+    temp_filter_reset(&f);
+    seed = 1;
+
+    int64_t t = feed(&f, 0, 50, [](double) { return 175 + noise(1.0); });
+
+    double in_sq = 0, out_sq = 0, worst = 0;
+    const int n = 2000;
+    feed(&f, t, n, [&](double) {
+        const double C = 175 + noise(1.0);
+        in_sq += (C - 175) * (C - 175);
+        return C;
+    }, [&](double) {
+        const double e = filtered_C(&f) - 175;
+        out_sq += e * e;
+        worst = std::max(worst, std::abs(e));
+    });
+
+    const double in_rms = std::sqrt(in_sq / n);
+    const double out_rms = std::sqrt(out_sq / n);
+    CHECK(out_rms < in_rms * 0.6, "noise rms %.3fC in, %.3fC out, want 40%% taken out", in_rms, out_rms);
+    CHECK(worst < 1.0, "worst filtered error %.2fC from +-1C noise", worst);
+    CHECK(std::abs(temp_filter_rate_cC(&f)) < 50, "rate from noise alone %d cC/s", (int)temp_filter_rate_cC(&f));
+}
+
+// Single bad conversions, as from a bus glitch, are thrown out by the median.
+static void glitches_rejected()
+{
+    temp_filter_t f;
+    temp_filter_reset(&f);
+    int64_t t = feed(&f, 0, 50, [](double) { return 150.0; });
+
+    int i = 0;
+    double worst = 0;
+    feed(&f, t, 500, [&](double) { return (i++ % 10 == 5) ? ((i % 20 < 10) ? 1000.0 : -100.0) : 150.0; },
+         [&](double) { worst = std::max(worst, std::abs(filtered_C(&f) - 150)); });
+
+    CHECK(worst < 0.01, "isolated glitches moved the output by %.2fC", worst);
+}
+
+// Late and missed conversions, and a sensor gap long enough to start over.
+static void timing()
+{
+    temp_filter_t f;
+    temp_filter_reset(&f);
+    const double rate = 0.5;
+
+    // Every third conversion missed: the prediction uses the real interval.
+    int64_t t = 0;
+    for (int i = 0; i < 600; i++)
+    {
+        t += (i % 3 == 2) ? 2 * conversion_us : conversion_us;
+        temp_filter_update(&f, raw(50 + rate * t / 1e6), t);
+    }
+    const double lag = 50 + rate * t / 1e6 - filtered_C(&f);
+    CHECK(std::abs(lag) < 0.1, "lag with missed conversions %.3fC", lag);
+
+    // A repeated timestamp is ignored rather than dividing by zero.
+    temp_filter_update(&f, raw(500), t);
+    CHECK(std::abs(50 + rate * t / 1e6 - filtered_C(&f)) < 0.1, "conversion with no time step ignored");
+
+    // After 3s without a reading the old state is dropped, not extrapolated.
+    t += 3 * 1000 * 1000;
+    temp_filter_update(&f, raw(80), t);
+    CHECK(std::abs(filtered_C(&f) - 80) < 0.1, "restarted at 80C after a gap, got %.2f", filtered_C(&f));
+    CHECK(temp_filter_rate_cC(&f) == 0, "rate cleared after a gap");
+}
+
+static void conversions()
+{
+    CHECK(raw16_to_cC(raw(100)) == 10000, "1600/16 C is 10000 cC");
+    CHECK(raw16_to_cC(-16) == -100, "-1C");
+    CHECK(cC_to_raw16(10000) == 1600, "10000 cC is 1600/16 C");
+    CHECK(cC_to_raw16(3) == 0 && cC_to_raw16(4) == 1 && cC_to_raw16(-4) == -1, "rounded to nearest 1/16");
+    CHECK(cC_to_cF(10000) == 21200 && cF_to_cC(21200) == 10000, "100C is 212F");
+    CHECK(delta_cC_to_cF(100) == 180, "a 1C difference is 1.8F");
+
+    for (int32_t cC = -5000; cC <= 120000; cC += 7)
+    {
+        const int32_t back = raw16_to_cC(cC_to_raw16(cC));
+        if (std::abs(back - cC) > 4)
+        {
+            CHECK(false, "%d cC round trips to %d", (int)cC, (int)back);
+            break;
+        }
+    }
+}
+
+int main()
+{
+    step_response();
+    ramp_tracking();
+    noise_rejection();
+    glitches_rejected();
+    timing();
+    conversions();
+
+    printf("filter_test: %d checks, %d failed\n", checks, failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,260 @@
+#include "host.h"
+
+#include "mcp9600.h"
+#include "bay_sensor.h"
+#include "i2c_bus.h"
+#include "httpd.h"
+#include "events.h"
+#include "binlog.h"
+#include "history.h"
+#include "cook_log.h"
+#include "energy.h"
+#include "metrics.h"
+#include "trace.h"
+
+#include "esp_timer.h"
+#include "driver/gpio.h"
+
+#include <cstdio>
+#include <cstring>
+
+/* Host stand-ins for everything the controller and the cook timers call outside
+ *   themselves. Inputs come from the trace being replayed, everything that only
+ *   reports (history, cook log, energy, metrics, binlog) goes nowhere.
+ */
+
+namespace host
+{
+
+int64_t now_us = 0;
+uint8_t inputs = 0;
+uint8_t present = 0;
+bay_reading_t bay = {};
+sample_ring_t samples = {};
+gpio_isr_t overtemp_isr = nullptr;
+bool verbose = false;
+void (*on_event)(StoveEvent event, int argument, const char *detail) = nullptr;
+std::string response;
+Traced traced = {};
+
+} // namespace host
+
+// As in stovectrl.cpp
+constexpr const static gpio_num_t Door_Open = gpio_num_t(4);
+constexpr const static gpio_num_t Cancel    = gpio_num_t(1);
+constexpr const static gpio_num_t Over_Temp = gpio_num_t(6);
+
+static uint32_t levels[GPIO_NUM_MAX];
+
+int64_t esp_timer_get_time()
+{
+    return host::now_us;
+}
+
+esp_err_t gpio_config(const gpio_config_t *)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio, uint32_t level)
+{
+    levels[gpio] = level;
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio)
+{
+    switch ((int)gpio)
+    {
+    case Cancel:    return !!(host::inputs & TRACE_IN_CANCEL);
+    case Door_Open: return !!(host::inputs & TRACE_IN_DOOR_OPEN);
+    case Over_Temp: return !(host::inputs & TRACE_IN_OVER_TEMP);    // active low
+    default:        return levels[gpio];
+    }
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio, gpio_isr_t handler, void *)
+{
+    if (gpio == Over_Temp)
+        host::overtemp_isr = handler;
+    return ESP_OK;
+}
+
+bool mcp9600_present(int probe)
+{
+    return host::present & (1 << probe);
+}
+
+const char *mcp9600_name(int)
+{
+    return "";
+}
+
+esp_err_t mcp9600_set_alert(int, int32_t, uint8_t)
+{
+    return ESP_OK;
+}
+
+void mcp9600_move_alert_limit(int, int32_t)
+{
+}
+
+void mcp9600_sample()
+{
+}
+
+const sample_ring_t *mcp9600_samples()
+{
+    return &host::samples;
+}
+
+mcp9600_config_t mcp9600_config(int)
+{
+    return mcp9600_config_t{};
+}
+
+mcp9600_health_t mcp9600_health(int)
+{
+    return mcp9600_health_t{};
+}
+
+void bay_sensor_sample()
+{
+}
+
+bay_reading_t bay_sensor_latest()
+{
+    return host::bay;
+}
+
+uint32_t i2c_bus_resets()
+{
+    return 0;
+}
+
+void EV_post(enum StoveEvent event, int argument, const char *detail)
+{
+    if (host::verbose)
+        printf("%10.3f  event %d, argument %d, %s\n", host::now_us / 1e6, event, argument, detail);
+    if (host::on_event)
+        host::on_event(event, argument, detail);
+}
+
+void binlog_write(binlog_id_t, const char *, int, ...)
+{
+}
+
+void metrics_record(metric_t, uint32_t)
+{
+}
+
+void history_push(const history_record_t *)
+{
+}
+
+uint32_t cook_log_start()
+{
+    return 0;
+}
+
+void cook_log_end()
+{
+}
+
+void cook_log_sample(const history_record_t *)
+{
+}
+
+uint32_t cook_log_session()
+{
+    return 0;
+}
+
+void cook_log_summary(const cook_summary_t *)
+{
+}
+
+void energy_tick(bool, bool, int64_t, uint32_t)
+{
+}
+
+void energy_session_start()
+{
+}
+
+void energy_session_end()
+{
+}
+
+energy_on_time_t energy_session()
+{
+    return energy_on_time_t{};
+}
+
+energy_on_time_t energy_lifetime()
+{
+    return energy_on_time_t{};
+}
+
+// A replayed POST only carries its body.
+esp_err_t get_content(httpd_req_t *req, char *content, size_t content_size)
+{
+    if (req->content_len >= content_size)
+        return ESP_FAIL;
+
+    memcpy(content, req->content, req->content_len);
+    content[req->content_len] = 0;
+    return ESP_OK;
+}
+
+esp_err_t ack_http_post(httpd_req_t *)
+{
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *, const char *)
+{
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *, const char *buf, ssize_t len)
+{
+    host::response.assign(buf, (len < 0) ? strlen(buf) : len);
+    return ESP_OK;
+}
+
+// The first chunk starts a new response, as the last chunk (empty) ends one.
+esp_err_t httpd_resp_send_chunk(httpd_req_t *, const char *buf, ssize_t len)
+{
+    static bool sending = false;
+    if (!sending)
+        host::response.clear();
+    if (buf)
+        host::response.append(buf, (len < 0) ? strlen(buf) : len);
+    sending = buf && len;
+    return ESP_OK;
+}
+
+// The controller's side of the trace, kept for replay.cpp to compare.
+void trace_tick_begin(int64_t, uint32_t, uint8_t inputs)
+{
+    host::traced = {};
+    host::traced.begun = true;
+    host::traced.inputs = inputs;
+}
+
+void trace_bay(const bay_reading_t *)
+{
+}
+
+void trace_sample(const sample_t *)
+{
+    host::traced.samples++;
+}
+
+void trace_tick_end(uint16_t outputs, int32_t target_cF)
+{
+    host::traced.ended = true;
+    host::traced.outputs = outputs;
+    host::traced.target_cF = target_cF;
+}
@@ -0,0 +1,52 @@
+#ifndef REPLAY_HOST_H
+#define REPLAY_HOST_H
+
+#include "trace.h"
+#include "bay_sensor.h"
+#include "sample_ring.h"
+#include "driver/gpio.h"
+#include "events.h"
+
+#include <string>
+
+/* State behind the host stand-ins for ESP-IDF and the parts of the firmware that talk
+ *   to hardware. replay.cpp fills in what the next tick will read, runs it, and looks
+ *   at what the controller handed to the trace_* calls.
+ */
+namespace host
+{
+
+// What the hardware reads as for the tick.
+extern int64_t now_us;
+extern uint8_t inputs;              // TRACE_IN_*, for the Cancel, door and alert pins
+extern uint8_t present;             // trace_header_t.present
+extern bay_reading_t bay;
+extern sample_ring_t samples;
+
+// The over temperature ISR, once SC_init_overtemp() has attached it.
+extern gpio_isr_t overtemp_isr;
+
+// Print events as the controller posts them.
+extern bool verbose;
+
+// Called for every event posted, for the tests.
+extern void (*on_event)(StoveEvent event, int argument, const char *detail);
+
+// The body of the last response sent by a GET handler.
+extern std::string response;
+
+// From the controller's trace_* calls, for the last tick.
+struct Traced
+{
+    bool begun;
+    bool ended;
+    uint8_t inputs;
+    int samples;
+    uint16_t outputs;
+    int32_t target_cF;
+};
+extern Traced traced;
+
+} // namespace host
+
+#endif // REPLAY_HOST_H
@@ -0,0 +1,344 @@
+/* Host tool: replays a trace of the control loop through the real StoveCtrl and cook timers.
+ *
+ *   make
+ *   replay [-v] [capture ...]        (stdin without arguments)
+ *
+ * Reads the 'T' lines of a console capture or of GET /trace, see main/trace.h. Each tick
+ *   gets the inputs, probe samples and POSTs the oven saw, the cook timers' clock is
+ *   moved on by as much as the oven's was, and afterwards the relays, fans, light, mode
+ *   and target are compared with what the oven recorded. Exits 1 if any tick diverged.
+ * A trace taken from boot replays exactly. One switched on later starts from a controller
+ *   that has only just booted, so expect it to differ until the two have settled the same.
+ */
+
+#include "host.h"
+
+#include "stovectrl.h"
+#include "cooktimers.h"
+#include "binlog_text.h"
+#include "history.h"
+#include "led.h"
+#include "virtualclock.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <utility>
+
+#define MAX_REPORTED 20
+
+struct Tick
+{
+    trace_tick_t t;
+    bool has_bay;
+    trace_bay_t bay;
+    std::vector<trace_sample_t> samples;
+    std::vector<std::pair<std::string, std::string>> commands;
+};
+
+static const struct
+{
+    const char *uri;
+    esp_err_t (*handler)(httpd_req_t *req);
+} handlers[] = {
+    { "/set_target_temp",        set_target_temperature },
+    { "/set_downdraft_fan",      set_downdraft_fan },
+    { "/set_convection_fan",     set_convection_fan },
+    { "/set_light",              set_light },
+    { "/set_cooling_fan",        set_cooling_fan },
+    { "/set_use_top_element",    set_use_top_element },
+    { "/set_use_bottom_element", set_use_bottom_element },
+    { "/set_stove_mode",         set_stove_mode },
+    { "/add_timer",              add_timer },
+    { "/rm_timer",               rm_timer },
+};
+
+static trace_header_t header;
+static bool have_header = false;
+static bool running = false;
+static bool done = false;
+static uint32_t next_seq = 0;
+static int64_t first_us = 0;
+
+static unsigned ticks = 0, posts = 0, skipped = 0, gaps = 0, divergences = 0;
+
+static esp_err_t led_set_pixel(led_strip_t *, uint32_t, uint32_t, uint32_t, uint32_t) { return ESP_OK; }
+static esp_err_t led_refresh(led_strip_t *, uint32_t) { return ESP_OK; }
+static esp_err_t led_clear(led_strip_t *, uint32_t) { return ESP_OK; }
+static esp_err_t led_del(led_strip_t *) { return ESP_OK; }
+static led_strip_t led = { led_set_pixel, led_refresh, led_clear, led_del };
+
+static bool unpack(Tick &tick, const uint8_t *data, int len)
+{
+    int at = sizeof(tick.t);
+    if (len < at)
+        return false;
+    memcpy(&tick.t, data, sizeof(tick.t));
+
+    tick.has_bay = tick.t.inputs & TRACE_IN_BAY;
+    if (tick.has_bay)
+    {
+        if (len < at + (int)sizeof(tick.bay))
+            return false;
+        memcpy(&tick.bay, data + at, sizeof(tick.bay));
+        at += sizeof(tick.bay);
+    }
+
+    tick.samples.resize(tick.t.samples);
+    if (len < at + tick.t.samples * (int)sizeof(trace_sample_t))
+        return false;
+    memcpy(tick.samples.data(), data + at, tick.t.samples * sizeof(trace_sample_t));
+    at += tick.t.samples * sizeof(trace_sample_t);
+
+    for (int i = 0; i < tick.t.commands; i++)
+    {
+        trace_command_t c;
+        if (len < at + (int)sizeof(c))
+            return false;
+        memcpy(&c, data + at, sizeof(c));
+        at += sizeof(c);
+
+        if (len < at + c.uri_len + c.content_len)
+            return false;
+        tick.commands.emplace_back(std::string((const char *)data + at, c.uri_len),
+                                   std::string((const char *)data + at + c.uri_len, c.content_len));
+        at += c.uri_len + c.content_len;
+    }
+
+    return at == len;
+}
+
+static std::string describe(uint16_t outputs, int32_t target_cF)
+{
+    static const char *modes[] = { "off", "manual", "timers", "?" };
+
+    char text[128];
+    snprintf(text, sizeof(text), "%s%s%s, convection %d, downdraft %d%s%s, target %.2fF",
+             modes[TRACE_OUT_MODE(outputs)],
+             (outputs & TRACE_OUT_BAKE) ? ", bake" : "",
+             (outputs & TRACE_OUT_BROIL) ? ", broil" : "",
+             HISTORY_CONVECTION(outputs), HISTORY_DOWNDRAFT(outputs),
+             (outputs & HISTORY_COOLING_FAN) ? ", cooling fan" : "",
+             (outputs & HISTORY_LIGHT) ? ", light" : "",
+             target_cF / 100.0);
+    return text;
+}
+
+static void diverged(const Tick &tick, const char *what, const std::string &recorded, const std::string &replayed)
+{
+    if (++divergences > MAX_REPORTED)
+        return;
+
+    printf("%10.3f  tick %u: %s diverged\n"
+           "            recorded %s\n"
+           "            replayed %s\n",
+           (tick.t.now_us - first_us) / 1e6, (unsigned)tick.t.seq, what, recorded.c_str(), replayed.c_str());
+}
+
+// The controller as it comes up at boot, at the time of the first tick.
+static void boot(const Tick &tick, const char *where)
+{
+    if (tick.t.seq != header.first_tick)
+        printf("%s: the trace has lost its start, replaying from tick %u\n", where, (unsigned)tick.t.seq);
+    else if (tick.t.seq != 1)
+        printf("%s: traced from tick %u, not from boot, expect differences at first\n", where, (unsigned)tick.t.seq);
+
+    host::now_us = tick.t.now_us;
+    host::inputs = tick.t.inputs;
+    host::present = header.present;
+    first_us = tick.t.now_us;
+
+    VirtualClock::reset();
+    SC_init_gpio();
+    SC_init(&led);
+    SC_init_overtemp();
+    CT_task_init();
+
+    next_seq = tick.t.seq;
+    running = true;
+}
+
+static void replay(const Tick &tick, const char *where)
+{
+    if (!running)
+        boot(tick, where);
+
+    if (tick.t.seq != next_seq)
+    {
+        printf("%s: ticks %u to %u are missing\n", where, (unsigned)next_seq, (unsigned)tick.t.seq - 1);
+        gaps++;
+    }
+    next_seq = tick.t.seq + 1;
+
+    VirtualClock::advance(VirtualClock::duration(tick.t.now_us - host::now_us));
+    host::now_us = tick.t.now_us;
+    host::inputs = tick.t.inputs;
+
+    if (tick.has_bay)
+    {
+        host::bay.ok = tick.bay.ok;
+        host::bay.temp_cC = tick.bay.temp_cC;
+        host::bay.humidity_c = tick.bay.humidity_c;
+        host::bay.time_us = tick.t.now_us - tick.bay.age_us;
+        host::bay.errors = tick.bay.errors;
+    }
+
+    for (const trace_sample_t &s : tick.samples)
+    {
+        const sample_t sample = { tick.t.now_us - s.age_us, s.value, s.flags, s.source };
+        sample_ring_push(&host::samples, &sample);
+    }
+
+    // What happened between the last tick and this one: POSTs, then the alert.
+    for (const auto &command : tick.commands)
+    {
+        posts++;
+        if (host::verbose)
+            printf("%10.3f  POST %s %s\n", (tick.t.now_us - first_us) / 1e6, command.first.c_str(), command.second.c_str());
+
+        bool found = false;
+        for (const auto &h : handlers)
+        {
+            if (command.first != h.uri)
+                continue;
+
+            httpd_req_t req = { command.first.c_str(), command.second.size(), command.second.c_str() };
+            h.handler(&req);
+            found = true;
+        }
+        if (!found)
+            printf("%s: no replay for POST %s, ignored\n", where, command.first.c_str());
+    }
+
+    if ((tick.t.inputs & TRACE_IN_TRIPPED) && host::overtemp_isr)
+        host::overtemp_isr(nullptr);
+
+    SC_task_event();
+    CT_tick();
+    ticks++;
+
+    const host::Traced &traced = host::traced;
+    const uint8_t recorded_inputs = tick.t.inputs & ~TRACE_IN_BAY;
+    if (traced.inputs != recorded_inputs)
+        diverged(tick, "inputs", std::to_string(recorded_inputs), std::to_string(traced.inputs));
+    if (traced.samples != tick.t.samples)
+        diverged(tick, "samples taken", std::to_string(tick.t.samples), std::to_string(traced.samples));
+    if ((traced.outputs != tick.t.outputs) || (traced.target_cF != tick.t.target_cF))
+        diverged(tick, "outputs", describe(tick.t.outputs, tick.t.target_cF), describe(traced.outputs, traced.target_cF));
+}
+
+static void record(const uint8_t *data, int len, const char *where)
+{
+    if (done)
+        return;
+
+    if (data[0] == TRACE_HEADER)
+    {
+        trace_header_t h;
+        if (len != sizeof(h))
+        {
+            printf("%s: bad trace header\n", where);
+            return;
+        }
+        memcpy(&h, data, sizeof(h));
+
+        // Another boot, or tracing switched off and on again.
+        if (running)
+        {
+            printf("%s: a new trace starts here, stopping\n", where);
+            done = true;
+            return;
+        }
+        if (h.version != TRACE_VERSION)
+        {
+            printf("%s: trace version %u, this replay reads %u\n", where, h.version, TRACE_VERSION);
+            done = true;
+            return;
+        }
+
+        header = h;
+        have_header = true;
+        return;
+    }
+
+    Tick tick;
+    if ((data[0] != TRACE_TICK) || !unpack(tick, data, len))
+    {
+        printf("%s: bad trace record\n", where);
+        return;
+    }
+
+    // Without the header we don't know which probes were fitted.
+    if (!have_header)
+    {
+        skipped++;
+        return;
+    }
+
+    replay(tick, where);
+}
+
+static void read_trace(FILE *in, const char *name)
+{
+    char line[4096];
+    unsigned number = 0;
+    while (fgets(line, sizeof(line), in))
+    {
+        number++;
+        if ((line[0] != BINLOG_STX) || (line[1] != TRACE_TAG))
+            continue;
+
+        line[strcspn(line, "\r\n")] = 0;
+
+        char where[256];
+        snprintf(where, sizeof(where), "%s:%u", name, number);
+
+        uint8_t data[TRACE_RECORD_MAX + 1];
+        const int len = binlog_unbase64(data, sizeof(data), line + 2);
+        if ((len < 2) || (binlog_crc8(data, len - 1) != data[len - 1]))
+        {
+            printf("%s: bad trace line\n", where);
+            continue;
+        }
+
+        record(data, len - 1, where);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int first = 1;
+    if ((argc > 1) && !strcmp(argv[1], "-v"))
+    {
+        host::verbose = true;
+        first++;
+    }
+
+    if (first == argc)
+        read_trace(stdin, "stdin");
+
+    for (int i = first; i < argc; i++)
+    {
+        FILE *in = fopen(argv[i], "r");
+        if (!in)
+        {
+            perror(argv[i]);
+            return 2;
+        }
+        read_trace(in, argv[i]);
+        fclose(in);
+    }
+
+    if (skipped)
+        printf("%u ticks before the trace header skipped\n", skipped);
+    if (!ticks)
+    {
+        printf("No trace to replay\n");
+        return 2;
+    }
+
+    printf("%u ticks over %.1fs, %u POSTs, %u gaps, %u diverged\n",
+           ticks, (host::now_us - first_us) / 1e6, posts, gaps, divergences);
+    return divergences ? 1 : 0;
+}
@@ -0,0 +1,12 @@
+#ifndef DRIVER_I2C_H
+#define DRIVER_I2C_H
+
+#include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
+
+typedef int i2c_port_t;
+typedef void *i2c_cmd_handle_t;
+
+#define I2C_LINK_RECOMMENDED_SIZE(n) (2 * (n) * 20 + 64)
+
+#endif // DRIVER_I2C_H
@@ -0,0 +1,32 @@
+#ifndef ESP_HTTP_SERVER_H
+#define ESP_HTTP_SERVER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "esp_err.h"
+
+typedef void *httpd_handle_t;
+
+// The replay hands a handler the recorded body, nothing else is used.
+typedef struct httpd_req
+{
+    const char *uri;
+    size_t content_len;
+    const char *content;
+} httpd_req_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type);
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t len);
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ESP_HTTP_SERVER_H
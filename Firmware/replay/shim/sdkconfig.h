@@ -0,0 +1,6 @@
+#ifndef SDKCONFIG_H
+#define SDKCONFIG_H
+
+// The host build is configured as the WROOM boards: no PSRAM.
+
+#endif // SDKCONFIG_H
@@ -0,0 +1,227 @@
+/* Host test: thermocouple.cpp against NIST ITS-90. See Makefile, "make test".
+ *
+ * The fixed point tables are checked at the printed NIST table points, and then densely
+ *   over each type's whole range against the reference functions evaluated here in
+ *   double, both directions. Exits 1 if any check failed.
+ */
+
+#include "thermocouple.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+
+static int checks = 0, failures = 0;
+
+#define CHECK(cond, ...)                                    \
+    do {                                                    \
+        checks++;                                           \
+        if (!(cond))                                        \
+        {                                                   \
+            failures++;                                     \
+            printf("%s:%d: ", __FILE__, __LINE__);          \
+            printf(__VA_ARGS__);                            \
+            printf("\n");                                   \
+        }                                                   \
+    } while (0)
+
+struct Point
+{
+    int C;
+    double mV;
+};
+
+// NIST ITS-90 tables, https://srdata.nist.gov/its90/main/ (printed to 1uV).
+static const Point nist_k[] = {
+    { -200, -5.891 }, { -100, -3.554 }, { 0, 0.000 }, { 100, 4.096 }, { 200, 8.138 },
+    { 300, 12.209 }, { 400, 16.397 }, { 500, 20.644 }, { 600, 24.905 }, { 700, 29.129 },
+    { 800, 33.275 }, { 900, 37.326 }, { 1000, 41.276 }, { 1100, 45.119 }, { 1200, 48.838 },
+    { 1300, 52.410 }, { 1372, 54.886 },
+};
+
+static const Point nist_j[] = {
+    { -200, -7.890 }, { -100, -4.633 }, { 0, 0.000 }, { 100, 5.269 }, { 200, 10.779 },
+    { 300, 16.327 }, { 400, 21.848 }, { 500, 27.393 }, { 600, 33.102 }, { 700, 39.132 },
+    { 760, 42.919 }, { 800, 45.494 }, { 900, 51.877 }, { 1000, 57.953 }, { 1100, 63.792 },
+    { 1200, 69.553 },
+};
+
+// The NIST reference functions, E in mV for T in C.
+static double polynomial(const double *c, int n, double t)
+{
+    double e = 0;
+    for (int i = n; i-- > 0;)
+        e = e * t + c[i];
+    return e;
+}
+
+static double reference_mV(tc_type_t type, double t)
+{
+    static const double k_low[] = {
+        0.000000000000E+00,  0.394501280250E-01,  0.236223735980E-04, -0.328589067840E-06,
+       -0.499048287770E-08, -0.675090591730E-10, -0.574103274280E-12, -0.310888728940E-14,
+       -0.104516093650E-16, -0.198892668780E-19, -0.163226974860E-22 };
+    static const double k_high[] = {
+       -0.176004136860E-01,  0.389212049750E-01,  0.185587700320E-04, -0.994575928740E-07,
+        0.318409457190E-09, -0.560728448890E-12,  0.560750590590E-15, -0.320207200030E-18,
+        0.971511471520E-22, -0.121047212750E-25 };
+    static const double j_low[] = {
+        0.000000000000E+00,  0.503811878150E-01,  0.304758369300E-04, -0.856810657200E-07,
+        0.132281952950E-09, -0.170529583370E-12,  0.209480906970E-15, -0.125383953360E-18,
+        0.156317256970E-22 };
+    static const double j_high[] = {
+        0.296456256810E+03, -0.149761277860E+01,  0.317871039240E-02, -0.318476867010E-05,
+        0.157208190040E-08, -0.306913690560E-12 };
+
+    if (type == TC_TYPE_J)
+        return (t <= 760) ? polynomial(j_low, 9, t) : polynomial(j_high, 6, t);
+
+    if (t <= 0)
+        return polynomial(k_low, 11, t);
+    return polynomial(k_high, 10, t) + 0.118597600000E+00 * std::exp(-0.118343200000E-03 * std::pow(t - 0.126968600000E+03, 2));
+}
+
+// dE/dT in uV per C, to turn voltage errors into temperature errors.
+static double seebeck_uV(tc_type_t type, double t)
+{
+    return (reference_mV(type, t + 0.5) - reference_mV(type, t - 0.5)) * 1000;
+}
+
+static void nist_table(tc_type_t type, const Point *points, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        const Point &p = points[i];
+        const double ref_mV = reference_mV(type, p.C);
+        CHECK(std::abs(ref_mV - p.mV) <= 0.0005, "type %s: reference function %.4f mV at %dC, NIST %.3f",
+              tc_type_name(type), ref_mV, p.C, p.mV);
+
+        const int32_t nV = tc_nV_from_cC(type, p.C * 100);
+        CHECK(std::abs(nV - p.mV * 1e6) <= 1000, "type %s: %d nV at %dC, NIST %.3f mV",
+              tc_type_name(type), (int)nV, p.C, p.mV);
+
+        // The printed table is rounded to 1uV, allow that as a temperature.
+        const double allowed_cC = 50000.0 / seebeck_uV(type, p.C) + 2;
+        const int32_t cC = tc_cC_from_nV(type, (int32_t)std::lround(p.mV * 1e6));
+        CHECK(std::abs(cC - p.C * 100) <= allowed_cC, "type %s: %.3f mV read as %d cC, NIST %dC",
+              tc_type_name(type), p.mV, (int)cC, p.C);
+    }
+}
+
+// Every 0.37C from t_min to t_max against the reference function, within allowed C.
+static void whole_range(tc_type_t type, int t_min, int t_max, double allowed)
+{
+    double worst_from = 0, worst_to = 0;
+    int worst_from_at = 0, worst_to_at = 0;
+
+    for (int32_t cC = t_min * 100; cC <= t_max * 100; cC += 37)
+    {
+        const double t = cC / 100.0;
+        const double ref_nV = reference_mV(type, t) * 1e6;
+        const double uV_per_C = seebeck_uV(type, t);
+
+        // Forward, as a temperature error.
+        const double from = (tc_nV_from_cC(type, cC) - ref_nV) / (uV_per_C * 1000);
+        if (std::abs(from) > std::abs(worst_from))
+        {
+            worst_from = from;
+            worst_from_at = cC;
+        }
+
+        // Inverse of the exact voltage.
+        const double to = (tc_cC_from_nV(type, (int32_t)std::lround(ref_nV)) - cC) / 100.0;
+        if (std::abs(to) > std::abs(worst_to))
+        {
+            worst_to = to;
+            worst_to_at = cC;
+        }
+    }
+
+    CHECK(std::abs(worst_from) < allowed, "type %s: E(T) off by %.3fC at %.2fC", tc_type_name(type), worst_from, worst_from_at / 100.0);
+    CHECK(std::abs(worst_to) < allowed, "type %s: T(E) off by %.3fC at %.2fC", tc_type_name(type), worst_to, worst_to_at / 100.0);
+}
+
+// What the MCP9600 sees: the difference between the junctions.
+static void cold_junction(tc_type_t type)
+{
+    const int hot[] = { -50, 20, 100, 250, 500, 800 };
+    const int cold[] = { -20, 0, 23, 35, 60 };
+
+    for (int h : hot)
+        for (int c : cold)
+        {
+            const int32_t measured_nV = (int32_t)std::lround((reference_mV(type, h) - reference_mV(type, c)) * 1e6);
+            const int32_t cC = tc_hot_junction_cC(type, measured_nV, c * 100);
+            CHECK(std::abs(cC - h * 100) <= 3, "type %s: %dC hot, %dC cold read as %d cC",
+                  tc_type_name(type), h, c, (int)cC);
+        }
+
+    // Hot at ambient reads ambient whatever the cold junction does.
+    CHECK(std::abs(tc_hot_junction_cC(type, 0, 2500) - 2500) <= 1, "type %s: no voltage reads the cold junction", tc_type_name(type));
+}
+
+static void range(tc_type_t type, int t_min, int t_max)
+{
+    const int32_t lo = tc_nV_from_cC(type, t_min * 100);
+    const int32_t hi = tc_nV_from_cC(type, t_max * 100);
+
+    CHECK(tc_nV_in_range(type, lo) && tc_nV_in_range(type, hi) && tc_nV_in_range(type, 0),
+          "type %s: ends of the range are in range", tc_type_name(type));
+    CHECK(!tc_nV_in_range(type, lo - 1000) && !tc_nV_in_range(type, hi + 1000),
+          "type %s: beyond the range is out of range", tc_type_name(type));
+    CHECK(tc_cC_from_nV(type, lo - 1000000) == t_min * 100, "type %s: clamped low", tc_type_name(type));
+    CHECK(tc_cC_from_nV(type, hi + 1000000) == t_max * 100, "type %s: clamped high", tc_type_name(type));
+}
+
+static void calibration()
+{
+    CHECK(tc_calibrate(nullptr, 12345) == 12345, "no calibration");
+
+    tc_calibration_t cal = {};
+    CHECK(tc_calibrate(&cal, 12345) == 12345, "empty calibration");
+
+    // Boiling water read 99.5C: an offset.
+    cal.count = 1;
+    cal.measured_cC[0] = 9950;
+    cal.actual_cC[0] = 10000;
+    CHECK(tc_calibrate(&cal, 20000) == 20050, "one point is an offset");
+
+    // Ice 0.5C and boiling 99C: a line, extended past both ends.
+    cal.count = 2;
+    cal.measured_cC[0] = 50;
+    cal.actual_cC[0] = 0;
+    cal.measured_cC[1] = 9900;
+    cal.actual_cC[1] = 10000;
+    CHECK(tc_calibrate(&cal, 50) == 0 && tc_calibrate(&cal, 9900) == 10000, "two points hit both");
+    CHECK(std::abs(tc_calibrate(&cal, 19750) - 20000) <= 1, "line extended above, got %d", (int)tc_calibrate(&cal, 19750));
+    CHECK(std::abs(tc_calibrate(&cal, -9800) + 10000) <= 1, "line extended below, got %d", (int)tc_calibrate(&cal, -9800));
+
+    // Three points: the segments join.
+    cal.count = 3;
+    cal.measured_cC[2] = 20000;
+    cal.actual_cC[2] = 20500;
+    CHECK(tc_calibrate(&cal, 9900) == 10000, "middle point hit");
+    CHECK(tc_calibrate(&cal, 14950) == 15250, "second segment, got %d", (int)tc_calibrate(&cal, 14950));
+    CHECK(tc_calibrate(&cal, 30100) == 31000, "last segment extended, got %d", (int)tc_calibrate(&cal, 30100));
+}
+
+int main()
+{
+    nist_table(TC_TYPE_K, nist_k, sizeof(nist_k) / sizeof(nist_k[0]));
+    nist_table(TC_TYPE_J, nist_j, sizeof(nist_j) / sizeof(nist_j[0]));
+    // The curves bend hardest at the cold end, where an oven never goes.
+    whole_range(TC_TYPE_K, -50, 1372, 0.02);
+    whole_range(TC_TYPE_J, -50, 1200, 0.02);
+    whole_range(TC_TYPE_K, -200, -50, 0.05);
+    whole_range(TC_TYPE_J, -200, -50, 0.05);
+    cold_junction(TC_TYPE_K);
+    cold_junction(TC_TYPE_J);
+    range(TC_TYPE_K, -200, 1372);
+    range(TC_TYPE_J, -200, 1200);
+    calibration();
+
+    CHECK(tc_mcp9600_type(TC_TYPE_K) == 0 && tc_mcp9600_type(TC_TYPE_J) == 1, "MCP9600 type register");
+
+    printf("thermocouple_test: %d checks, %d failed\n", checks, failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,398 @@
+/* Host test: cook timer scenarios on the virtual clock. See Makefile, "make test".
+ *
+ * Drives cooktimers.cpp through its POST handlers and CT_update()/CT_tick() the way
+ *   the control task does, 20 times a second, with the controller's side faked here.
+ *   Hours of program run in well under a second. Exits 1 if any check failed.
+ */
+
+#include "host.h"
+
+#include "cooktimers.h"
+#include "stovectrl.h"
+#include "mcp9600.h"
+#include "elapsedtimer.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <climits>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std::chrono;
+using namespace std::chrono_literals;
+
+static int checks = 0, failures = 0;
+
+#define CHECK(cond, ...)                                    \
+    do {                                                    \
+        checks++;                                           \
+        if (!(cond))                                        \
+        {                                                   \
+            failures++;                                     \
+            printf("%s:%d: ", __FILE__, __LINE__);          \
+            printf(__VA_ARGS__);                            \
+            printf("\n");                                   \
+        }                                                   \
+    } while (0)
+
+// The controller, as far as the cook timers see it.
+static double target = -1;
+static bool stable = false;
+static int32_t probe_cF[MCP9600_MAX_PROBES];
+
+void SC_set_target_temp(double t)
+{
+    target = t;
+}
+
+bool SC_target_stable()
+{
+    return stable;
+}
+
+int SC_preheat_eta_s()
+{
+    return 0;
+}
+
+int32_t SC_probe_temp_cF(int probe)
+{
+    return ((probe >= 0) && (probe < MCP9600_MAX_PROBES)) ? probe_cF[probe] : INT32_MIN;
+}
+
+// Seconds of virtual time since the test started.
+static double now_s()
+{
+    return duration<double>(cook_clock::now().time_since_epoch()).count();
+}
+
+struct Event
+{
+    StoveEvent event;
+    int argument;
+    std::string detail;
+    double time;
+};
+static std::vector<Event> events;
+
+static void on_event(StoveEvent event, int argument, const char *detail)
+{
+    events.push_back({ event, argument, detail, now_s() });
+}
+
+static void post(esp_err_t (*handler)(httpd_req_t *), const char *uri, const std::string &body)
+{
+    httpd_req_t req = { uri, body.size(), body.c_str() };
+    handler(&req);
+}
+
+// The uids in /timers, in order.
+static std::vector<int> timer_uids()
+{
+    get_timers(nullptr);
+
+    std::vector<int> uids;
+    const std::string &json = host::response;
+    for (size_t at = json.find("\"uid\":"); at != std::string::npos; at = json.find("\"uid\":", at + 1))
+        uids.push_back(atoi(json.c_str() + at + 6));
+    return uids;
+}
+
+// Adds a timer, returns its uid or 0 if it wasn't taken.
+static int add(const std::string &body)
+{
+    const std::vector<int> before = timer_uids();
+    post(add_timer, "/add_timer", body);
+    const std::vector<int> after = timer_uids();
+
+    int uid = 0;
+    for (int u : after)
+        if (u > uid)
+            uid = u;
+    return (after.size() > before.size()) ? uid : 0;
+}
+
+static void remove(int uid)
+{
+    post(rm_timer, "/rm_timer", std::to_string(uid));
+}
+
+static void clear()
+{
+    for (int uid : timer_uids())
+        remove(uid);
+    events.clear();
+    target = -1;
+    stable = false;
+    for (auto &t : probe_cF)
+        t = INT32_MIN;
+}
+
+// As the control task: 50ms ticks.
+static void run(duration<double> d)
+{
+    const auto end = cook_clock::now() + duration_cast<cook_clock::duration>(d);
+    while (cook_clock::now() < end)
+    {
+        VirtualClock::advance(50ms);
+        CT_update();
+        CT_tick();
+    }
+}
+
+static void program_runs_in_order()
+{
+    clear();
+    add("duration=600&argument=350&action=Cook");
+    add("duration=60&argument=425&action=Cook");
+    add("duration=0&argument=0&action=Stop+Cook");
+
+    run(1s);
+    CHECK(target == 350, "first step sets 350, target %g", target);
+    run(598s);
+    CHECK(target == 350 && timer_uids().size() == 3, "first step still running at 599s");
+    run(2s);
+    CHECK(target == 425, "second step at 601s, target %g", target);
+    run(60s);
+    CHECK(target == 0, "stop after the second step, target %g", target);
+    CHECK(timer_uids().empty(), "program finished, %zu timers left", timer_uids().size());
+}
+
+static void preheat_waits_for_the_oven()
+{
+    clear();
+    add("duration=300&argument=350&action=Cook&preheat=1");
+    add("duration=0&argument=0&action=Stop+Cook");
+
+    run(3600s);
+    CHECK(target == 350, "preheat step sets its target");
+    CHECK(timer_uids().size() == 2, "preheat step doesn't count while the oven heats");
+    CHECK(host::response.find("\"waiting\": 1") != std::string::npos, "preheat step shown waiting");
+
+    stable = true;
+    run(299s);
+    CHECK(target == 350, "preheat step counts from stable, still on at 299s");
+    run(2s);
+    CHECK(target == 0, "preheat step done 300s after stable, target %g", target);
+}
+
+static void removing_the_running_step()
+{
+    clear();
+    const int first = add("duration=1000&argument=350&action=Cook");
+    add("duration=1000&argument=200&action=Cook");
+    add("duration=0&argument=0&action=Stop+Cook");
+
+    run(500s);
+    remove(first);
+    run(1s);
+    CHECK(target == 200, "next step starts once the running one is removed, target %g", target);
+    run(1000s);
+    CHECK(target == 0, "rest of the program runs, target %g", target);
+}
+
+// Countdowns of random length, some removed half way, alongside a program.
+static void countdowns_fire_on_time()
+{
+    clear();
+
+    struct Countdown
+    {
+        int seconds;
+        double added;
+        bool removed;
+    };
+    std::map<int, Countdown> countdowns;
+
+    add("duration=20000&argument=350&action=Cook");
+
+    uint32_t seed = 12345;
+    for (int i = 0; i < 25; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        const int length = 1 + (seed >> 8) % 5000;
+        const int uid = add("duration=" + std::to_string(length) + "&argument=0&action=" +
+                            ((i % 2) ? "Countdown" : "Alert+Webpage"));
+        CHECK(uid, "countdown %d taken", i);
+        countdowns[uid] = { length, now_s(), false };
+        run(seconds((seed >> 4) % 200));
+    }
+
+    // Remove every third one that is still pending.
+    int n = 0;
+    for (auto &[uid, c] : countdowns)
+        if ((n++ % 3 == 0) && (now_s() < c.added + c.seconds))
+        {
+            remove(uid);
+            c.removed = true;
+        }
+
+    run(6000s);
+
+    std::map<int, int> fired;
+    for (const Event &e : events)
+    {
+        if (e.event != SE_Timer_Fired)
+            continue;
+        fired[e.argument]++;
+
+        const auto it = countdowns.find(e.argument);
+        CHECK(it != countdowns.end(), "unknown timer %d fired", e.argument);
+        if (it == countdowns.end())
+            continue;
+
+        const Countdown &c = it->second;
+        const double late = e.time - (c.added + c.seconds);
+        CHECK((late >= 0) && (late <= 1.05), "timer %d of %ds fired %.2fs after its time", e.argument, c.seconds, late);
+    }
+
+    for (const auto &[uid, c] : countdowns)
+        CHECK(fired[uid] == (c.removed ? 0 : 1), "timer %d (%s) fired %d times", uid, c.removed ? "removed" : "kept", fired[uid]);
+
+    const std::vector<int> left = timer_uids();
+    CHECK((left.size() == 1) && (countdowns.count(left[0]) == 0), "only the program step is left, %zu timers", left.size());
+    CHECK(target == 350, "program unaffected by the countdowns");
+}
+
+static void day_long_program()
+{
+    clear();
+    add("duration=86400&argument=170&action=Cook");
+    add("duration=0&argument=0&action=Stop+Cook");
+    const double start = now_s();
+    const int countdown = add("duration=86400&argument=0&action=Countdown");
+
+    run(86399s);
+    CHECK(target == 170, "24h step still on, target %g", target);
+    CHECK(events.empty(), "24h countdown not yet fired");
+    run(3s);
+    CHECK(target == 0, "24h step done, target %g", target);
+    CHECK((events.size() == 1) && (events[0].argument == countdown), "24h countdown fired once");
+    if (!events.empty())
+        CHECK(events[0].time - start >= 86400, "24h countdown fired %.2fs early", 86400 - (events[0].time - start));
+}
+
+static void probe_step_runs_until_reached()
+{
+    clear();
+    host::present = 0x03;
+    probe_cF[1] = 10000;
+    add("duration=0&argument=325&action=Cook&preheat=0&probe=1&until=165");
+    add("duration=0&argument=0&action=Stop+Cook");
+
+    run(7200s);
+    CHECK(target == 325, "open ended probe step runs on, target %g", target);
+
+    probe_cF[1] = 16500;
+    run(1s);
+    CHECK(target == 0, "probe step ends at the probe target, target %g", target);
+    CHECK(!events.empty() && (events[0].event == SE_Target_Reached) && (events[0].argument == 165),
+          "probe target reached posted");
+}
+
+// A probe step that is done as soon as it starts still reports it.
+static void probe_step_already_at_target()
+{
+    clear();
+    host::present = 0x03;
+    probe_cF[1] = 17000;
+    add("duration=0&argument=325&action=Cook&preheat=0&probe=1&until=165");
+    add("duration=0&argument=0&action=Stop+Cook");
+
+    run(1s);
+    CHECK(target == 0, "probe step at its target ends at once, target %g", target);
+    CHECK(!events.empty() && (events[0].event == SE_Target_Reached) && (events[0].argument == 165),
+          "probe target reached posted on the first tick");
+}
+
+// Without its probe an open ended step would never end.
+static void probe_step_gives_up_on_a_lost_probe()
+{
+    clear();
+    host::present = 0x03;
+    probe_cF[1] = 10000;
+    add("duration=0&argument=325&action=Cook&preheat=0&probe=1&until=165");
+    add("duration=0&argument=0&action=Stop+Cook");
+
+    run(600s);
+    probe_cF[1] = INT32_MIN;
+    run(20s);
+    probe_cF[1] = 10100;
+    run(1s);
+    probe_cF[1] = INT32_MIN;
+    run(29s);
+    CHECK(target == 325, "a probe back within 30s keeps the step going, target %g", target);
+    run(2s);
+    CHECK(target == 0, "step ends 30s after the probe is lost, target %g", target);
+    CHECK(!events.empty() && (events[0].event == SE_Fault) && (events[0].detail == "probe_lost"),
+          "probe lost posted as a fault");
+}
+
+// None of these may be taken, or take the controller down.
+static void bad_timers_are_refused()
+{
+    clear();
+    host::present = 0x03;
+    const char *bad[] = {
+        "duration=&argument=350&action=Cook",
+        "duration=ten&argument=350&action=Cook",
+        "duration=-5&argument=350&action=Cook",
+        "duration=99999999999999999999&argument=350&action=Cook",
+        "duration=60&argument=&action=Cook",
+        "duration=60&argument=nan&action=Cook",
+        "duration=60&argument=350x&action=Cook",
+        "duration=0&argument=325&action=Cook&preheat=0&probe=&until=165",
+        "duration=0&argument=325&action=Cook&preheat=0&probe=1&until=",
+        "duration=0&argument=325&action=Cook&preheat=0&probe=8&until=165",
+        "duration=0&argument=325&action=Cook&preheat=0&probe=-1&until=165",
+        "duration=0&argument=325&action=Cook&preheat=0&probe=5&until=165",     // not fitted
+        "duration=0&argument=325&action=Cook&preheat=0&probe=1&until=0",
+        "duration=0&argument=325&action=Cook&preheat=0&probe=1&until=165.5",
+        "duration=60&argument=350",
+        "argument=350&duration=60&action=Cook",
+    };
+    for (const char *body : bad)
+        CHECK(!add(body), "refused %s", body);
+
+    CHECK(add("duration=0&argument=325&action=Cook&preheat=0&probe=1&until=165"), "a good probe step is taken");
+}
+
+static void timer_pause_resume()
+{
+    Timer timer(60s);
+    timer.start();
+    VirtualClock::advance(10s);
+    timer.pause();
+    VirtualClock::advance(100s);
+    CHECK(!timer.isRunning() && (timer.elapsedTime() == 10s), "paused timer holds 10s");
+    timer.start();
+    VirtualClock::advance(45s);
+    CHECK(!timer.timedout(), "55s of 60s not timed out");
+    VirtualClock::advance(6s);
+    CHECK(timer.timedout(), "61s of 60s timed out");
+    timer.reset();
+    CHECK(!timer.isRunning() && (timer.elapsedTime() == 0s), "reset clears it");
+}
+
+int main()
+{
+    host::on_event = on_event;
+    VirtualClock::reset();
+    CT_task_init();
+
+    program_runs_in_order();
+    preheat_waits_for_the_oven();
+    removing_the_running_step();
+    countdowns_fire_on_time();
+    day_long_program();
+    probe_step_runs_until_reached();
+    probe_step_already_at_target();
+    probe_step_gives_up_on_a_lost_probe();
+    bad_timers_are_refused();
+    timer_pause_resume();
+
+    printf("timer_test: %d checks, %d failed\n", checks, failures);
+    return failures ? 1 : 0;
+}